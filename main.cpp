@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 #include <stdint.h>
 
@@ -16,11 +18,38 @@
 
 #include "I2S.h"
 #include "iir.h"
+#include "packed16.h"
+#include "control.h"
+#include "graph.h"
+#include "requantize.h"
+#include "governor.h"
+#include "selftest.h"
+#include "spectrum.h"
+#include "preset.h"
+#include "silence.h"
+#include "convolve.h"
 
 #include "pio_i2s.pio.h"
 
+/* check the filter kernels against their references at boot */
+#ifndef DSP_SELFTEST
+#define DSP_SELFTEST (0)
+#endif
+
+/* 16 bit mode packs one L/R frame per 32 bit word, halving DMA
+    bandwidth and interrupt rate per frame; the rings keep their size
+    and hold twice the frames */
+#ifndef PACKED_16
+#define PACKED_16 (0)
+#endif
+
+#if PACKED_16
+const int sampleRate = 96000;
+const int bitDepth = 16;
+#else
 const int sampleRate = 48000;
 const int bitDepth = 32;
+#endif
 const float mclkFactor = 512.0;
 
 const int input_BCLK_Base = 3;
@@ -31,130 +60,1104 @@ const int mclk_pin = 15;
 
 mutex_t _pioMutex; /* external definition in comaptability.h */
 
-int __not_in_flash_func(main)()
+/* report telemetry about ten times per second */
+const uint32_t telemetryBlocks = sampleRate / 10 / GRAPH_BLOCK_SIZE;
+
+/* time budget of one block, the load governor's reference */
+const uint32_t blockPeriodUs = 1000000 * GRAPH_BLOCK_SIZE / sampleRate;
+
+/* blocks in one lap of the I2S rings, a frame takes two words unless packed */
+const uint32_t lapBlocks = I2S_BUFFER_COUNT * I2S_BUFFER_WORDS / (GRAPH_BLOCK_SIZE * (PACKED_16 ? 1 : 2));
+
+/* the only links between the control core and the audio core */
+static CommandQueue commandQueue;
+static TelemetryQueue telemetryQueue;
+static TapQueue tapQueue;
+
+/* control core only, reads the tap */
+static SpectrumAnalyzer analyzer;
+
+/* statically allocated, the ring buffers are too large for a core stack */
+static PIOProgram mclkPio(&pio_i2s_mclk_program);
+static I2S I2S_Output(OUTPUT, output_BCLK_Base, output_DATA, bitDepth);
+static I2S I2S_Input(INPUT, input_BCLK_Base, input_DATA, bitDepth);
+
+/* set by the audio core if it fails to start, printed by core0 */
+static const char *volatile audioFault = nullptr;
+/* set by the audio core once its setup, which runs from flash, is done,
+    core0 writes no preset flash before that */
+static volatile bool audioReady = false;
+
+/* largest sample the makeup gain below takes without
+    wrapping, gains reach +12dB so louder samples saturate there */
+#define SAMPLE_LIMIT ((1 << 24) - 1)
+
+static inline int32_t __not_in_flash_func(saturate24)(int32_t s)
 {
-    /* binary info */
-    bi_decl(bi_program_description("pico-dsp - a simple audio dsp"));
-    bi_decl(bi_1pin_with_name(input_BCLK_Base, "I2S Input (ADC) BCLK - DON'T USE (invalid timing)"));
-    bi_decl(bi_1pin_with_name(input_BCLK_Base + 1, "I2S Input (ADC) LRCK - DON'T USE (invalid timing)"));
-    bi_decl(bi_1pin_with_name(input_DATA, "I2S Input (ADC) Data"));
-    bi_decl(bi_1pin_with_name(output_BCLK_Base, "I2S Output (DAC) BCLK"));
-    bi_decl(bi_1pin_with_name(output_BCLK_Base + 1, "I2S Output (DAC) LRCK"));
-    bi_decl(bi_1pin_with_name(output_DATA, "I2S Output (DAC) Data"));
-    bi_decl(bi_1pin_with_name(mclk_pin, "I2S MCLK"));
+    return s > SAMPLE_LIMIT ? SAMPLE_LIMIT : (s < -SAMPLE_LIMIT ? -SAMPLE_LIMIT : s);
+}
 
-    /* start stdio
-        enables printf and friends
-        uses either uart or usb as defined by cmake
-    */
-    stdio_init_all();
+#if PACKED_16
+/* filter nodes are the stage halves (2 * stage + channel),
+    gain nodes are the channels */
+#define STAGES (3)
+#else
+/* the DAC takes 24 of the 32 bits, the rest is requantized with noise shaping */
+const uint8_t dacBits = 24;
+const uint8_t requantizeOrder = 3;
 
-    /* on-board led */
-    gpio_init(PICO_DEFAULT_LED_PIN);
-    gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
-    gpio_put(PICO_DEFAULT_LED_PIN, 1);
+/* driver time alignment range, 10ms */
+const uint32_t maxAlignment = sampleRate / 100;
 
-    /* PIOs wait for IRQ7, so enable before loading */
-    irq_set_enabled(7, true);
+/* signal flow, compiled into a flat plan before the audio core starts */
+enum
+{
+    in_left,
+    in_right,
+    lowpass1,
+    lowpass2,
+    split_left,
+    shaping1,
+    merge_left,
+    trim_left,
+    align_left,
+    out_left,
+    highpass1,
+    highpass2,
+    trim_right,
+    align_right,
+    out_right,
+    node_count
+};
 
-    /* undervolt core voltage
-        might enable higher clock speeds */
-    // vreg_set_voltage(VREG_VOLTAGE_1_00);
-    // sleep_ms(1000); // vreg settle
+static graph_node_t topology[node_count];
+static Graph graph;
 
-    /* overclock system */
-    // set_sys_clock_khz(230000, true);
-    // sleep_ms(100);
+/* presets go to the audio core whole, core0 keeps a copy of the live settings */
+static PresetQueue presetQueue;
+static PresetBank presets;
+static preset_t current;
 
-    IIR lowpass1(lowpass,   880, BIQUAD_Q_ORDER_4_1, 0.0, sampleRate);
-    IIR lowpass2(lowpass,   880, BIQUAD_Q_ORDER_4_2, 0.0, sampleRate);
-    IIR highpass1(highpass, 880, BIQUAD_Q_ORDER_4_1, 0.0, sampleRate);
-    IIR highpass2(highpass, 880, BIQUAD_Q_ORDER_4_2, 0.0, sampleRate);
+/*
+    the convolution engine runs on core0, in the interrupt the audio
+    core raises through the SIO FIFO after queueing a block
+*/
+static ConvolveQueue convolveJobs;
+static ConvolveQueue convolveResults;
+static Convolver convolver;
 
-    IIR shaping1(peak, 80, BIQUAD_Q_ORDER_2, 6.0, sampleRate);
+static void describe_graph()
+{
+    topology[in_left]    = graph_input(0);
+    topology[in_right]   = graph_input(1);
+
+    topology[lowpass1]   = graph_biquad(in_left,  biquad_design(lowpass, 880, BIQUAD_Q_ORDER_4_1, 0.0, sampleRate)); // +0dB
+    topology[lowpass2]   = graph_biquad(lowpass1, biquad_design(lowpass, 880, BIQUAD_Q_ORDER_4_2, 0.0, sampleRate)); // +0dB
+    /* the bass peak runs on the low band, at Fs / SUBBAND_FACTOR */
+    topology[split_left] = graph_split(lowpass2);
+    topology[shaping1]   = graph_optional(graph_biquad(split_left, biquad_design(peak, 80, BIQUAD_Q_ORDER_2, 6.0, sampleRate / SUBBAND_FACTOR))); // +6dB
+    topology[merge_left] = graph_merge(shaping1, split_left);
+    topology[trim_left]  = graph_gain(merge_left, 0.0);
+    topology[align_left] = graph_delay(trim_left, 0, maxAlignment);
+    topology[out_left]   = graph_output(align_left, 0);
+
+    topology[highpass1]  = graph_biquad(in_right,  biquad_design(highpass, 880, BIQUAD_Q_ORDER_4_1, 0.0, sampleRate)); // +0dB
+    topology[highpass2]  = graph_biquad(highpass1, biquad_design(highpass, 880, BIQUAD_Q_ORDER_4_2, 0.0, sampleRate)); // +0dB
+    topology[trim_right]  = graph_gain(highpass2, 0.0);
+    /* starts at the left branch's subband latency */
+    topology[align_right] = graph_delay(trim_right, SUBBAND_LATENCY, maxAlignment);
+    topology[out_right]   = graph_output(align_right, 1);
+}
+
+static void print_plan()
+{
+    uint32_t budget = (uint32_t)(((uint64_t)clock_get_hz(clk_sys) * GRAPH_BLOCK_SIZE) / sampleRate);
+    printf("plan: %u steps, ~%lu cycles per block (%lu%% of %lu)\n",
+           (unsigned)graph.steps(),
+           (unsigned long)graph.estimateCycles(),
+           (unsigned long)(graph.estimateCycles() * 100 / budget),
+           (unsigned long)budget);
+    printf("delay memory: %u of %u words\n",
+           (unsigned)graph.delayWords(), (unsigned)DELAY_ARENA_WORDS);
+}
+#endif
+
+/* linear ramp to zero over one block, ends processing before an idle stretch */
+static inline int32_t __not_in_flash_func(fade_out)(int32_t s, size_t i)
+{
+    return (int32_t)(((int64_t)s * (int32_t)(GRAPH_BLOCK_SIZE - 1 - i)) / GRAPH_BLOCK_SIZE);
+}
+
+static void __not_in_flash_func(audio_halt)(const char *reason)
+{
+    audioFault = reason;
+    while (1);
+}
+
+/*
+    audio core
+    runs only the audio path, never touches stdio and never blocks
+    on anything but the I2S ring buffers
+*/
+static void __not_in_flash_func(audio_main)()
+{
+    /* PIOs wait for IRQ7, so enable before loading */
+    irq_set_enabled(7, true);
+
+#if PACKED_16
+    /* each stage pairs the left and right filter of the crossover */
+    StereoIIR16 stage1(
+        biquad_design(lowpass,  880, BIQUAD_Q_ORDER_4_1, 0.0, sampleRate),
+        biquad_design(highpass, 880, BIQUAD_Q_ORDER_4_1, 0.0, sampleRate));
+    StereoIIR16 stage2(
+        biquad_design(lowpass,  880, BIQUAD_Q_ORDER_4_2, 0.0, sampleRate),
+        biquad_design(highpass, 880, BIQUAD_Q_ORDER_4_2, 0.0, sampleRate));
+    StereoIIR16 stage3(
+        biquad_design(peak, 80, BIQUAD_Q_ORDER_2, 6.0, sampleRate),
+        biquad_design(none, 0, 0, 0.0, sampleRate));
+
+    StereoIIR16 *chain[STAGES] = {&stage1, &stage2, &stage3};
+    int32_t gain[2] = {GAIN_UNITY, GAIN_UNITY};
+#else
+    static preset_t preset;
+#endif
 
     /* load mclk pio */
     int off = 0, sm = 0;
     PIO pio;
-    PIOProgram* mclkPio = new PIOProgram(&pio_i2s_mclk_program);
-    if(mclkPio->prepare(&pio, &sm, &off))  {
+    if(mclkPio.prepare(&pio, &sm, &off))  {
         pio_i2s_mclk_program_init(pio, sm, off, mclk_pin);
         // set mclk to a multiple of fs
         float mclkFrequency = mclkFactor  * (float)sampleRate;
         pio_sm_set_clkdiv(pio, sm, (float)clock_get_hz(clk_sys) / mclkFrequency);
     }   else    {
-        printf("failed to allocate MCLK PIO");
-        while(1);
+        audio_halt("failed to allocate MCLK PIO");
     }
 
-    /* initilize I2S */
-    I2S I2S_Output(OUTPUT, output_BCLK_Base, output_DATA, bitDepth);
-    I2S I2S_Input(INPUT, input_BCLK_Base, input_DATA, bitDepth);
-
+    /* initilize I2S
+        the DMA interrupts get registered on this core */
     I2S_Input.setFrequency(sampleRate);
     I2S_Output.setFrequency(sampleRate);
 
     if (!I2S_Output.begin())
     {
-        printf("failed to initialize I2S Output!");
-        while (1);
+        audio_halt("failed to initialize I2S Output!");
     }
 
     if (!I2S_Input.begin())
     {
-        printf("failed to initialize I2S Input!");
-        while (1);
+        audio_halt("failed to initialize I2S Input!");
     }
 
     /* loop variables */
+#if PACKED_16
+    uint32_t frames[GRAPH_BLOCK_SIZE];
+    dsp_tap_t tapBlock;
+#else
     int32_t left_rx = 0, right_rx = 0;
     int32_t left_tx = 0, right_tx = 0;
+    int32_t *in[2] = {graph.input(0), graph.input(1)};
+    const int32_t *out[2];
+    int32_t tx[2][GRAPH_BLOCK_SIZE];
+    static int32_t silentBlock[GRAPH_BLOCK_SIZE];
 
-    uint32_t counter = 0;
-    absolute_time_t start = 0, end = 0;
-    int64_t diff = 0;
+    Requantizer requantize[2];
+    requantize[0].configure(32 - dacBits, requantizeOrder, true);
+    requantize[1].configure(32 - dacBits, requantizeOrder, true);
+    /* as last commanded, the governor drops the shaping under load */
+    uint8_t shapingOrder = requantizeOrder;
+    bool dither = true;
 
-    printf("entering main loop");
-    gpio_put(PICO_DEFAULT_LED_PIN, 0);
+    /* the convolved channel comes back one block later, the other one
+        waits in the ping-pong buffers, [block][channel] */
+    static int32_t convolveDelay[2][2][GRAPH_BLOCK_SIZE];
+    static convolve_block_t convolveResult;
+    int8_t convolveChannel = -1;
+    uint32_t convolveSequence = 0;
+    bool convolvePending = false;
+    bool convolving = false;
+    uint8_t convolveSide = 0;
+#endif
+
+    bool bypass = false;
+    int8_t tapChannel = -1;
+
+    SilenceDetector silence;
+    silence.configure(silence_threshold(SILENCE_THRESHOLD_DB), silence_hold(SILENCE_HOLD_MS, sampleRate));
+    silence_state_t lastQuiet = silence_active;
+
+    /* the rings prime during the first lap, their xruns are no overload */
+    LoadGovernor governor(lapBlocks);
+    shed_level_t shed = shed_none;
+    uint32_t xrunsSeen = 0;
+
+    dsp_telemetry_t telemetry = {};
+    dsp_command_t cmd;
+    uint32_t telemetryCountdown = telemetryBlocks;
+    uint32_t busy = 0;
+    uint32_t start = 0;
+    uint32_t periodStart = time_us_32();
+    uint32_t asleepStart = 0;
 
     /* synchronously start all pio0s and clocks */
     pio_enable_sm_mask_in_sync(pio0, 0xF);
     /* run PIOs in sync using falling edge of IRQ7 */
     irq_set_enabled(7, false);
 
+    /* from here on core1 runs from RAM only */
+    audioReady = true;
+
     while (1)
     {
-        I2S_Input.read(&left_rx, true);
-        I2S_Input.read(&right_rx, true);
+#if PACKED_16
+        int32_t inputPeak = 0;
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            I2S_Input.read((int32_t *)&frames[i], true);
+
+            int32_t left = unpackLeft16(frames[i]);
+            int32_t right = unpackRight16(frames[i]);
+            left = left < 0 ? -left : left;
+            right = right < 0 ? -right : right;
+            inputPeak = left > inputPeak ? left : inputPeak;
+            inputPeak = right > inputPeak ? right : inputPeak;
+        }
+
+        start = time_us_32();
+
+        /* 16 bit full scale to graph level */
+        bool processing = !bypass && shed < shed_bypass;
+        silence_state_t quiet = silence.update(inputPeak << 8);
+
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            uint32_t frame = frames[i];
+
+            /* 1 bit of headroom for the +6dB shaping,
+                matches the net gain of the 32 bit path */
+            frame = pack16(unpackLeft16(frame) >> 1, unpackRight16(frame) >> 1);
+
+            /* no economy variant in 16 bit, it already is one */
+            if (processing && quiet == silence_idle)
+            {
+                frame = 0;
+            }
+            else if (processing)
+            {
+                stage1.filter(&frame); // lowpass1 | highpass1
+                stage2.filter(&frame); // lowpass2 | highpass2
+                if (shed < shed_optional)
+                {
+                    stage3.filter(&frame); // shaping1 | none
+                }
+            }
+
+            /* Q16 gain, limited to +12dB so the product fits 32 bits */
+            int32_t left = unpackLeft16(frame);
+            int32_t right = unpackRight16(frame);
+            if (gain[0] != GAIN_UNITY || gain[1] != GAIN_UNITY)
+            {
+                left = saturate16((left * (gain[0] >> 4)) >> 12);
+                right = saturate16((right * (gain[1] >> 4)) >> 12);
+                frame = pack16(left, right);
+            }
+            if (processing && quiet == silence_stop)
+            {
+                left = fade_out(left, i);
+                right = fade_out(right, i);
+                frame = pack16(left, right);
+            }
+
+            I2S_Output.write((int32_t)frame, false);
+
+            /* 16 bit full scale to graph level */
+            tapBlock.s[i] = (tapChannel ? right : left) << 9;
+
+            left = left < 0 ? -left : left;
+            right = right < 0 ? -right : right;
+#else
+        int32_t inputPeak = 0;
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            I2S_Input.read(&left_rx, true);
+            I2S_Input.read(&right_rx, true);
+
+            /* scale 24 bit sample to 32 bit range */
+            in[0][i] = left_rx >> 8;
+            in[1][i] = right_rx >> 8;
+
+            int32_t left = in[0][i] < 0 ? -in[0][i] : in[0][i];
+            int32_t right = in[1][i] < 0 ? -in[1][i] : in[1][i];
+            inputPeak = left > inputPeak ? left : inputPeak;
+            inputPeak = right > inputPeak ? right : inputPeak;
+        }
+
+        start = time_us_32();
+
+        bool processing = !bypass && shed < shed_bypass;
+        silence_state_t quiet = silence.update(inputPeak);
+
+        if (!processing)
+        {
+            out[0] = in[0];
+            out[1] = in[1];
+        }
+        else if (quiet == silence_idle)
+        {
+            /* the histories were cleared when processing stopped */
+            out[0] = silentBlock;
+            out[1] = silentBlock;
+        }
+        else
+        {
+            graph.process();
+            out[0] = graph.output(0);
+            out[1] = graph.output(1);
+        }
+
+        if (convolveChannel >= 0 && processing && quiet != silence_idle)
+        {
+            const int32_t *delayed[2] = {convolveDelay[convolveSide][0], convolveDelay[convolveSide][1]};
+            convolveSide ^= 1;
+            memcpy(convolveDelay[convolveSide][0], out[0], sizeof(convolveDelay[0][0]));
+            memcpy(convolveDelay[convolveSide][1], out[1], sizeof(convolveDelay[0][0]));
+
+            /* the engine's answer to the previous block, late ones are stale */
+            bool wet = false;
+            while (convolveResults.pop(&convolveResult))
+            {
+                wet = convolvePending && convolveResult.sequence == convolveSequence - 1;
+            }
+            if (convolvePending && !wet)
+            {
+                telemetry.convolveMisses++;
+            }
+            out[0] = delayed[0];
+            out[1] = delayed[1];
+            if (wet)
+            {
+                out[convolveChannel] = convolveResult.s;
+            }
+
+            /* a gap in the sequence makes the engine forget its history */
+            convolve_block_t convolveBlock;
+            convolveBlock.sequence = convolveSequence++;
+            memcpy(convolveBlock.s, convolveDelay[convolveSide][convolveChannel], sizeof(convolveBlock.s));
+            convolvePending = convolveJobs.push(convolveBlock);
+            /* the doorbell, never waits: one word in the FIFO is enough */
+            if (convolvePending && multicore_fifo_wready())
+            {
+                sio_hw->fifo_wr = convolveBlock.sequence;
+                __sev();
+            }
+            convolving = true;
+        }
+        else if (convolving)
+        {
+            /* resumes from a silent previous block and a fresh history */
+            memset(convolveDelay, 0, sizeof(convolveDelay));
+            convolveSequence++;
+            convolvePending = false;
+            convolving = false;
+        }
+
+        if (tapChannel >= 0 && shed < shed_optional)
+        {
+            /* dropped while the analyzer is busy, never waits */
+            dsp_tap_t tapBlock;
+            memcpy(tapBlock.s, out[tapChannel], sizeof(tapBlock.s));
+            tapQueue.push(tapBlock);
+        }
+
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            /* makeup gain
+                +6dB max -> scale by 2^1
+                headroom is 2^8 - 2^1 -> 2^7 */
+            tx[0][i] = saturate24(out[0][i]) << 7;
+            tx[1][i] = saturate24(out[1][i]) << 7;
+        }
+
+        if (processing && quiet == silence_stop)
+        {
+            /* what is left of the tail is below the threshold already */
+            for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+            {
+                tx[0][i] = fade_out(tx[0][i], i);
+                tx[1][i] = fade_out(tx[1][i], i);
+            }
+        }
+
+        /* round to the DAC word instead of letting it truncate,
+            idle blocks stay digital silence (the DAC may mute on it) */
+        if (!processing || quiet != silence_idle)
+        {
+            requantize[0].process(tx[0], GRAPH_BLOCK_SIZE);
+            requantize[1].process(tx[1], GRAPH_BLOCK_SIZE);
+        }
+
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            left_tx = tx[0][i];
+            right_tx = tx[1][i];
+
+            I2S_Output.write(left_tx, false);
+            I2S_Output.write(right_tx, false);
+
+            int32_t left = left_tx < 0 ? -left_tx : left_tx;
+            int32_t right = right_tx < 0 ? -right_tx : right_tx;
+#endif
+
+            if (left > telemetry.peak[0])
+            {
+                telemetry.peak[0] = left;
+            }
+            if (right > telemetry.peak[1])
+            {
+                telemetry.peak[1] = right;
+            }
+        }
+
+#if PACKED_16
+        if (tapChannel >= 0 && shed < shed_optional)
+        {
+            tapQueue.push(tapBlock);
+        }
+#endif
+
+        /* restart every history from silence, so the next active
+            block does not depend on how long the idle stretch was */
+        if (processing && quiet == silence_stop)
+        {
+#if PACKED_16
+            stage1.clear();
+            stage2.clear();
+            stage3.clear();
+#else
+            graph.clear();
+            requantize[0].configure(32 - dacBits, shed >= shed_optional ? 0 : shapingOrder, dither);
+            requantize[1].configure(32 - dacBits, shed >= shed_optional ? 0 : shapingOrder, dither);
+#endif
+        }
+
+        uint32_t blockBusy = time_us_32() - start;
+        uint32_t blockLoad = (blockBusy * 1000) / blockPeriodUs;
+        busy += blockBusy;
+        if (blockLoad > telemetry.loadPeak)
+        {
+            telemetry.loadPeak = blockLoad;
+        }
+        telemetry.frames += GRAPH_BLOCK_SIZE;
+
+        /* the first block after an idle stretch runs at once from the
+            cleared histories, its time is what waking up costs */
+        if (processing && lastQuiet == silence_idle && quiet == silence_active)
+        {
+            telemetry.wakeUs = blockBusy;
+        }
+        lastQuiet = quiet;
+
+        /* any new over-/underflow since the last block counts */
+        telemetry.xruns[0] = I2S_Input.getXruns(&telemetry.xrunTime[0]);
+        telemetry.xruns[1] = I2S_Output.getXruns(&telemetry.xrunTime[1]);
+        uint32_t xruns = telemetry.xruns[0] + telemetry.xruns[1];
+
+        if (governor.update(blockLoad, xruns != xrunsSeen))
+        {
+            shed = governor.level();
+#if !PACKED_16
+            graph.setSkipOptional(shed >= shed_optional);
+            graph.setEconomy(shed >= shed_economy);
+            requantize[0].configure(32 - dacBits, shed >= shed_optional ? 0 : shapingOrder, dither);
+            requantize[1].configure(32 - dacBits, shed >= shed_optional ? 0 : shapingOrder, dither);
+#endif
+        }
+        xrunsSeen = xruns;
+
+        /* commands take effect at block boundaries */
+        while (commandQueue.pop(&cmd))
+        {
+            switch (cmd.type)
+            {
+            case command_gain:
+#if PACKED_16
+                gain[cmd.node & 1] = cmd.gain;
+#else
+                graph.setGain(cmd.node, cmd.gain);
+#endif
+                break;
+            case command_filter:
+#if PACKED_16
+                chain[cmd.node / 2]->setCoefficients(cmd.node & 1, cmd.coeffs);
+#else
+                graph.setBiquad(cmd.node, cmd.coeffs);
+#endif
+                break;
+            case command_delay:
+#if !PACKED_16
+                graph.setDelay(cmd.node, cmd.delay);
+#endif
+                break;
+            case command_bypass:
+                bypass = cmd.bypass;
+                break;
+            case command_requantize:
+#if !PACKED_16
+                shapingOrder = cmd.order;
+                dither = cmd.dither;
+                requantize[0].configure(32 - dacBits, shed >= shed_optional ? 0 : shapingOrder, dither);
+                requantize[1].configure(32 - dacBits, shed >= shed_optional ? 0 : shapingOrder, dither);
+#endif
+                break;
+            case command_tap:
+                tapChannel = cmd.tap;
+                break;
+            case command_silence:
+                silence.configure(cmd.threshold, cmd.hold);
+                break;
+            case command_convolve:
+#if !PACKED_16
+                if (cmd.convolve != convolveChannel)
+                {
+                    memset(convolveDelay, 0, sizeof(convolveDelay));
+                    convolveSequence++;
+                    convolvePending = false;
+                    convolving = false;
+                }
+                convolveChannel = cmd.convolve;
+#endif
+                break;
+            }
+        }
+
+#if !PACKED_16
+        /* every setting of a preset changes at the same block boundary,
+            biquads and gains crossfade, delays always do */
+        if (presetQueue.pop(&preset))
+        {
+            for (size_t i = 0; i < preset.count; i++)
+            {
+                const preset_entry_t &e = preset.entry[i];
+                switch (e.type)
+                {
+                case command_filter:
+                    graph.setBiquad(e.node, e.coeffs, true);
+                    break;
+                case command_gain:
+                    graph.setGain(e.node, e.gain, true);
+                    break;
+                case command_delay:
+                    graph.setDelay(e.node, e.delay);
+                    break;
+                }
+            }
+        }
+#endif
+
+        if (--telemetryCountdown == 0)
+        {
+            telemetryCountdown = telemetryBlocks;
+            uint32_t now = time_us_32();
+            telemetry.load = (busy * 1000) / (now - periodStart);
+            uint32_t asleep = I2S_Input.getAsleepUs() + I2S_Output.getAsleepUs();
+            telemetry.asleep = ((asleep - asleepStart) * 1000) / (now - periodStart);
+            asleepStart = asleep;
+            telemetry.shed = shed;
+            telemetry.shedChanges = governor.changes();
+            telemetry.silent = silence.idle();
+            /* dropped if core0 is not keeping up, never waits */
+            telemetryQueue.push(telemetry);
+            telemetry.loadPeak = 0;
+            telemetry.peak[0] = 0;
+            telemetry.peak[1] = 0;
+            busy = 0;
+            periodStart = now;
+        }
+    }
+}
+
+/* reject commands that do not match the addressed node */
+static bool command_valid(const dsp_command_t &cmd)
+{
+#if PACKED_16
+    switch (cmd.type)
+    {
+    case command_gain:
+        return cmd.node < 2;
+    case command_filter:
+        return cmd.node < 2 * STAGES;
+    case command_delay:
+    case command_requantize:
+    case command_convolve:
+        return false;
+    default:
+        return true;
+    }
+#else
+    if (cmd.type == command_bypass || cmd.type == command_requantize || cmd.type == command_tap ||
+        cmd.type == command_silence)
+    {
+        return true;
+    }
+    if (cmd.type == command_convolve)
+    {
+        return cmd.convolve < 2;
+    }
+    if (cmd.node >= node_count)
+    {
+        return false;
+    }
+    switch (cmd.type)
+    {
+    case command_gain:
+        return topology[cmd.node].type == node_gain;
+    case command_delay:
+        return topology[cmd.node].type == node_delay;
+    default:
+        return topology[cmd.node].type == node_biquad;
+    }
+#endif
+}
 
-        start = get_absolute_time();
+#if !PACKED_16
+static bool preset_valid(const preset_t &p)
+{
+    for (size_t i = 0; i < p.count; i++)
+    {
+        uint8_t type = p.entry[i].type;
+        if ((type != command_filter && type != command_gain && type != command_delay) ||
+            !command_valid(preset_command(p.entry[i])))
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-        /* scale 24 bit sample to 32 bit range */
-        left_tx = left_rx >> 8;
-        right_tx = right_rx >> 8;
+/* the live settings of every node, read back before the audio core starts */
+static void preset_snapshot(preset_t &p, const char *name)
+{
+    preset_init(p, name);
+    for (uint8_t node = 0; node < node_count; node++)
+    {
+        dsp_command_t cmd = {};
+        cmd.node = node;
+        if (graph.getBiquad(node, &cmd.coeffs))
+        {
+            cmd.type = command_filter;
+        }
+        else if (graph.getGain(node, &cmd.gain))
+        {
+            cmd.type = command_gain;
+        }
+        else if (graph.getDelay(node, &cmd.delay))
+        {
+            cmd.type = command_delay;
+        }
+        else
+        {
+            continue;
+        }
+        preset_set(p, cmd);
+    }
+}
 
-        lowpass1.filter(&left_tx); // +0dB
-        lowpass2.filter(&left_tx); // +0dB
-        shaping1.filter(&left_tx); // +6dB
+/*
+    slot 0 is loaded at boot: its filters replace the designs in the
+    topology before compiling, so they are not quantized again
+*/
+static void preset_boot()
+{
+    presets.begin();
+    if (!presets.load(0, &current) || !preset_valid(current))
+    {
+        preset_init(current, "default");
+        return;
+    }
+    for (size_t i = 0; i < current.count; i++)
+    {
+        const preset_entry_t &e = current.entry[i];
+        if (e.type == command_filter)
+        {
+            graph_node_t n = graph_biquad(topology[e.node].source[0], e.coeffs);
+            n.optional = topology[e.node].optional;
+            topology[e.node] = n;
+        }
+    }
+}
 
-        highpass1.filter(&right_tx); // +0dB
-        highpass2.filter(&right_tx); // +0dB
+/* gains and delays after compiling, they have no design to replace */
+static void preset_boot_settings()
+{
+    for (size_t i = 0; i < current.count; i++)
+    {
+        const preset_entry_t &e = current.entry[i];
+        if (e.type == command_gain)
+        {
+            graph.setGain(e.node, e.gain);
+        }
+        else if (e.type == command_delay)
+        {
+            graph.setDelay(e.node, e.delay);
+        }
+    }
+}
 
-        /* makeup gain
-            +6dB max -> scale by 2^1
-            headroom is 2^8 - 2^1 -> 2^7 */
-        left_tx <<= 7;
-        right_tx <<= 7;
+/*
+    preset list
+    preset load <slot>
+    preset save <slot> [name]
+*/
+static void preset_line(const char *line)
+{
+    static preset_t p;
+    char verb[8];
+    char name[PRESET_NAME];
+    unsigned slot = 0;
+    int fields = sscanf(line, "preset %7s %u %15s", verb, &slot, name);
 
-        I2S_Output.write(left_tx, false);
-        I2S_Output.write(right_tx, false);
+    if (fields == 1 && !strcmp(verb, "list"))
+    {
+        for (unsigned s = 0; s < PRESET_SLOTS; s++)
+        {
+            const char *n = presets.name(s);
+            printf("preset %u %s\n", s, n ? n : "-");
+        }
+        return;
+    }
+    if (fields < 2 || slot >= PRESET_SLOTS)
+    {
+        printf("?\n");
+        return;
+    }
 
-        end = get_absolute_time();
+    if (!strcmp(verb, "load"))
+    {
+        if (!presets.load(slot, &p) || !preset_valid(p))
+        {
+            printf("?\n");
+        }
+        else if (!presetQueue.push(p))
+        {
+            printf("busy\n");
+        }
+        else
+        {
+            for (size_t i = 0; i < p.count; i++)
+            {
+                preset_set(current, preset_command(p.entry[i]));
+            }
+            memcpy(current.name, p.name, PRESET_NAME);
+        }
+    }
+    else if (!strcmp(verb, "save"))
+    {
+        if (fields == 3)
+        {
+            memset(current.name, 0, PRESET_NAME);
+            strncpy(current.name, name, PRESET_NAME - 1);
+        }
+        if (!presets.save(slot, current))
+        {
+            printf("failed\n");
+        }
+    }
+    else
+    {
+        printf("?\n");
+    }
+}
+
+/*
+    core0, raised by the audio core after each block it queued;
+    a block whose number does not follow the last one starts over
+    from silence (channel change, bypass, idle)
+*/
+static void convolve_irq()
+{
+    static uint32_t expected = 0;
+    static convolve_block_t block;
+
+    multicore_fifo_drain();
+    multicore_fifo_clear_irq();
+    while (convolveJobs.pop(&block))
+    {
+        if (block.sequence != expected)
+        {
+            convolver.reset();
+        }
+        expected = block.sequence + 1;
+        convolver.process(block.s, block.s);
+        /* dropped if the audio core is behind, it counts a miss */
+        convolveResults.push(block);
+    }
+}
+
+/* loading state, taps arrive on the lines after the command */
+static int8_t loadChannel = -1;
+static size_t loadTaps = 0;
+static size_t loadReceived = 0;
+static float loadPartition[CONVOLVE_BLOCK];
+
+/*
+    convolve <channel> <taps>   followed by the taps, any number per line
+    convolve off
+    the running response stays active until the last tap is in
+*/
+static void convolve_line(char *line)
+{
+    dsp_command_t cmd = {};
+    cmd.type = command_convolve;
+
+    if (loadTaps)
+    {
+        const char *sep = " \t";
+        for (char *t = strtok(line, sep); t; t = strtok(NULL, sep))
+        {
+            char *end;
+            float tap = strtof(t, &end);
+            if (end == t || *end || !isfinite(tap))
+            {
+                loadTaps = 0;
+                printf("?\n");
+                return;
+            }
+
+            size_t i = loadReceived % CONVOLVE_BLOCK;
+            loadPartition[i] = tap;
+            loadReceived++;
+            if (i == CONVOLVE_BLOCK - 1 || loadReceived == loadTaps)
+            {
+                convolver.load((loadReceived - 1) / CONVOLVE_BLOCK, loadPartition, i + 1);
+            }
+            if (loadReceived == loadTaps)
+            {
+                break;
+            }
+        }
+        if (loadReceived < loadTaps)
+        {
+            return;
+        }
+
+        loadTaps = 0;
+        irq_set_enabled(SIO_IRQ_PROC0, false);
+        convolver.swap((loadReceived + CONVOLVE_BLOCK - 1) / CONVOLVE_BLOCK);
+        irq_set_enabled(SIO_IRQ_PROC0, true);
+        cmd.convolve = loadChannel;
+    }
+    else
+    {
+        unsigned channel = 0, taps = 0;
+        if (!strcmp(line, "convolve off"))
+        {
+            cmd.convolve = -1;
+        }
+        else if (sscanf(line, "convolve %u %u", &channel, &taps) == 2 && channel < 2 &&
+                 taps && taps <= CONVOLVE_MAX_TAPS)
+        {
+            loadChannel = (int8_t)channel;
+            loadTaps = taps;
+            loadReceived = 0;
+            return;
+        }
+        else
+        {
+            printf("?\n");
+            return;
+        }
+    }
+
+    if (!commandQueue.push(cmd))
+    {
+        printf("busy\n");
+    }
+}
+#endif
+
+int main()
+{
+    /* binary info */
+    bi_decl(bi_program_description("pico-dsp - a simple audio dsp"));
+    bi_decl(bi_1pin_with_name(input_BCLK_Base, "I2S Input (ADC) BCLK - DON'T USE (invalid timing)"));
+    bi_decl(bi_1pin_with_name(input_BCLK_Base + 1, "I2S Input (ADC) LRCK - DON'T USE (invalid timing)"));
+    bi_decl(bi_1pin_with_name(input_DATA, "I2S Input (ADC) Data"));
+    bi_decl(bi_1pin_with_name(output_BCLK_Base, "I2S Output (DAC) BCLK"));
+    bi_decl(bi_1pin_with_name(output_BCLK_Base + 1, "I2S Output (DAC) LRCK"));
+    bi_decl(bi_1pin_with_name(output_DATA, "I2S Output (DAC) Data"));
+    bi_decl(bi_1pin_with_name(mclk_pin, "I2S MCLK"));
+
+    /* start stdio
+        enables printf and friends
+        uses either uart or usb as defined by cmake
+        only ever used from this core
+    */
+    stdio_init_all();
+
+    mutex_init(&_pioMutex);
+
+    /* on-board led */
+    gpio_init(PICO_DEFAULT_LED_PIN);
+    gpio_set_dir(PICO_DEFAULT_LED_PIN, GPIO_OUT);
+    gpio_put(PICO_DEFAULT_LED_PIN, 1);
+
+    /* undervolt core voltage
+        might enable higher clock speeds */
+    // vreg_set_voltage(VREG_VOLTAGE_1_00);
+    // sleep_ms(1000); // vreg settle
+
+    /* overclock system */
+    // set_sys_clock_khz(230000, true);
+    // sleep_ms(100);
+
+#if DSP_SELFTEST
+    /* before the audio core starts, nothing else competes for the cycles */
+    bool selftestOk = selftest_run(sampleRate);
+    selftestOk &= selftest_fft(sampleRate);
+    selftestOk &= selftest_delay();
+#if !PACKED_16
+    selftestOk &= selftest_convolve(sampleRate);
+#endif
+    if (!selftestOk)
+    {
+        printf("selftest failed\n");
+    }
+#endif
+
+#if !PACKED_16
+    /* the filter designs run in soft-float here, not on the audio core */
+    describe_graph();
+    preset_boot();
+    if (!graph.compile(topology, node_count))
+    {
+        printf("failed to compile processing graph: %s", graph.error());
+        while (1);
+    }
+    preset_boot_settings();
+    char bootName[PRESET_NAME];
+    memcpy(bootName, current.name, PRESET_NAME);
+    preset_snapshot(current, bootName);
+    printf("preset %s\n", current.name);
+    print_plan();
+#endif
+
+    multicore_launch_core1(audio_main);
+
+#if !PACKED_16
+    /* the audio core's doorbell for the convolution engine */
+    multicore_fifo_clear_irq();
+    irq_set_exclusive_handler(SIO_IRQ_PROC0, convolve_irq);
+    irq_set_enabled(SIO_IRQ_PROC0, true);
+#endif
+
+    while (!audioReady && !audioFault)
+    {
+        tight_loop_contents();
+    }
+
+    printf("entering main loop");
+    gpio_put(PICO_DEFAULT_LED_PIN, 0);
+
+    /* control core
+        owns USB, command parsing and logging */
+    char line[64];
+    size_t lineLength = 0;
+    dsp_command_t cmd;
+    dsp_telemetry_t telemetry;
+    bool faultReported = false;
+
+    while (1)
+    {
+        if (audioFault && !faultReported)
+        {
+            printf("%s\n", audioFault);
+            faultReported = true;
+        }
+
+        int c = getchar_timeout_us(1000);
+        if (c != PICO_ERROR_TIMEOUT)
+        {
+            if (c == '\n' || c == '\r')
+            {
+                line[lineLength] = '\0';
+                if (lineLength)
+                {
+#if PACKED_16
+                    bool ok = control_parse(line, sampleRate, StereoIIR16::quantize, &cmd);
+#else
+                    if (!strcmp(line, "plan"))
+                    {
+                        print_plan();
+                        lineLength = 0;
+                        continue;
+                    }
+                    if (!strncmp(line, "preset", 6))
+                    {
+                        preset_line(line);
+                        lineLength = 0;
+                        continue;
+                    }
+                    if (loadTaps || !strncmp(line, "convolve", 8))
+                    {
+                        convolve_line(line);
+                        lineLength = 0;
+                        continue;
+                    }
+                    /* low band biquads are designed at their own rate */
+                    unsigned filterNode = 0;
+                    float Fs = sampleRate;
+                    if (sscanf(line, "filter %u", &filterNode) == 1 && filterNode < node_count)
+                    {
+                        Fs = (float)sampleRate / graph.decimation((uint8_t)filterNode);
+                    }
+                    bool ok = control_parse(line, Fs, IIR::quantize, &cmd);
+#endif
+                    if (!ok || !command_valid(cmd))
+                    {
+                        printf("?\n");
+                        lineLength = 0;
+                        continue;
+                    }
+
+                    /* the analyzer is ready before the first block arrives,
+                        and only stops once the tap is off */
+                    if (cmd.type == command_tap && cmd.tap >= 0)
+                    {
+                        analyzer.begin(cmd.size, cmd.averages);
+                    }
+
+                    if (!commandQueue.push(cmd))
+                    {
+                        printf("busy\n");
+                    }
+                    else if (cmd.type == command_tap && cmd.tap < 0)
+                    {
+                        analyzer.end();
+                    }
+#if !PACKED_16
+                    else
+                    {
+                        /* kept for "preset save", ignored unless a node setting */
+                        preset_set(current, cmd);
+                    }
+#endif
+                }
+                lineLength = 0;
+            }
+            else if (lineLength < sizeof(line) - 1)
+            {
+                line[lineLength++] = (char)c;
+            }
+        }
+
+        while (telemetryQueue.pop(&telemetry))
+        {
+            control_print_telemetry(telemetry);
+        }
 
-        diff = (absolute_time_diff_us(start, end));
-        counter++;
-        if(counter % sampleRate == 0) {
-            printf("%lldus\n", diff);
+        if (analyzer.poll(tapQueue))
+        {
+            analyzer.print(sampleRate);
         }
     }
 
@@ -20,48 +20,50 @@
 */
 
 // #include <Arduino.h>
-#include <vector>
 #include "hardware/dma.h"
 #include "hardware/irq.h"
 #include "hardware/pio.h"
+#include "hardware/sync.h"
+#include "hardware/timer.h"
 #include "pio_i2s.pio.h"
 #include "AudioPioRingBuffer.h"
 
 static int              __channelCount = 0;    // # of channels left.  When we hit 0, then remove our handler
 static AudioRingBuffer* __channelMap[12];      // Lets the IRQ handler figure out where to dispatch to
 
-AudioRingBuffer::AudioRingBuffer(size_t bufferCount, size_t bufferWords, int32_t silenceSample, PinMode direction) {
+AudioRingBuffer::AudioRingBuffer(uint32_t *storage, size_t bufferCount, size_t bufferWords, int32_t silenceSample, PinMode direction, bool addressRing) {
     _running = false;
+    _addressRing = addressRing;
+    _storage = storage;
+    _emptyMask = 0;
     _silenceSample = silenceSample;
     _bufferCount = bufferCount;
     _wordsPerBuffer = bufferWords;
     _isOutput = direction == OUTPUT;
     _overunderflow = false;
+    _xruns = 0;
+    _lastXrun = 0;
     _callback = nullptr;
     _userBuffer = -1;
     _userOff = 0;
-    for (size_t i = 0; i < bufferCount; i++) {
-        auto ab = new AudioBuffer;
-        ab->buff = new uint32_t[_wordsPerBuffer];
-        ab->empty = true;
-        _buffers.push_back(ab);
-    }
 }
 
 AudioRingBuffer::~AudioRingBuffer() {
+    end();
+}
+
+void AudioRingBuffer::end() {
     if (_running) {
+        _running = false;
         for (auto i = 0; i < 2; i++) {
             dma_channel_set_irq0_enabled(_channelDMA[i], false);
+            dma_channel_abort(_channelDMA[i]);
             dma_channel_unclaim(_channelDMA[i]);
-            __channelMap[_channelDMA[i]] = nullptr;
-        }
-        while (_buffers.size()) {
-            auto ab = _buffers.back();
-            _buffers.pop_back();
-            delete[] ab->buff;
-            delete ab;
+            if (__channelMap[_channelDMA[i]] == this) {
+                __channelMap[_channelDMA[i]] = nullptr;
+                __channelCount--;
+            }
         }
-        __channelCount--;
         if (!__channelCount) {
             irq_set_enabled(DMA_IRQ_0, false);
             // TODO - how can we know if there are no other parts of the core using DMA0 IRQ??
@@ -74,16 +76,19 @@ void AudioRingBuffer::setCallback(void (*fn)()) {
     _callback = fn;
 }
 
+void AudioRingBuffer::setWatchdog(bool enable) {
+    _watchdog = enable;
+}
+
 bool AudioRingBuffer::begin(int dreq, volatile void *pioFIFOAddr) {
+    if (_addressRing) {
+        return _beginRing(dreq, pioFIFOAddr);
+    }
     _running = true;
     // Set all buffers to silence, empty
-    for (auto buff : _buffers) {
-        buff->empty = true;
-        // if (_isOutput) {
-            for (uint32_t x = 0; x < _wordsPerBuffer; x++) {
-                buff->buff[x] = _silenceSample;
-            }
-        // }
+    _emptyMask = (_bufferCount == 32) ? 0xffffffff : ((1u << _bufferCount) - 1);
+    for (uint32_t x = 0; x < _bufferCount * _wordsPerBuffer; x++) {
+        _storage[x] = _silenceSample;
     }
     // Get ping and pong DMA channels
     for (auto i = 0; i < 2; i++) {
@@ -112,9 +117,9 @@ bool AudioRingBuffer::begin(int dreq, volatile void *pioFIFOAddr) {
         channel_config_set_irq_quiet(&c, false); // Need IRQs
 
         if (_isOutput) {
-            dma_channel_configure(_channelDMA[i], &c, pioFIFOAddr, _buffers[i]->buff, _wordsPerBuffer, false);
+            dma_channel_configure(_channelDMA[i], &c, pioFIFOAddr, _buffer(i), _wordsPerBuffer, false);
         } else {
-            dma_channel_configure(_channelDMA[i], &c, _buffers[i]->buff, pioFIFOAddr, _wordsPerBuffer, false);
+            dma_channel_configure(_channelDMA[i], &c, _buffer(i), pioFIFOAddr, _wordsPerBuffer, false);
         }
         dma_channel_set_irq0_enabled(_channelDMA[i], true);
         __channelMap[_channelDMA[i]] = this;
@@ -130,73 +135,214 @@ bool AudioRingBuffer::begin(int dreq, volatile void *pioFIFOAddr) {
     return true;
 }
 
-bool AudioRingBuffer::write(uint32_t v, bool sync) {
+bool AudioRingBuffer::_beginRing(int dreq, volatile void *pioFIFOAddr) {
+    _ringWords = _bufferCount * _wordsPerBuffer;
+    uint32_t bytes = _ringWords * sizeof(uint32_t);
+    uint ringBits = 0;
+    while ((1u << ringBits) < bytes) {
+        ringBits++;
+    }
+    // The hardware wrap works on the low address bits only
+    if ((1u << ringBits) != bytes || ringBits > 15 || ((uintptr_t)_storage & (bytes - 1))) {
+        return false;
+    }
+    _ringMask = _ringWords - 1;
+
+    for (uint32_t x = 0; x < _ringWords; x++) {
+        _storage[x] = _silenceSample;
+    }
+    // Data channel and control channel
+    for (auto i = 0; i < 2; i++) {
+        _channelDMA[i] = dma_claim_unused_channel(true);
+        if (_channelDMA[i] == -1) {
+            if (i == 1) {
+                dma_channel_unclaim(_channelDMA[0]);
+            }
+            return false;
+        }
+    }
+    _running = true;
+    int data = _channelDMA[0];
+    int ctrl = _channelDMA[1];
+
+    // One lap per trigger, the address wraps back to the start of the ring
+    dma_channel_config c = dma_channel_get_default_config(data);
+    channel_config_set_transfer_data_size(&c, DMA_SIZE_32);
+    channel_config_set_read_increment(&c, _isOutput);
+    channel_config_set_write_increment(&c, !_isOutput);
+    channel_config_set_ring(&c, !_isOutput /* wrap the write address on input */, ringBits);
+    channel_config_set_dreq(&c, dreq);
+    channel_config_set_chain_to(&c, ctrl); // Restart via the control channel after each lap
+    channel_config_set_irq_quiet(&c, !_watchdog);
+    if (_isOutput) {
+        dma_channel_configure(data, &c, pioFIFOAddr, _storage, _ringWords, false);
+    } else {
+        dma_channel_configure(data, &c, _storage, pioFIFOAddr, _ringWords, false);
+    }
+
+    // Rewrites the lap length into the data channel's triggering alias
+    dma_channel_config cc = dma_channel_get_default_config(ctrl);
+    channel_config_set_transfer_data_size(&cc, DMA_SIZE_32);
+    channel_config_set_read_increment(&cc, false);
+    channel_config_set_write_increment(&cc, false);
+    dma_channel_configure(ctrl, &cc, &dma_hw->ch[data].al1_transfer_count_trig, &_ringWords, 1, false);
+
+    if (_watchdog) {
+        bool needSetIRQ = __channelCount == 0;
+        dma_channel_set_irq0_enabled(data, true);
+        __channelMap[data] = this;
+        __channelCount++;
+        if (needSetIRQ) {
+            irq_add_shared_handler(DMA_IRQ_0, _irq, PICO_SHARED_IRQ_HANDLER_DEFAULT_ORDER_PRIORITY);
+            irq_set_enabled(DMA_IRQ_0, true);
+        }
+    }
+
+    // Output starts two buffers ahead of the DMA, input right behind it
+    _userPos = _isOutput ? 2 * _wordsPerBuffer : 0;
+    _userAvail = 0;
+    _userCount = 0;
+    _watchdogCount = 0;
+    dma_channel_start(data);
+    return true;
+}
+
+uint32_t __not_in_flash_func(AudioRingBuffer::_ringPosition)() {
+    int data = _channelDMA[0];
+    uint32_t addr = _isOutput ? dma_hw->ch[data].read_addr : dma_hw->ch[data].write_addr;
+    return ((addr - (uint32_t)(uintptr_t)_storage) / sizeof(uint32_t)) & _ringMask;
+}
+
+bool __not_in_flash_func(AudioRingBuffer::_writeRing)(uint32_t v, bool sync) {
+    // The DMA position is only sampled once the cached space is used up
+    while (!_userAvail) {
+        uint32_t pending = (_userPos - _ringPosition()) & _ringMask;
+        if (pending > _ringWords - _wordsPerBuffer) {
+            // The DMA passed us and replays old samples, restart two buffers ahead
+            _xrun();
+            _userPos = (_ringPosition() + 2 * _wordsPerBuffer) & _ringMask;
+            pending = 2 * _wordsPerBuffer;
+        }
+        // Keep one buffer of slack so being lapped stays detectable
+        _userAvail = _ringWords - _wordsPerBuffer - pending;
+        if (!_userAvail && !sync) {
+            return false;
+        }
+    }
+    _storage[_userPos] = v;
+    _userPos = (_userPos + 1) & _ringMask;
+    _userCount = _userCount + 1;
+    _userAvail--;
+    return true;
+}
+
+bool __not_in_flash_func(AudioRingBuffer::_readRing)(uint32_t *v, bool sync) {
+    while (!_userAvail) {
+        uint32_t hw = _ringPosition();
+        uint32_t avail = (hw - _userPos) & _ringMask;
+        if (avail > _ringWords - _wordsPerBuffer) {
+            // The DMA is about to lap us, skip ahead to the last complete buffer
+            _xrun();
+            _userPos = (hw - _wordsPerBuffer) & _ringMask;
+            avail = _wordsPerBuffer;
+        }
+        _userAvail = avail;
+        if (!_userAvail && !sync) {
+            return false;
+        }
+    }
+    *v = _storage[_userPos];
+    _userPos = (_userPos + 1) & _ringMask;
+    _userCount = _userCount + 1;
+    _userAvail--;
+    return true;
+}
+
+bool __not_in_flash_func(AudioRingBuffer::write)(uint32_t v, bool sync) {
     if (!_running || !_isOutput) {
         return false;
     }
+    if (_addressRing) {
+        return _writeRing(v, sync);
+    }
     if (_userBuffer == -1) {
         // First write or overflow, pick spot 2 buffers out
         _userBuffer = (_nextBuffer + 2) % _bufferCount;
         _userOff = 0;
     }
-    if (!_buffers[_userBuffer]->empty) {
+    if (!_isEmpty(_userBuffer)) {
         if (!sync) {
             return false;
         } else {
-            while (!_buffers[_userBuffer]->empty) {
-                /* noop busy wait */
+            uint32_t sleepStart = time_us_32();
+            while (!_isEmpty(_userBuffer)) {
+                /* sleep, the DMA interrupt that ends the wait sets the event */
+                __wfe();
             }
+            _asleepUs += time_us_32() - sleepStart;
         }
     }
     if (_userBuffer == _curBuffer) {
         if (!sync) {
             return false;
         } else {
+            uint32_t sleepStart = time_us_32();
             while (_userBuffer == _curBuffer) {
-                /* noop busy wait */
+                /* sleep, the DMA interrupt that ends the wait sets the event */
+                __wfe();
             }
+            _asleepUs += time_us_32() - sleepStart;
         }
     }
-    _buffers[_userBuffer]->buff[_userOff++] = v;
+    _buffer(_userBuffer)[_userOff++] = v;
     if (_userOff == _wordsPerBuffer) {
-        _buffers[_userBuffer]->empty = false;
-        _userBuffer = (_userBuffer + 1) % _bufferCount;
+        _setEmpty(_userBuffer, false);
+        _userBuffer = _advance(_userBuffer);
         _userOff = 0;
     }
     return true;
 }
 
-bool AudioRingBuffer::read(uint32_t *v, bool sync) {
+bool __not_in_flash_func(AudioRingBuffer::read)(uint32_t *v, bool sync) {
     if (!_running || _isOutput) {
         return false;
     }
+    if (_addressRing) {
+        return _readRing(v, sync);
+    }
     if (_userBuffer == -1) {
         // First write or overflow, pick last filled buffer
         _userBuffer = (_curBuffer - 1 + _bufferCount) % _bufferCount;
         _userOff = 0;
     }
-    if (_buffers[_userBuffer]->empty) {
+    if (_isEmpty(_userBuffer)) {
         if (!sync) {
             return false;
         } else {
-            while (_buffers[_userBuffer]->empty) {
-                /* noop busy wait */
+            uint32_t sleepStart = time_us_32();
+            while (_isEmpty(_userBuffer)) {
+                /* sleep, the DMA interrupt that ends the wait sets the event */
+                __wfe();
             }
+            _asleepUs += time_us_32() - sleepStart;
         }
     }
     if (_userBuffer == _curBuffer) {
         if (!sync) {
             return false;
         } else {
+            uint32_t sleepStart = time_us_32();
             while (_userBuffer == _curBuffer) {
-                /* noop busy wait */
+                /* sleep, the DMA interrupt that ends the wait sets the event */
+                __wfe();
             }
+            _asleepUs += time_us_32() - sleepStart;
         }
     }
-    auto ret = _buffers[_userBuffer]->buff[_userOff++];
+    auto ret = _buffer(_userBuffer)[_userOff++];
     if (_userOff == _wordsPerBuffer) {
-        _buffers[_userBuffer]->empty = true;
-        _userBuffer = (_userBuffer + 1) % _bufferCount;
+        _setEmpty(_userBuffer, true);
+        _userBuffer = _advance(_userBuffer);
         _userOff = 0;
     }
     *v = ret;
@@ -209,10 +355,38 @@ bool AudioRingBuffer::getOverUnderflow() {
     return hold;
 }
 
+uint32_t __not_in_flash_func(AudioRingBuffer::getXruns)(uint32_t *lastUs) {
+    // Both are written from the IRQ, read the pair consistently
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t count = _xruns;
+    if (lastUs) {
+        *lastUs = _lastXrun;
+    }
+    restore_interrupts(save);
+    return count;
+}
+
+uint32_t __not_in_flash_func(AudioRingBuffer::getAsleepUs)() {
+    return _asleepUs;
+}
+
+void __not_in_flash_func(AudioRingBuffer::_xrun)() {
+    // Called from the user side and from the DMA IRQ of the same core
+    uint32_t save = save_and_disable_interrupts();
+    _overunderflow = true;
+    _xruns = _xruns + 1;
+    _lastXrun = time_us_32();
+    restore_interrupts(save);
+}
+
 int AudioRingBuffer::available() {
     if (!_running) {
         return 0;
     }
+    if (_addressRing) {
+        uint32_t pending = (_userPos - _ringPosition()) & _ringMask;
+        return _isOutput ? _ringWords - _wordsPerBuffer - pending : (_ringWords - pending) & _ringMask;
+    }
     int avail;
     avail = _wordsPerBuffer - _userOff;
     avail += ((_bufferCount + _curBuffer - _userBuffer) % _bufferCount) * _wordsPerBuffer;
@@ -220,27 +394,71 @@ int AudioRingBuffer::available() {
 }
 
 void AudioRingBuffer::flush() {
+    if (_addressRing) {
+        while (_isOutput && _ringPosition() != _userPos) {
+            // busy wait
+        }
+        return;
+    }
     while (_curBuffer != _userBuffer) {
         // busy wait
     }
 }
 
+void __not_in_flash_func(AudioRingBuffer::_setEmpty)(int idx, bool empty) {
+    // The DMA IRQ modifies the same mask, keep the read-modify-write atomic
+    uint32_t save = save_and_disable_interrupts();
+    if (empty) {
+        _emptyMask |= 1u << idx;
+    } else {
+        _emptyMask &= ~(1u << idx);
+    }
+    restore_interrupts(save);
+}
+
 void __not_in_flash_func(AudioRingBuffer::_dmaIRQ)(int channel) {
+    if (_addressRing) {
+        // Watchdog, once per lap. A user side that did not move for a
+        // whole lap has stalled, silence the output instead of looping it.
+        // The position is masked to the ring and one that keeps pace comes
+        // back to the same spot every lap, so compare the word count
+        uint32_t count = _userCount;
+        if (count == _watchdogCount) {
+            _xrun();
+            if (_isOutput) {
+                for (uint32_t x = 0; x < _ringWords; x++) {
+                    _storage[x] = _silenceSample;
+                }
+            }
+        }
+        _watchdogCount = count;
+        dma_channel_acknowledge_irq0(channel);
+        if (_callback) {
+            _callback();
+        }
+        return;
+    }
+    uint32_t *cur = _buffer(_curBuffer);
+    uint32_t *next = _buffer(_nextBuffer);
     if (_isOutput) {
         for (uint32_t x = 0; x < _wordsPerBuffer; x++) {
-            _buffers[_curBuffer]->buff[x] = _silenceSample;
+            cur[x] = _silenceSample;
         }
-        _buffers[_curBuffer]-> empty = true;
-        _overunderflow = _overunderflow | _buffers[_nextBuffer]->empty;
-        dma_channel_set_read_addr(channel, _buffers[_nextBuffer]->buff, false);
+        _emptyMask |= 1u << _curBuffer;
+        if (_isEmpty(_nextBuffer)) {
+            _xrun();
+        }
+        dma_channel_set_read_addr(channel, next, false);
     } else {
-        _buffers[_curBuffer]-> empty = false;
-        _overunderflow = _overunderflow | !_buffers[_nextBuffer]->empty;
-        dma_channel_set_write_addr(channel, _buffers[_nextBuffer]->buff, false);
+        _emptyMask &= ~(1u << _curBuffer);
+        if (!_isEmpty(_nextBuffer)) {
+            _xrun();
+        }
+        dma_channel_set_write_addr(channel, next, false);
     }
     dma_channel_set_trans_count(channel, _wordsPerBuffer, false);
-    _curBuffer = (_curBuffer + 1) % _bufferCount;
-    _nextBuffer = (_nextBuffer + 1) % _bufferCount;
+    _curBuffer = _advance(_curBuffer);
+    _nextBuffer = _advance(_nextBuffer);
     dma_channel_acknowledge_irq0(channel);
     if (_callback) {
         _callback();
@@ -248,7 +466,7 @@ void __not_in_flash_func(AudioRingBuffer::_dmaIRQ)(int channel) {
 }
 
 void __not_in_flash_func(AudioRingBuffer::_irq)() {
-    for (size_t i = 0; i < sizeof(__channelMap); i++) {
+    for (size_t i = 0; i < sizeof(__channelMap) / sizeof(__channelMap[0]); i++) {
         if (dma_channel_get_irq0_status(i) && __channelMap[i]) {
             __channelMap[i]->_dmaIRQ(i);
         }
@@ -22,35 +22,65 @@
 #pragma once
 // #include <Arduino.h>
 #include "compatability.h"
-#include <vector>
 
+// All buffers live back to back in caller supplied storage of
+// bufferCount * bufferWords words, see StaticAudioRingBuffer.
+// The empty flags are a bitmask, so at most 32 buffers.
+//
+// In address ring mode the whole storage is a single ring that the DMA
+// wraps in hardware (channel_config_set_ring) and a second channel
+// re-triggers after every lap, so it runs without CPU involvement.
+// The storage must then be a power of two of at most 32KB, aligned to
+// its size. Positions are taken from the DMA address registers, the
+// only interrupt left is an optional once-per-lap watchdog which
+// detects a stalled user side (and silences the output).
 class AudioRingBuffer {
 public:
-    AudioRingBuffer(size_t bufferCount, size_t bufferWords, int32_t silenceSample, PinMode direction = OUTPUT);
+    AudioRingBuffer(uint32_t *storage, size_t bufferCount, size_t bufferWords, int32_t silenceSample, PinMode direction = OUTPUT, bool addressRing = false);
     ~AudioRingBuffer();
 
     void setCallback(void (*fn)());
+    // Address ring mode only, call before begin()
+    void setWatchdog(bool enable);
 
     bool begin(int dreq, volatile void *pioFIFOAddr);
+    void end();
 
     bool write(uint32_t v, bool sync = true);
     bool read(uint32_t *v, bool sync = true);
     void flush();
 
     bool getOverUnderflow();
+    // Over-/underflows since start, optionally with the time_us_32() of the last one
+    uint32_t getXruns(uint32_t *lastUs = nullptr);
+    // Time spent asleep in blocking waits since start, wraps, user side only
+    uint32_t getAsleepUs();
     int available();
 
 private:
     void _dmaIRQ(int channel);
     static void _irq();
 
-    typedef struct {
-        uint32_t *buff;
-        volatile bool empty;
-    } AudioBuffer;
+    bool _beginRing(int dreq, volatile void *pioFIFOAddr);
+    bool _writeRing(uint32_t v, bool sync);
+    bool _readRing(uint32_t *v, bool sync);
+    uint32_t _ringPosition();
+
+    uint32_t *_buffer(int idx) {
+        return _storage + idx * _wordsPerBuffer;
+    }
+    // Next buffer index, without a division per buffer
+    int _advance(int idx) {
+        return idx + 1 == (int)_bufferCount ? 0 : idx + 1;
+    }
+    bool _isEmpty(int idx) {
+        return _emptyMask & (1u << idx);
+    }
+    void _setEmpty(int idx, bool empty);
 
     bool _running = false;
-    std::vector<AudioBuffer*> _buffers;
+    uint32_t *_storage;
+    volatile uint32_t _emptyMask;
     volatile int _curBuffer;
     volatile int _nextBuffer;
     size_t _chunkSampleCount;
@@ -63,8 +93,44 @@ private:
     void (*_callback)();
 
     bool _overunderflow;
+    volatile uint32_t _xruns;
+    volatile uint32_t _lastXrun;
+    void _xrun();
+
+    uint32_t _asleepUs = 0;
 
     // User buffer pointer
     int _userBuffer = -1;
     size_t _userOff = 0;
+
+    // Address ring mode
+    bool _addressRing;
+    bool _watchdog = true;
+    uint32_t _ringWords; // also the reload value the control channel writes
+    uint32_t _ringMask;
+    volatile uint32_t _userPos;
+    uint32_t _userAvail;
+    // Words moved by the user side, not masked, so a full lap still counts
+    volatile uint32_t _userCount;
+    uint32_t _watchdogCount;
+};
+
+// Ring buffer with its storage allocated statically, sizes are fixed at
+// compile time so the memory shows up in the linker's budget.
+// AddressRing selects the DMA address ring mode and aligns the storage
+// to its size as the hardware wrap requires.
+template <size_t BufferCount, size_t BufferWords, bool AddressRing = false>
+class StaticAudioRingBuffer : public AudioRingBuffer {
+    static constexpr size_t _bytes = BufferCount * BufferWords * sizeof(uint32_t);
+    static_assert(BufferCount >= 2 && BufferCount <= 32, "AudioRingBuffer supports 2 to 32 buffers");
+    static_assert(!AddressRing || ((_bytes & (_bytes - 1)) == 0 && _bytes <= 32768),
+                  "DMA address ring needs a power of two of at most 32KB");
+
+public:
+    StaticAudioRingBuffer(int32_t silenceSample, PinMode direction = OUTPUT) :
+        AudioRingBuffer(_data, BufferCount, BufferWords, silenceSample, direction, AddressRing) {
+    }
+
+private:
+    alignas(AddressRing ? _bytes : 16) uint32_t _data[BufferCount * BufferWords];
 };
@@ -21,20 +21,20 @@
 // #include <Arduino.h>
 #include "I2S.h"
 #include "pio_i2s.pio.h"
+#include "packed16.h"
 
-I2S::I2S(PinMode direction, pin_size_t pinBCLK, pin_size_t pinDOUT, int bps) {
+// Silence is all zeros at any width, so it is known before begin()
+I2S::I2S(PinMode direction, pin_size_t pinBCLK, pin_size_t pinDOUT, int bps) :
+    _arb(0, direction),
+    _i2s(direction == OUTPUT ? &pio_i2s_out_program : &pio_i2s_in_program) {
     _running = false;
     _bps = bps;
     _writtenHalf = false;
     _pinBCLK = pinBCLK;
     _pinDOUT = pinDOUT;
     _freq = 48000;
-    _arb = nullptr;
     _isOutput = direction == OUTPUT;
     _cb = nullptr;
-    _buffers = 32;
-    _bufferWords = 64;
-    _silenceSample = 0;
 }
 
 I2S::~I2S() {
@@ -53,7 +53,7 @@ void I2S::onTransmit(void(*fn)(void)) {
     if (_isOutput) {
         _cb = fn;
         if (_running) {
-            _arb->setCallback(_cb);
+            _arb.setCallback(_cb);
         }
     }
 }
@@ -62,7 +62,7 @@ void I2S::onReceive(void(*fn)(void)) {
     if (!_isOutput) {
         _cb = fn;
         if (_running) {
-            _arb->setCallback(_cb);
+            _arb.setCallback(_cb);
         }
     }
 }
@@ -71,24 +71,21 @@ bool I2S::begin() {
     _running = true;
     _hasPeeked = false;
     int off = 0;
-    _i2s = new PIOProgram(_isOutput ? &pio_i2s_out_program : &pio_i2s_in_program);
-    _i2s->prepare(&_pio, &_sm, &off);
+    if (!_i2s.prepare(&_pio, &_sm, &off)) {
+        _running = false;
+        return false;
+    }
     if (_isOutput) {
         pio_i2s_out_program_init(_pio, _sm, off, _pinDOUT, _pinBCLK, _bps);
     } else {
         pio_i2s_in_program_init(_pio, _sm, off, _pinDOUT, _bps);
     }
     setFrequency(_freq);
-    if (_bps == 8) {
-        uint8_t a = _silenceSample & 0xff;
-        _silenceSample = (a << 24) | (a << 16) | (a << 8) | a;
-    } else if (_bps == 16) {
-        uint16_t a = _silenceSample & 0xffff;
-        _silenceSample = (a << 16) | a;
+    if (!_arb.begin(pio_get_dreq(_pio, _sm, _isOutput), _isOutput ? &_pio->txf[_sm] : (volatile void*)&_pio->rxf[_sm])) {
+        _running = false;
+        return false;
     }
-    _arb = new AudioRingBuffer(_buffers, _bufferWords, _silenceSample, _isOutput ? OUTPUT : INPUT);
-    _arb->begin(pio_get_dreq(_pio, _sm, _isOutput), _isOutput ? &_pio->txf[_sm] : (volatile void*)&_pio->rxf[_sm]);
-    _arb->setCallback(_cb);
+    _arb.setCallback(_cb);
     // pio_sm_set_enabled(_pio, _sm, true);
 
     return true;
@@ -96,22 +93,55 @@ bool I2S::begin() {
 
 void I2S::end() {
     _running = false;
-    delete _arb;
-    _arb = nullptr;
-    delete _i2s;
-    _i2s = nullptr;
+    _arb.end();
 }
 
-size_t I2S::write(int32_t val, bool sync) {
+size_t __not_in_flash_func(I2S::write)(int32_t val, bool sync) {
     if (!_running || !_isOutput) {
         return 0;
     }
-    return _arb->write(val, sync);
+    return _arb.write(val, sync);
+}
+
+bool I2S::getOverUnderflow() {
+    if (!_running) {
+        return false;
+    }
+    return _arb.getOverUnderflow();
+}
+
+uint32_t __not_in_flash_func(I2S::getXruns)(uint32_t *lastUs) {
+    return _arb.getXruns(lastUs);
+}
+
+uint32_t __not_in_flash_func(I2S::getAsleepUs)() {
+    return _arb.getAsleepUs();
+}
+
+size_t I2S::write16(int16_t l, int16_t r) {
+    if (!_running || !_isOutput || _bps != 16) {
+        return 0;
+    }
+    // One ring buffer word carries a complete L/R frame
+    return _arb.write(pack16(l, r), true);
 }
 
-size_t I2S::read(int32_t *val, bool sync) {
+size_t __not_in_flash_func(I2S::read)(int32_t *val, bool sync) {
     if (!_running || _isOutput) {
         return 0;
     }
-    return _arb->read((uint32_t *)val, sync);
+    return _arb.read((uint32_t *)val, sync);
+}
+
+size_t I2S::read16(int16_t *l, int16_t *r) {
+    if (!_running || _isOutput || _bps != 16) {
+        return 0;
+    }
+    uint32_t frame;
+    if (!_arb.read(&frame, true)) {
+        return 0;
+    }
+    *l = unpackLeft16(frame);
+    *r = unpackRight16(frame);
+    return 1;
 }
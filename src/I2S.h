@@ -21,9 +21,23 @@
 
 #pragma once
 // #include <Arduino.h>
-#include <vector>
 #include "AudioPioRingBuffer.h"
 
+// Ring buffer dimensions, fixed at compile time and held inside the
+// I2S object, so instances should be static rather than on a stack
+#ifndef I2S_BUFFER_COUNT
+#define I2S_BUFFER_COUNT (32)
+#endif
+#ifndef I2S_BUFFER_WORDS
+#define I2S_BUFFER_WORDS (64)
+#endif
+
+// Run the DMA as a self-restarting address ring instead of re-arming it
+// from an interrupt after every buffer, see AudioRingBuffer
+#ifndef I2S_DMA_RING
+#define I2S_DMA_RING (0)
+#endif
+
 class I2S{
 public:
     I2S(PinMode direction = OUTPUT, pin_size_t pinBCLK = 0, pin_size_t pinDOUT = 2, int bps = 32);
@@ -62,8 +76,21 @@ public:
     // Read 32 bit value to port, user responsbile for packing/alignment, etc.
     size_t read(int32_t *val, bool sync);
 
+    // Read one stereo frame in 16 bit mode, will block until available
+    size_t read16(int16_t *l, int16_t *r);
+
+    // Clears the flag on read
+    bool getOverUnderflow();
+
+    // Over-/underflows since start, optionally with the time_us_32() of the last one
+    uint32_t getXruns(uint32_t *lastUs = nullptr);
+
+    // Time the caller spent asleep waiting for the ring buffer, microseconds since start
+    uint32_t getAsleepUs();
+
     // Note that these callback are called from **INTERRUPT CONTEXT** and hence
     // should be in RAM, not FLASH, and should be quick to execute.
+    // With I2S_DMA_RING they are only called once per ring lap.
     void onTransmit(void(*)(void));
     void onReceive(void(*)(void));
 
@@ -72,9 +99,6 @@ private:
     pin_size_t _pinDOUT;
     int _bps;
     int _freq;
-    size_t _buffers;
-    size_t _bufferWords;
-    int32_t _silenceSample;
     bool _isOutput;
 
     bool _running;
@@ -91,8 +115,8 @@ private:
 
     void (*_cb)();
 
-    AudioRingBuffer *_arb;
-    PIOProgram *_i2s;
+    StaticAudioRingBuffer<I2S_BUFFER_COUNT, I2S_BUFFER_WORDS, I2S_DMA_RING> _arb;
+    PIOProgram _i2s;
     PIO _pio;
     int _sm;
 };
@@ -0,0 +1,95 @@
+#ifndef CIRCULAR_H
+#define CIRCULAR_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+/* address generation of circular buffers on the SIO interpolators */
+#ifndef DSP_INTERP
+#define DSP_INTERP (0)
+#endif
+
+#if DSP_INTERP
+#include "hardware/interp.h"
+#endif
+
+/*
+    Pointer walk over a power of two circular buffer of samples, one
+    step per next().
+    With DSP_INTERP=1 a cursor runs on one of the calling core's
+    interpolators: lane 0 adds 4 to the byte offset and masks it to the
+    buffer, BASE2 adds the buffer's address, so a single POP returns the
+    pointer and advances. Without, a masked index produces the same
+    sequence, and is the reference for it.
+    unit 0 and 1 are the core's two interpolators. A kernel sets up the
+    cursors it needs on entry and nothing survives its return, so
+    interrupt handlers must not use them.
+*/
+class CircularCursor {
+public:
+    /* mask = buffer length - 1, position is masked */
+    __force_inline CircularCursor(uint8_t unit, int32_t *line, uint32_t mask, uint32_t position)
+    {
+#if DSP_INTERP
+        /* no clz, libgcc's would run from flash */
+        uint bits = 0;
+        while (mask >> bits)
+        {
+            bits++;
+        }
+
+        _interp = unit ? interp1 : interp0;
+        interp_config cfg = interp_default_config();
+        interp_config_set_mask(&cfg, 2, bits ? 1 + bits : 2);
+        interp_set_config(_interp, 0, &cfg);
+        cfg = interp_default_config();
+        interp_set_config(_interp, 1, &cfg);
+
+        _interp->accum[0] = (position & mask) * sizeof(int32_t);
+        _interp->accum[1] = 0;
+        _interp->base[0] = mask ? sizeof(int32_t) : 0;
+        _interp->base[1] = 0;
+        _interp->base[2] = (uint32_t)(uintptr_t)line;
+#else
+        (void)unit;
+        _line = line;
+        _position = position & mask;
+#endif
+        _mask = mask;
+    }
+
+    __force_inline int32_t *next()
+    {
+#if DSP_INTERP
+        return (int32_t *)(uintptr_t)_interp->pop[2];
+#else
+        int32_t *p = _line + _position;
+        _position = (_position + 1) & _mask;
+        return p;
+#endif
+    }
+
+    /* index the next call returns */
+    __force_inline uint32_t position() const
+    {
+#if DSP_INTERP
+        return (_interp->accum[0] / sizeof(int32_t)) & _mask;
+#else
+        return _position;
+#endif
+    }
+
+private:
+#if DSP_INTERP
+    interp_hw_t *_interp;
+#else
+    int32_t *_line;
+    uint32_t _position;
+#endif
+    uint32_t _mask;
+};
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "control.h"
+#include "requantize.h"
+#include "spectrum.h"
+#include "silence.h"
+
+static const char *filterNames[] = {
+    "lowpass",
+    "highpass",
+    "bandpass",
+    "notch",
+    "peak",
+    "lowshelf",
+    "highshelf",
+    "none"};
+
+static bool parseFloat(const char *tok, float *v)
+{
+    if (!tok)
+    {
+        return false;
+    }
+    char *end;
+    *v = strtof(tok, &end);
+    return end != tok;
+}
+
+static bool parseNode(const char *tok, uint8_t *node)
+{
+    float v;
+    if (!parseFloat(tok, &v) || v < 0 || v >= GRAPH_MAX_NODES)
+    {
+        return false;
+    }
+    *node = (uint8_t)v;
+    return true;
+}
+
+bool control_parse(char *line, float Fs, biquad_coeffs_t (*quantize)(const biquad_design_t &), dsp_command_t *cmd)
+{
+    const char *sep = " \t\r\n";
+    const char *tok = strtok(line, sep);
+    if (!tok)
+    {
+        return false;
+    }
+
+    memset(cmd, 0, sizeof(*cmd));
+
+    if (!strcmp(tok, "gain"))
+    {
+        float dB;
+        if (!parseNode(strtok(NULL, sep), &cmd->node) ||
+            !parseFloat(strtok(NULL, sep), &dB))
+        {
+            return false;
+        }
+        /* limited to +12dB, keeps the 16 bit path within its accumulator */
+        dB = dB > 12.0f ? 12.0f : dB;
+        cmd->type = command_gain;
+        cmd->gain = (int32_t)(powf(10.0f, dB / 20.0f) * GAIN_UNITY);
+        return true;
+    }
+
+    if (!strcmp(tok, "filter"))
+    {
+        float Fc, Q, dB;
+        if (!parseNode(strtok(NULL, sep), &cmd->node))
+        {
+            return false;
+        }
+        tok = strtok(NULL, sep);
+        int type = -1;
+        for (int i = 0; tok && i <= none; i++)
+        {
+            if (!strcmp(tok, filterNames[i]))
+            {
+                type = i;
+            }
+        }
+        if (type < 0 ||
+            !parseFloat(strtok(NULL, sep), &Fc) ||
+            !parseFloat(strtok(NULL, sep), &Q) ||
+            !parseFloat(strtok(NULL, sep), &dB))
+        {
+            return false;
+        }
+        if (type != none && (Fc <= 0 || Fc >= Fs / 2 || Q <= 0))
+        {
+            return false;
+        }
+        cmd->type = command_filter;
+        cmd->coeffs = quantize(biquad_design((filter_type_t)type, Fc, Q, dB, Fs));
+        return true;
+    }
+
+    if (!strcmp(tok, "delay"))
+    {
+        float samples;
+        if (!parseNode(strtok(NULL, sep), &cmd->node) ||
+            !parseFloat(strtok(NULL, sep), &samples) || samples < 0)
+        {
+            return false;
+        }
+        cmd->type = command_delay;
+        cmd->delay = (uint32_t)samples;
+        return true;
+    }
+
+    if (!strcmp(tok, "bypass"))
+    {
+        float on;
+        if (!parseFloat(strtok(NULL, sep), &on))
+        {
+            return false;
+        }
+        cmd->type = command_bypass;
+        cmd->bypass = on != 0;
+        return true;
+    }
+
+    if (!strcmp(tok, "requantize"))
+    {
+        float order, dither;
+        if (!parseFloat(strtok(NULL, sep), &order) || order < 0 || order > REQUANTIZE_MAX_ORDER ||
+            !parseFloat(strtok(NULL, sep), &dither))
+        {
+            return false;
+        }
+        cmd->type = command_requantize;
+        cmd->order = (uint8_t)order;
+        cmd->dither = dither != 0;
+        return true;
+    }
+
+    if (!strcmp(tok, "spectrum"))
+    {
+        cmd->type = command_tap;
+        cmd->tap = -1;
+        tok = strtok(NULL, sep);
+        if (tok && !strcmp(tok, "off"))
+        {
+            return true;
+        }
+
+        float channel, size, averages;
+        if (!parseFloat(tok, &channel) || channel < 0 || channel >= GRAPH_MAX_CHANNELS ||
+            !parseFloat(strtok(NULL, sep), &size) || size < SPECTRUM_MIN_SIZE || size > FFT_MAX_SIZE ||
+            !parseFloat(strtok(NULL, sep), &averages) || averages < 1 || averages > 1000)
+        {
+            return false;
+        }
+        cmd->tap = (int8_t)channel;
+        cmd->size = (uint16_t)size;
+        cmd->averages = (uint16_t)averages;
+        /* power of two sizes only */
+        return (cmd->size & (cmd->size - 1)) == 0;
+    }
+
+    if (!strcmp(tok, "silence"))
+    {
+        cmd->type = command_silence;
+        tok = strtok(NULL, sep);
+        if (tok && !strcmp(tok, "off"))
+        {
+            return true;
+        }
+
+        float dB, ms;
+        if (!parseFloat(tok, &dB) || dB > 0 ||
+            !parseFloat(strtok(NULL, sep), &ms) || ms <= 0 || ms > 600000)
+        {
+            return false;
+        }
+        cmd->threshold = silence_threshold(dB);
+        cmd->hold = silence_hold(ms, Fs);
+        return true;
+    }
+
+    return false;
+}
+
+void control_print_telemetry(const dsp_telemetry_t &t)
+{
+    printf("frames %lu load %lu.%lu%% max %lu.%lu%% xruns %lu %lu last %lu %lu shed %u (%lu) silent %u asleep %lu.%lu%% wake %lu conv %lu peak %ld %ld\n",
+           (unsigned long)t.frames,
+           (unsigned long)(t.load / 10), (unsigned long)(t.load % 10),
+           (unsigned long)(t.loadPeak / 10), (unsigned long)(t.loadPeak % 10),
+           (unsigned long)t.xruns[0], (unsigned long)t.xruns[1],
+           (unsigned long)(t.xrunTime[0] / 1000), (unsigned long)(t.xrunTime[1] / 1000),
+           (unsigned)t.shed, (unsigned long)t.shedChanges,
+           (unsigned)t.silent,
+           (unsigned long)(t.asleep / 10), (unsigned long)(t.asleep % 10),
+           (unsigned long)t.wakeUs,
+           (unsigned long)t.convolveMisses,
+           (long)t.peak[0], (long)t.peak[1]);
+}
@@ -0,0 +1,92 @@
+#ifndef CONTROL_H
+#define CONTROL_H
+#pragma once
+
+#include <stdint.h>
+#include "iir.h"
+#include "graph.h"
+#include "spsc.h"
+
+/*
+    Messages between the control core (core0, USB and logging) and
+    the audio core (core1). Both directions are fixed-size SPSC rings,
+    the audio core only ever polls and never waits on either of them.
+*/
+
+typedef enum
+{
+    command_gain,
+    command_filter,
+    command_delay,
+    command_bypass,
+    command_requantize,
+    command_tap,
+    command_silence,
+    command_convolve
+} command_type_t;
+
+typedef struct
+{
+    command_type_t type;
+    uint8_t node;    // processing graph node
+    bool bypass;
+    int32_t gain;    // Q16 linear
+    uint32_t delay;  // samples
+    uint8_t order;   // noise shaping order
+    bool dither;
+    int8_t tap;      // output channel copied to the tap, -1 for none
+    uint16_t size;   // spectrum FFT size
+    uint16_t averages;
+    int32_t threshold; // silence detection, graph level
+    uint32_t hold;     // blocks of silence before processing stops, 0 for off
+    int8_t convolve;   // output channel run through the convolution engine, -1 for none
+    biquad_coeffs_t coeffs;
+} dsp_command_t;
+
+/* all health figures of the audio core in one report */
+typedef struct
+{
+    uint32_t frames;       // frames processed since start
+    uint32_t load;         // busy time per frame period, per-mille
+    uint32_t loadPeak;     // worst single block since last report, per-mille
+    uint32_t xruns[2];     // input, output ring buffer over-/underflows since start
+    uint32_t xrunTime[2];  // time_us_32() of the last one, 0 for none yet
+    uint8_t shed;          // load shedding level, shed_level_t
+    uint32_t shedChanges;  // shedding level changes since start
+    bool silent;           // input silent, processing stopped
+    uint32_t asleep;       // time the audio core slept waiting for the rings, per-mille
+    uint32_t wakeUs;       // processing time of the last first block after an idle stretch, 0 for none yet
+    uint32_t convolveMisses; // blocks the convolution engine did not return in time
+    int32_t peak[2];       // absolute output peak per channel since last report
+} dsp_telemetry_t;
+
+/* one block of one output channel at graph level, for the spectrum analyzer */
+typedef struct
+{
+    int32_t s[GRAPH_BLOCK_SIZE];
+} dsp_tap_t;
+
+typedef SpscRing<dsp_command_t, 16> CommandQueue;
+typedef SpscRing<dsp_telemetry_t, 8> TelemetryQueue;
+typedef SpscRing<dsp_tap_t, 16> TapQueue;
+
+/*
+    parse one line of the text protocol into a command
+    filter designs are calculated (in soft-float) by the caller's core
+    and quantized with the supplied function for the active filter path
+
+        gain <node> <dB>
+        filter <node> <type> <Fc> <Q> <dB>
+        delay <node> <samples>
+        bypass <0|1>
+        requantize <order> <0|1>
+        spectrum <channel> <size> <averages>
+        spectrum off
+        silence <dBFS> <ms>
+        silence off
+*/
+bool control_parse(char *line, float Fs, biquad_coeffs_t (*quantize)(const biquad_design_t &), dsp_command_t *cmd);
+
+void control_print_telemetry(const dsp_telemetry_t &t);
+
+#endif
@@ -0,0 +1,233 @@
+#include <string.h>
+#include <limits.h>
+#include <math.h>
+
+#include "convolve.h"
+#include "fft.h"
+
+/* exponent of an all zero spectrum, skipped */
+#define EMPTY (INT8_MIN)
+
+/* product sums stay below 2^30, half full scale as the inverse transform wants:
+    complex products below 2^31, summed over up to 2^6 partitions */
+#define HEADROOM (7)
+static_assert(CONVOLVE_MAX_PARTITIONS <= (1 << (HEADROOM - 1)), "too many partitions for the headroom");
+
+/* fft_real scales by 1/CONVOLVE_FFT */
+#define FFT_BITS (6)
+static_assert(CONVOLVE_FFT == (1 << FFT_BITS), "FFT_BITS does not match CONVOLVE_FFT");
+
+static int bits(uint32_t v)
+{
+    return v ? 32 - __builtin_clz(v) : 0;
+}
+
+static uint32_t largest(const int32_t *v, size_t n)
+{
+    uint32_t p = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t a = v[i] < 0 ? -(uint32_t)v[i] : (uint32_t)v[i];
+        p = a > p ? a : p;
+    }
+    return p;
+}
+
+static void scale(int32_t *v, size_t n, int shift)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        v[i] = shift >= 0 ? v[i] << shift : v[i] >> -shift;
+    }
+}
+
+/*
+    a Q31 spectrum to 16 bits, exponent is that of the Q31 one
+    (value = DFT * 2^exponent), returns the exponent of the result
+*/
+static int8_t pack(int32_t *spectrum, int16_t *out, int exponent)
+{
+    uint32_t p = largest(spectrum, CONVOLVE_FFT);
+    int shift = 15 - bits(p);
+    exponent += shift;
+    if (!p || exponent <= EMPTY || exponent > INT8_MAX)
+    {
+        memset(out, 0, CONVOLVE_FFT * sizeof(int16_t));
+        return EMPTY;
+    }
+
+    scale(spectrum, CONVOLVE_FFT, shift);
+    for (size_t i = 0; i < CONVOLVE_FFT; i++)
+    {
+        out[i] = (int16_t)spectrum[i];
+    }
+    return (int8_t)exponent;
+}
+
+Convolver::Convolver()
+{
+    memset(_filter, 0, sizeof(_filter));
+    memset(_filterExponent, EMPTY, sizeof(_filterExponent));
+    _partitions = 0;
+    _bank = 0;
+    reset();
+}
+
+void Convolver::reset()
+{
+    memset(_previous, 0, sizeof(_previous));
+    memset(_input, 0, sizeof(_input));
+    memset(_inputExponent, EMPTY, sizeof(_inputExponent));
+    _head = 0;
+}
+
+void Convolver::load(size_t partition, const float *taps, size_t count)
+{
+    if (partition >= CONVOLVE_MAX_PARTITIONS)
+    {
+        return;
+    }
+    count = count > CONVOLVE_BLOCK ? CONVOLVE_BLOCK : count;
+    int16_t *h = _filter[_bank ^ 1][partition];
+    int8_t *exponent = &_filterExponent[_bank ^ 1][partition];
+
+    float m = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        m = fabsf(taps[i]) > m ? fabsf(taps[i]) : m;
+    }
+    int e = 0;
+    frexpf(m, &e);
+    if (m == 0 || e < -64)
+    {
+        memset(h, 0, CONVOLVE_FFT * sizeof(int16_t));
+        *exponent = EMPTY;
+        return;
+    }
+
+    /* taps below 2^30 in Q(30 - e), zero padded to the transform */
+    int32_t w[CONVOLVE_FFT] = {};
+    for (size_t i = 0; i < count; i++)
+    {
+        w[i] = (int32_t)lrintf(ldexpf(taps[i], 30 - e));
+    }
+    fft_real(w, CONVOLVE_FFT);
+    *exponent = pack(w, h, 30 - e - FFT_BITS);
+}
+
+void Convolver::swap(size_t partitions)
+{
+    _bank ^= 1;
+    _partitions = partitions > CONVOLVE_MAX_PARTITIONS ? CONVOLVE_MAX_PARTITIONS : partitions;
+}
+
+size_t Convolver::partitions() const
+{
+    return _partitions;
+}
+
+void Convolver::process(const int32_t *in, int32_t *out)
+{
+    /* overlap-save window, the block before and this one */
+    int32_t w[CONVOLVE_FFT];
+    memcpy(w, _previous, sizeof(_previous));
+    memcpy(w + CONVOLVE_BLOCK, in, sizeof(_previous));
+    memcpy(_previous, in, sizeof(_previous));
+
+    _head = _head + 1 == CONVOLVE_MAX_PARTITIONS ? 0 : _head + 1;
+    uint32_t p = largest(w, CONVOLVE_FFT);
+    if (p)
+    {
+        /* full precision into the transform, peak below 2^30 */
+        int shift = 30 - bits(p);
+        scale(w, CONVOLVE_FFT, shift);
+        fft_real(w, CONVOLVE_FFT);
+        _inputExponent[_head] = pack(w, _input[_head], shift - FFT_BITS);
+    }
+    else
+    {
+        _inputExponent[_head] = EMPTY;
+    }
+
+    /* products are aligned to the largest one, HEADROOM bits down */
+    const int16_t(*filter)[CONVOLVE_FFT] = _filter[_bank];
+    const int8_t *filterExponent = _filterExponent[_bank];
+    int lowest = INT_MAX;
+    for (size_t k = 0, slot = _head; k < _partitions; k++)
+    {
+        if (_inputExponent[slot] != EMPTY && filterExponent[k] != EMPTY)
+        {
+            int e = _inputExponent[slot] + filterExponent[k];
+            lowest = e < lowest ? e : lowest;
+        }
+        slot = slot ? slot - 1 : CONVOLVE_MAX_PARTITIONS - 1;
+    }
+    if (lowest == INT_MAX)
+    {
+        memset(out, 0, CONVOLVE_BLOCK * sizeof(int32_t));
+        return;
+    }
+    int exponent = lowest - HEADROOM;
+
+    /* partition k of the response meets the input of k blocks ago */
+    int32_t acc[CONVOLVE_FFT] = {};
+    for (size_t k = 0, slot = _head; k < _partitions; k++)
+    {
+        const int16_t *x = _input[slot];
+        int e = _inputExponent[slot];
+        slot = slot ? slot - 1 : CONVOLVE_MAX_PARTITIONS - 1;
+        if (e == EMPTY || filterExponent[k] == EMPTY)
+        {
+            continue;
+        }
+        int shift = e + filterExponent[k] - exponent;
+        if (shift > 31)
+        {
+            continue;
+        }
+        const int16_t *h = filter[k];
+
+        /* DC and Nyquist are real, packed into the first pair */
+        acc[0] += (x[0] * h[0]) >> shift;
+        acc[1] += (x[1] * h[1]) >> shift;
+        for (size_t i = 2; i < CONVOLVE_FFT; i += 2)
+        {
+            int32_t xr = x[i], xi = x[i + 1];
+            int32_t hr = h[i], hi = h[i + 1];
+            acc[i] += (xr * hr - xi * hi) >> shift;
+            acc[i + 1] += (xr * hi + xi * hr) >> shift;
+        }
+    }
+
+    /* full precision into the inverse as well */
+    p = largest(acc, CONVOLVE_FFT);
+    if (!p)
+    {
+        memset(out, 0, CONVOLVE_BLOCK * sizeof(int32_t));
+        return;
+    }
+    int shift = 30 - bits(p);
+    scale(acc, CONVOLVE_FFT, shift);
+    exponent += shift;
+    fft_real_inverse(acc, CONVOLVE_FFT);
+
+    /* the second half is the linear convolution, the first wrapped around */
+    for (size_t i = 0; i < CONVOLVE_BLOCK; i++)
+    {
+        int64_t y = acc[CONVOLVE_BLOCK + i];
+        if (exponent > 62)
+        {
+            y = 0;
+        }
+        else if (exponent > 0)
+        {
+            y = (y + ((int64_t)1 << (exponent - 1))) >> exponent;
+        }
+        else
+        {
+            y <<= (-exponent > 32 ? 32 : -exponent);
+        }
+        y = y > CONVOLVE_LIMIT ? CONVOLVE_LIMIT : (y < -CONVOLVE_LIMIT ? -CONVOLVE_LIMIT : y);
+        out[i] = (int32_t)y;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef CONVOLVE_H
+#define CONVOLVE_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "graph.h"
+#include "spsc.h"
+
+/* partitions are one processing block, transforms twice that */
+#define CONVOLVE_BLOCK (GRAPH_BLOCK_SIZE)
+#define CONVOLVE_FFT (2 * CONVOLVE_BLOCK)
+
+/* 2048 taps, 43ms at 48kHz, most of core0 at 125MHz */
+#define CONVOLVE_MAX_PARTITIONS (64)
+#define CONVOLVE_MAX_TAPS (CONVOLVE_MAX_PARTITIONS * CONVOLVE_BLOCK)
+
+/* output limit at graph level, +6dB over full scale like the graph's headroom */
+#define CONVOLVE_LIMIT ((1 << 24) - 1)
+
+/* one block to or from the engine, numbered by the audio core */
+typedef struct
+{
+    uint32_t sequence;
+    int32_t s[CONVOLVE_BLOCK];
+} convolve_block_t;
+
+typedef SpscRing<convolve_block_t, 4> ConvolveQueue;
+
+/*
+    Uniformly partitioned overlap-save convolution in fixed point.
+    The response is cut into partitions of one block. Each block of
+    input is transformed once, together with the block before it, and
+    kept in a frequency domain delay line; the output block is the
+    inverse transform of the sum of every partition's spectrum times
+    the input spectrum it lines up with. The cost per sample is two
+    transforms of CONVOLVE_FFT points plus one complex multiply per
+    partition, against one multiply per tap in direct form.
+    Spectra are 16 bit with an exponent per spectrum (block floating
+    point), so quiet passages keep their precision; products are
+    aligned and summed in 32 bits. The transforms are Q31.
+    Responses are loaded into a second bank while the first one keeps
+    running, swap() activates it.
+*/
+class Convolver {
+public:
+    Convolver(); // no response, outputs silence
+
+    /* loading side: partitions into the inactive bank, in soft-float */
+    void load(size_t partition, const float *taps, size_t count);
+    /* make the loaded partitions the active response, 0 for none */
+    void swap(size_t partitions);
+    size_t partitions() const;
+
+    /* forgets the input history */
+    void reset();
+
+    /* one block, out may alias in */
+    void process(const int32_t *in, int32_t *out);
+
+private:
+    /* input, its spectra and their exponents, newest at _head */
+    int32_t _previous[CONVOLVE_BLOCK];
+    int16_t _input[CONVOLVE_MAX_PARTITIONS][CONVOLVE_FFT];
+    int8_t _inputExponent[CONVOLVE_MAX_PARTITIONS];
+    size_t _head;
+
+    /* two banks of partition spectra, _bank is the running one */
+    int16_t _filter[2][CONVOLVE_MAX_PARTITIONS][CONVOLVE_FFT];
+    int8_t _filterExponent[2][CONVOLVE_MAX_PARTITIONS];
+    size_t _partitions;
+    uint8_t _bank;
+};
+
+#endif
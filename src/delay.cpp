@@ -0,0 +1,135 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "delay.h"
+#include "circular.h"
+
+DelayArena::DelayArena()
+{
+    _used = 0;
+}
+
+int32_t *DelayArena::reserve(size_t words)
+{
+    if (words > DELAY_ARENA_WORDS - _used)
+    {
+        return nullptr;
+    }
+    int32_t *line = &_pool[_used];
+    _used += words;
+    memset(line, 0, words * sizeof(int32_t));
+    return line;
+}
+
+void DelayArena::reset()
+{
+    _used = 0;
+}
+
+size_t DelayArena::used() const
+{
+    return _used;
+}
+
+size_t DelayArena::capacity() const
+{
+    return DELAY_ARENA_WORDS;
+}
+
+DelayLine::DelayLine()
+{
+    _line = nullptr;
+    _mask = 0;
+    _pos = 0;
+    _delay = 0;
+    _oldDelay = 0;
+    _fade = 0;
+}
+
+bool DelayLine::begin(DelayArena &arena, uint32_t maxDelay, uint32_t delay)
+{
+    /* longer than the delay itself, the tap trails the write position */
+    uint32_t size = 1;
+    while (size <= maxDelay)
+    {
+        size <<= 1;
+    }
+
+    _line = arena.reserve(size);
+    if (!_line)
+    {
+        return false;
+    }
+
+    _mask = size - 1;
+    _pos = 0;
+    _fade = 0;
+    _delay = delay > maxDelay ? maxDelay : delay;
+    _oldDelay = _delay;
+    return true;
+}
+
+void __not_in_flash_func(DelayLine::setDelay)(uint32_t samples)
+{
+    samples = samples > _mask ? _mask : samples;
+    if (samples == _delay)
+    {
+        return;
+    }
+    /* a change during a fade restarts it from the current target */
+    _oldDelay = _delay;
+    _delay = samples;
+    _fade = DELAY_CROSSFADE;
+}
+
+uint32_t DelayLine::getDelay() const
+{
+    return _delay;
+}
+
+uint32_t DelayLine::getMaxDelay() const
+{
+    return _mask;
+}
+
+void __not_in_flash_func(DelayLine::clear)()
+{
+    memset(_line, 0, (_mask + 1) * sizeof(int32_t));
+    _oldDelay = _delay;
+    _fade = 0;
+}
+
+void __not_in_flash_func(DelayLine::process)(const int32_t *in, int32_t *out, size_t n)
+{
+    int32_t *line = _line;
+    uint32_t mask = _mask;
+    uint32_t pos = _pos;
+    uint32_t delay = _delay;
+    size_t i = 0;
+
+    /* linear crossfade between the old and the new tap, Q16 weights */
+    for (; _fade && i < n; i++, _fade--)
+    {
+        line[pos] = in[i];
+        int32_t w = (int32_t)((_fade << 16) / DELAY_CROSSFADE);
+        int64_t acc = (int64_t)line[(pos - _oldDelay) & mask] * w;
+        acc += (int64_t)line[(pos - delay) & mask] * ((1 << 16) - w);
+        out[i] = (int32_t)(acc >> 16);
+        pos = (pos + 1) & mask;
+    }
+
+    if (i < n)
+    {
+        /* the tap trails the write position by the delay, both wrap */
+        CircularCursor write(0, line, mask, pos);
+        CircularCursor tap(1, line, mask, pos - delay);
+        for (; i < n; i++)
+        {
+            *write.next() = in[i];
+            out[i] = *tap.next();
+        }
+        pos = write.position();
+    }
+
+    _pos = pos;
+}
@@ -0,0 +1,70 @@
+#ifndef DELAY_H
+#define DELAY_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    total delay memory in words, shared by every delay line
+    32KB, budgeted next to the I2S ring buffers in the 264KB of SRAM
+    (about 680ms of delay at 48kHz in total)
+*/
+#define DELAY_ARENA_WORDS (8192)
+
+/* samples over which a delay change is crossfaded */
+#define DELAY_CROSSFADE (64)
+
+/*
+    One statically sized block of memory all delay lines are carved
+    from. Lines are only reserved at init, reserve() fails instead of
+    overcommitting and nothing is ever returned.
+*/
+class DelayArena {
+public:
+    DelayArena();
+
+    int32_t *reserve(size_t words);
+    void reset();
+
+    size_t used() const;
+    size_t capacity() const;
+
+private:
+    int32_t _pool[DELAY_ARENA_WORDS];
+    size_t _used;
+};
+
+/*
+    Sample-accurate delay on a power of two circular buffer, indexed
+    with a mask. The buffer is sized for the largest delay requested at
+    init, so the delay can be changed at run time without reallocating.
+*/
+class DelayLine {
+public:
+    DelayLine();
+
+    /* reserves the line, false if the arena is exhausted */
+    bool begin(DelayArena &arena, uint32_t maxDelay, uint32_t delay);
+
+    /* clamped to the maximum, crossfades from the old to the new tap */
+    void setDelay(uint32_t samples);
+    uint32_t getDelay() const;
+    uint32_t getMaxDelay() const;
+
+    /* in and out may point to the same buffer */
+    void process(const int32_t *in, int32_t *out, size_t n);
+
+    /* fills the line with silence and ends a running crossfade */
+    void clear();
+
+private:
+    int32_t *_line;
+    uint32_t _mask;
+    uint32_t _pos;
+    uint32_t _delay;
+    uint32_t _oldDelay;
+    uint32_t _fade;
+};
+
+#endif
@@ -0,0 +1,275 @@
+#include "fft.h"
+#include "fft_twiddle.h"
+
+#define QUARTER (FFT_MAX_SIZE / 4)
+
+/* wider type for sums and products, int16 * int16 fits 32 bits */
+template <typename T>
+struct fft_acc;
+
+template <>
+struct fft_acc<int16_t>
+{
+    typedef int32_t type;
+};
+
+template <>
+struct fft_acc<int32_t>
+{
+    typedef int64_t type;
+};
+
+/* cos and sin of 2 * pi * t / FFT_MAX_SIZE */
+static inline void twiddle(uint32_t t, int32_t *c, int32_t *s)
+{
+    uint32_t r = t & (QUARTER - 1);
+    switch ((t / QUARTER) & 3)
+    {
+    case 0:
+        *c = fftCos[r];
+        *s = fftCos[QUARTER - r];
+        break;
+    case 1:
+        *c = -fftCos[QUARTER - r];
+        *s = fftCos[r];
+        break;
+    case 2:
+        *c = -fftCos[r];
+        *s = -fftCos[QUARTER - r];
+        break;
+    default:
+        *c = fftCos[QUARTER - r];
+        *s = -fftCos[r];
+        break;
+    }
+}
+
+/* x * e^(-j 2 pi t / FFT_MAX_SIZE) */
+template <typename T>
+static inline void rotate(T re, T im, uint32_t t, typename fft_acc<T>::type *outRe, typename fft_acc<T>::type *outIm)
+{
+    typedef typename fft_acc<T>::type acc_t;
+    int32_t c, s;
+    twiddle(t, &c, &s);
+    *outRe = ((acc_t)re * c + (acc_t)im * s) >> 15;
+    *outIm = ((acc_t)im * c - (acc_t)re * s) >> 15;
+}
+
+template <typename T>
+static void bitReverse(T *data, size_t m)
+{
+    for (size_t i = 1, j = 0; i < m; i++)
+    {
+        size_t bit = m >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            T re = data[2 * i], im = data[2 * i + 1];
+            data[2 * i] = data[2 * j];
+            data[2 * i + 1] = data[2 * j + 1];
+            data[2 * j] = re;
+            data[2 * j + 1] = im;
+        }
+    }
+}
+
+/* complex FFT of m points in bit reversed order, scaled by 1/m */
+template <typename T>
+static void fftComplex(T *data, size_t m)
+{
+    typedef typename fft_acc<T>::type acc_t;
+
+    size_t span = 1;
+
+    /* an odd number of radix-2 stages leaves one on its own */
+    size_t log2m = 0;
+    while (((size_t)1 << log2m) < m)
+    {
+        log2m++;
+    }
+    if (log2m & 1)
+    {
+        for (size_t i = 0; i < m; i += 2)
+        {
+            acc_t ar = data[2 * i], ai = data[2 * i + 1];
+            acc_t br = data[2 * i + 2], bi = data[2 * i + 3];
+            data[2 * i] = (T)((ar + br) >> 1);
+            data[2 * i + 1] = (T)((ai + bi) >> 1);
+            data[2 * i + 2] = (T)((ar - br) >> 1);
+            data[2 * i + 3] = (T)((ai - bi) >> 1);
+        }
+        span = 2;
+    }
+
+    /*
+        radix-4 on bit reversed data, two radix-2 stages merged
+        a b c d at i, i + span, i + 2 span, i + 3 span
+        B = W^2k b, C = W^k c, D = W^3k d (W of 4 * span points)
+    */
+    for (; span < m; span *= 4)
+    {
+        uint32_t step = FFT_MAX_SIZE / (4 * span);
+        for (size_t base = 0; base < m; base += 4 * span)
+        {
+            for (size_t k = 0; k < span; k++)
+            {
+                T *a = &data[2 * (base + k)];
+                T *b = a + 2 * span;
+                T *c = b + 2 * span;
+                T *d = c + 2 * span;
+
+                acc_t Br, Bi, Cr, Ci, Dr, Di;
+                if (k == 0)
+                {
+                    Br = b[0], Bi = b[1];
+                    Cr = c[0], Ci = c[1];
+                    Dr = d[0], Di = d[1];
+                }
+                else
+                {
+                    rotate<T>(b[0], b[1], 2 * k * step, &Br, &Bi);
+                    rotate<T>(c[0], c[1], k * step, &Cr, &Ci);
+                    rotate<T>(d[0], d[1], 3 * k * step, &Dr, &Di);
+                }
+
+                acc_t a1r = a[0] + Br, a1i = a[1] + Bi;
+                acc_t b1r = a[0] - Br, b1i = a[1] - Bi;
+                acc_t Sr = Cr + Dr, Si = Ci + Di;
+                acc_t Fr = Cr - Dr, Fi = Ci - Di;
+
+                /* -j (C - D) = Fi - j Fr */
+                a[0] = (T)((a1r + Sr) >> 2);
+                a[1] = (T)((a1i + Si) >> 2);
+                b[0] = (T)((b1r + Fi) >> 2);
+                b[1] = (T)((b1i - Fr) >> 2);
+                c[0] = (T)((a1r - Sr) >> 2);
+                c[1] = (T)((a1i - Si) >> 2);
+                d[0] = (T)((b1r - Fi) >> 2);
+                d[1] = (T)((b1i + Fr) >> 2);
+            }
+        }
+    }
+}
+
+template <typename T>
+bool fft_real(T *data, size_t n)
+{
+    typedef typename fft_acc<T>::type acc_t;
+
+    if (n < FFT_MIN_SIZE || n > FFT_MAX_SIZE || (n & (n - 1)))
+    {
+        return false;
+    }
+
+    /* one bit of headroom, a complex pair of full scale reals exceeds full scale */
+    for (size_t i = 0; i < n; i++)
+    {
+        data[i] >>= 1;
+    }
+
+    size_t m = n / 2;
+    bitReverse(data, m);
+    fftComplex(data, m);
+
+    /*
+        split the spectrum of the packed pairs into the real spectrum
+        E = (Z[k] + Z*[m-k]) / 2, O = -j (Z[k] - Z*[m-k]) / 2
+        X[k] = E + W^k O, X[m-k] = (E - W^k O)*
+    */
+    acc_t z0r = data[0], z0i = data[1];
+    data[0] = (T)(z0r + z0i);
+    data[1] = (T)(z0r - z0i);
+
+    uint32_t step = FFT_MAX_SIZE / n;
+    for (size_t k = 1; k <= m / 2; k++)
+    {
+        T *zk = &data[2 * k];
+        T *zm = &data[2 * (m - k)];
+
+        acc_t Er = ((acc_t)zk[0] + zm[0]) >> 1;
+        acc_t Ei = ((acc_t)zk[1] - zm[1]) >> 1;
+        acc_t Or = ((acc_t)zk[1] + zm[1]) >> 1;
+        acc_t Oi = ((acc_t)zm[0] - zk[0]) >> 1;
+
+        /* O fits T, it is half the difference of two values of T */
+        acc_t Wr, Wi;
+        rotate<T>((T)Or, (T)Oi, k * step, &Wr, &Wi);
+
+        /* the mirrored bin first, for k = m/2 both are the same */
+        zm[0] = (T)(Er - Wr);
+        zm[1] = (T)(Wi - Ei);
+        zk[0] = (T)(Er + Wr);
+        zk[1] = (T)(Ei + Wi);
+    }
+
+    return true;
+}
+
+template <typename T>
+bool fft_real_inverse(T *data, size_t n)
+{
+    typedef typename fft_acc<T>::type acc_t;
+
+    if (n < FFT_MIN_SIZE || n > FFT_MAX_SIZE || (n & (n - 1)))
+    {
+        return false;
+    }
+
+    /*
+        join the real spectrum back into the one of the packed pairs
+        E = (X[k] + X*[m-k]) / 2, O = W^-k (X[k] - X*[m-k]) / 2
+        Z[k] = E + j O, Z[m-k] = E* + j O*
+    */
+    size_t m = n / 2;
+    acc_t x0 = data[0], xm = data[1];
+    data[0] = (T)((x0 + xm) >> 1);
+    data[1] = (T)((x0 - xm) >> 1);
+
+    uint32_t step = FFT_MAX_SIZE / n;
+    for (size_t k = 1; k <= m / 2; k++)
+    {
+        T *xk = &data[2 * k];
+        T *xmk = &data[2 * (m - k)];
+
+        acc_t Er = ((acc_t)xk[0] + xmk[0]) >> 1;
+        acc_t Ei = ((acc_t)xk[1] - xmk[1]) >> 1;
+        acc_t Gr = ((acc_t)xk[0] - xmk[0]) >> 1;
+        acc_t Gi = ((acc_t)xk[1] + xmk[1]) >> 1;
+
+        acc_t Or, Oi;
+        rotate<T>((T)Gr, (T)Gi, FFT_MAX_SIZE - k * step, &Or, &Oi);
+
+        /* conjugated for the forward transform below */
+        xmk[0] = (T)(Er + Oi);
+        xmk[1] = (T)(Ei - Or);
+        xk[0] = (T)(Er - Oi);
+        xk[1] = (T)(-Ei - Or);
+    }
+    data[1] = -data[1];
+
+    /* conj(FFT(conj(Z))) is the inverse, the pairs are the samples */
+    bitReverse(data, m);
+    fftComplex(data, m);
+    for (size_t i = 0; i < m; i++)
+    {
+        data[2 * i + 1] = -data[2 * i + 1];
+    }
+
+    return true;
+}
+
+template bool fft_real<int16_t>(int16_t *data, size_t n);
+template bool fft_real<int32_t>(int32_t *data, size_t n);
+template bool fft_real_inverse<int16_t>(int16_t *data, size_t n);
+template bool fft_real_inverse<int32_t>(int32_t *data, size_t n);
+
+int16_t fft_hann(size_t i, size_t n)
+{
+    int32_t c, s;
+    twiddle((uint32_t)(i * (FFT_MAX_SIZE / n)), &c, &s);
+    return (int16_t)((32767 - c) >> 1);
+}
@@ -0,0 +1,40 @@
+#ifndef FFT_H
+#define FFT_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FFT_MIN_SIZE (64)
+#define FFT_MAX_SIZE (4096)
+
+/*
+    In-place fixed-point FFT of n real samples, n a power of two in
+    FFT_MIN_SIZE..FFT_MAX_SIZE, Q15 (int16_t) or Q31 (int32_t).
+    The samples are transformed as n/2 complex values with radix-4
+    butterflies (one radix-2 stage where log2(n/2) is odd) and then
+    split into the spectrum of the real input.
+    The result is scaled by 1/n so no input can overflow, a full scale
+    sine gives a bin of half full scale.
+    Output layout (n/2 + 1 bins in n words):
+        data[0]          re X[0]
+        data[1]          re X[n/2]
+        data[2k, 2k+1]   re, im X[k] for k = 1..n/2-1
+    Twiddles come from one Q15 quarter wave table in flash.
+    Returns false for an unsupported n.
+*/
+template <typename T>
+bool fft_real(T *data, size_t n);
+
+/*
+    Inverse of fft_real, in place: a spectrum in its layout and scale
+    (bins within half full scale, as fft_real leaves them) back to the
+    n real samples, scaled by 1/n.
+*/
+template <typename T>
+bool fft_real_inverse(T *data, size_t n);
+
+/* Hann window coefficient i of n in Q15, from the same table */
+int16_t fft_hann(size_t i, size_t n);
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef FFT_TWIDDLE_H
+#define FFT_TWIDDLE_H
+#pragma once
+
+#include <stdint.h>
+
+/*
+    quarter wave cosine in Q15, cos(2 * pi * i / 4096) for i = 0..1024
+    (1.0 is stored as 32767), sine and the other quadrants are folded
+    from it. generated, regenerate for a different FFT_MAX_SIZE:
+    python3 -c "import math; print([min(32767, round(math.cos(2*math.pi*i/4096)*32768)) for i in range(1025)])"
+    const, so it stays in flash
+*/
+static const int16_t fftCos[4096 / 4 + 1] = {
+    32767, 32767, 32767, 32767, 32767, 32767, 32767, 32766, 32766, 32765, 32764, 32763,
+    32762, 32761, 32760, 32759, 32758, 32757, 32756, 32754, 32753, 32751, 32749, 32748,
+    32746, 32744, 32742, 32740, 32738, 32736, 32733, 32731, 32729, 32726, 32723, 32721,
+    32718, 32715, 32712, 32709, 32706, 32703, 32700, 32697, 32693, 32690, 32686, 32683,
+    32679, 32675, 32672, 32668, 32664, 32660, 32656, 32651, 32647, 32643, 32638, 32634,
+    32629, 32625, 32620, 32615, 32610, 32605, 32600, 32595, 32590, 32585, 32579, 32574,
+    32568, 32563, 32557, 32551, 32546, 32540, 32534, 32528, 32522, 32515, 32509, 32503,
+    32496, 32490, 32483, 32477, 32470, 32463, 32456, 32449, 32442, 32435, 32428, 32421,
+    32413, 32406, 32398, 32391, 32383, 32376, 32368, 32360, 32352, 32344, 32336, 32328,
+    32319, 32311, 32303, 32294, 32286, 32277, 32268, 32259, 32251, 32242, 32233, 32224,
+    32214, 32205, 32196, 32186, 32177, 32167, 32158, 32148, 32138, 32129, 32119, 32109,
+    32099, 32088, 32078, 32068, 32058, 32047, 32037, 32026, 32015, 32005, 31994, 31983,
+    31972, 31961, 31950, 31938, 31927, 31916, 31904, 31893, 31881, 31870, 31858, 31846,
+    31834, 31822, 31810, 31798, 31786, 31774, 31761, 31749, 31737, 31724, 31711, 31699,
+    31686, 31673, 31660, 31647, 31634, 31621, 31608, 31594, 31581, 31568, 31554, 31540,
+    31527, 31513, 31499, 31485, 31471, 31457, 31443, 31429, 31415, 31400, 31386, 31372,
+    31357, 31342, 31328, 31313, 31298, 31283, 31268, 31253, 31238, 31223, 31207, 31192,
+    31177, 31161, 31146, 31130, 31114, 31098, 31082, 31067, 31050, 31034, 31018, 31002,
+    30986, 30969, 30953, 30936, 30920, 30903, 30886, 30869, 30853, 30836, 30819, 30801,
+    30784, 30767, 30750, 30732, 30715, 30697, 30680, 30662, 30644, 30626, 30608, 30590,
+    30572, 30554, 30536, 30518, 30499, 30481, 30462, 30444, 30425, 30407, 30388, 30369,
+    30350, 30331, 30312, 30293, 30274, 30254, 30235, 30216, 30196, 30177, 30157, 30137,
+    30118, 30098, 30078, 30058, 30038, 30018, 29997, 29977, 29957, 29936, 29916, 29895,
+    29875, 29854, 29833, 29813, 29792, 29771, 29750, 29729, 29707, 29686, 29665, 29643,
+    29622, 29600, 29579, 29557, 29535, 29514, 29492, 29470, 29448, 29426, 29404, 29381,
+    29359, 29337, 29314, 29292, 29269, 29247, 29224, 29201, 29178, 29155, 29132, 29109,
+    29086, 29063, 29040, 29016, 28993, 28970, 28946, 28922, 28899, 28875, 28851, 28827,
+    28803, 28779, 28755, 28731, 28707, 28683, 28658, 28634, 28610, 28585, 28560, 28536,
+    28511, 28486, 28461, 28436, 28411, 28386, 28361, 28336, 28311, 28285, 28260, 28234,
+    28209, 28183, 28158, 28132, 28106, 28080, 28054, 28028, 28002, 27976, 27950, 27924,
+    27897, 27871, 27844, 27818, 27791, 27765, 27738, 27711, 27684, 27657, 27630, 27603,
+    27576, 27549, 27522, 27494, 27467, 27440, 27412, 27384, 27357, 27329, 27301, 27273,
+    27246, 27218, 27190, 27162, 27133, 27105, 27077, 27049, 27020, 26992, 26963, 26935,
+    26906, 26877, 26848, 26820, 26791, 26762, 26733, 26704, 26674, 26645, 26616, 26586,
+    26557, 26528, 26498, 26468, 26439, 26409, 26379, 26349, 26320, 26290, 26259, 26229,
+    26199, 26169, 26139, 26108, 26078, 26048, 26017, 25986, 25956, 25925, 25894, 25863,
+    25833, 25802, 25771, 25739, 25708, 25677, 25646, 25615, 25583, 25552, 25520, 25489,
+    25457, 25425, 25394, 25362, 25330, 25298, 25266, 25234, 25202, 25170, 25138, 25105,
+    25073, 25041, 25008, 24976, 24943, 24910, 24878, 24845, 24812, 24779, 24746, 24713,
+    24680, 24647, 24614, 24581, 24548, 24514, 24481, 24448, 24414, 24380, 24347, 24313,
+    24279, 24246, 24212, 24178, 24144, 24110, 24076, 24042, 24008, 23973, 23939, 23905,
+    23870, 23836, 23801, 23767, 23732, 23697, 23663, 23628, 23593, 23558, 23523, 23488,
+    23453, 23418, 23383, 23348, 23312, 23277, 23241, 23206, 23170, 23135, 23099, 23064,
+    23028, 22992, 22956, 22920, 22884, 22848, 22812, 22776, 22740, 22704, 22668, 22631,
+    22595, 22558, 22522, 22485, 22449, 22412, 22375, 22339, 22302, 22265, 22228, 22191,
+    22154, 22117, 22080, 22043, 22006, 21968, 21931, 21894, 21856, 21819, 21781, 21744,
+    21706, 21668, 21631, 21593, 21555, 21517, 21479, 21441, 21403, 21365, 21327, 21289,
+    21251, 21212, 21174, 21136, 21097, 21059, 21020, 20981, 20943, 20904, 20865, 20827,
+    20788, 20749, 20710, 20671, 20632, 20593, 20554, 20515, 20475, 20436, 20397, 20357,
+    20318, 20279, 20239, 20200, 20160, 20120, 20081, 20041, 20001, 19961, 19921, 19881,
+    19841, 19801, 19761, 19721, 19681, 19641, 19601, 19560, 19520, 19479, 19439, 19399,
+    19358, 19317, 19277, 19236, 19195, 19155, 19114, 19073, 19032, 18991, 18950, 18909,
+    18868, 18827, 18786, 18745, 18703, 18662, 18621, 18579, 18538, 18496, 18455, 18413,
+    18372, 18330, 18288, 18247, 18205, 18163, 18121, 18079, 18037, 17995, 17953, 17911,
+    17869, 17827, 17785, 17743, 17700, 17658, 17616, 17573, 17531, 17488, 17446, 17403,
+    17361, 17318, 17275, 17233, 17190, 17147, 17104, 17061, 17018, 16975, 16932, 16889,
+    16846, 16803, 16760, 16717, 16673, 16630, 16587, 16543, 16500, 16456, 16413, 16369,
+    16326, 16282, 16239, 16195, 16151, 16108, 16064, 16020, 15976, 15932, 15888, 15844,
+    15800, 15756, 15712, 15668, 15624, 15580, 15535, 15491, 15447, 15402, 15358, 15314,
+    15269, 15225, 15180, 15136, 15091, 15046, 15002, 14957, 14912, 14867, 14823, 14778,
+    14733, 14688, 14643, 14598, 14553, 14508, 14463, 14418, 14373, 14327, 14282, 14237,
+    14192, 14146, 14101, 14056, 14010, 13965, 13919, 13874, 13828, 13783, 13737, 13691,
+    13646, 13600, 13554, 13508, 13463, 13417, 13371, 13325, 13279, 13233, 13187, 13141,
+    13095, 13049, 13003, 12957, 12910, 12864, 12818, 12772, 12725, 12679, 12633, 12586,
+    12540, 12493, 12447, 12400, 12354, 12307, 12261, 12214, 12167, 12121, 12074, 12027,
+    11980, 11934, 11887, 11840, 11793, 11746, 11699, 11652, 11605, 11558, 11511, 11464,
+    11417, 11370, 11323, 11276, 11228, 11181, 11134, 11087, 11039, 10992, 10945, 10897,
+    10850, 10802, 10755, 10707, 10660, 10612, 10565, 10517, 10469, 10422, 10374, 10326,
+    10279, 10231, 10183, 10135, 10088, 10040, 9992, 9944, 9896, 9848, 9800, 9752,
+    9704, 9656, 9608, 9560, 9512, 9464, 9416, 9368, 9319, 9271, 9223, 9175,
+    9127, 9078, 9030, 8982, 8933, 8885, 8836, 8788, 8740, 8691, 8643, 8594,
+    8546, 8497, 8449, 8400, 8351, 8303, 8254, 8206, 8157, 8108, 8059, 8011,
+    7962, 7913, 7864, 7816, 7767, 7718, 7669, 7620, 7571, 7522, 7473, 7425,
+    7376, 7327, 7278, 7229, 7180, 7130, 7081, 7032, 6983, 6934, 6885, 6836,
+    6787, 6737, 6688, 6639, 6590, 6541, 6491, 6442, 6393, 6343, 6294, 6245,
+    6195, 6146, 6097, 6047, 5998, 5948, 5899, 5850, 5800, 5751, 5701, 5652,
+    5602, 5553, 5503, 5453, 5404, 5354, 5305, 5255, 5205, 5156, 5106, 5057,
+    5007, 4957, 4907, 4858, 4808, 4758, 4709, 4659, 4609, 4559, 4510, 4460,
+    4410, 4360, 4310, 4260, 4211, 4161, 4111, 4061, 4011, 3961, 3911, 3861,
+    3812, 3762, 3712, 3662, 3612, 3562, 3512, 3462, 3412, 3362, 3312, 3262,
+    3212, 3162, 3112, 3062, 3012, 2962, 2912, 2861, 2811, 2761, 2711, 2661,
+    2611, 2561, 2511, 2461, 2411, 2360, 2310, 2260, 2210, 2160, 2110, 2060,
+    2009, 1959, 1909, 1859, 1809, 1758, 1708, 1658, 1608, 1558, 1507, 1457,
+    1407, 1357, 1307, 1256, 1206, 1156, 1106, 1055, 1005, 955, 905, 854,
+    804, 754, 704, 653, 603, 553, 503, 452, 402, 352, 302, 251,
+    201, 151, 101, 50, 0
+};
+
+#endif
@@ -0,0 +1,92 @@
+#include "pico/stdlib.h"
+#include "governor.h"
+
+LoadGovernor::LoadGovernor(uint32_t settleBlocks)
+{
+    _level = shed_none;
+    _over = 0;
+    _under = 0;
+    _recover = GOVERNOR_RECOVER_BLOCKS;
+    _sinceRecover = UINT32_MAX;
+    _settle = settleBlocks;
+    _changes = 0;
+}
+
+void __not_in_flash_func(LoadGovernor::_step)(int direction)
+{
+    if (direction > 0)
+    {
+        /* the last recovery did not hold, wait longer next time */
+        if (_sinceRecover < _recover && _recover < GOVERNOR_RECOVER_MAX)
+        {
+            _recover *= 2;
+        }
+        _level = (shed_level_t)(_level + 1);
+    }
+    else
+    {
+        _level = (shed_level_t)(_level - 1);
+        _sinceRecover = 0;
+    }
+    _over = 0;
+    _under = 0;
+    _changes++;
+}
+
+bool __not_in_flash_func(LoadGovernor::update)(uint32_t loadPermille, bool xrun)
+{
+    if (_sinceRecover < UINT32_MAX)
+    {
+        _sinceRecover++;
+    }
+
+    /* until the rings went round once, over- and underflows are startup */
+    if (_settle > 0)
+    {
+        _settle--;
+        xrun = false;
+    }
+
+    if (loadPermille > GOVERNOR_HIGH || xrun)
+    {
+        _under = 0;
+        if ((xrun || ++_over >= GOVERNOR_ESCALATE_BLOCKS) && _level < shed_bypass)
+        {
+            _step(1);
+            return true;
+        }
+        return false;
+    }
+
+    _over = 0;
+    if (loadPermille >= GOVERNOR_LOW)
+    {
+        /* in between, hold */
+        _under = 0;
+        return false;
+    }
+
+    if (++_under >= _recover && _level > shed_none)
+    {
+        _step(-1);
+        return true;
+    }
+
+    /* long stable, forget earlier back-offs */
+    if (_level == shed_none && _under >= GOVERNOR_RECOVER_MAX)
+    {
+        _recover = GOVERNOR_RECOVER_BLOCKS;
+        _under = 0;
+    }
+    return false;
+}
+
+shed_level_t __not_in_flash_func(LoadGovernor::level)() const
+{
+    return _level;
+}
+
+uint32_t __not_in_flash_func(LoadGovernor::changes)() const
+{
+    return _changes;
+}
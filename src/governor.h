@@ -0,0 +1,59 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+#pragma once
+
+#include <stdint.h>
+
+/* per block load, per-mille of the block period, above which the governor sheds */
+#define GOVERNOR_HIGH (900)
+/* and below which it may give work back */
+#define GOVERNOR_LOW (600)
+/* consecutive blocks above GOVERNOR_HIGH before stepping up */
+#define GOVERNOR_ESCALATE_BLOCKS (8)
+/* consecutive blocks below GOVERNOR_LOW before stepping down,
+    doubled each time a recovery has to be taken back */
+#define GOVERNOR_RECOVER_BLOCKS (1024)
+#define GOVERNOR_RECOVER_MAX (16 * GOVERNOR_RECOVER_BLOCKS)
+
+/* what is dropped, each level includes the ones before it */
+typedef enum
+{
+    shed_none,
+    shed_optional, // optional graph stages, noise shaping, spectrum tap
+    shed_economy,  // biquads run their 16 bit variant
+    shed_bypass    // no processing at all
+} shed_level_t;
+
+/*
+    Load shedding policy of the audio core.
+    Fed once per block with the time the block took and whether a
+    ring buffer ran over or under since the last one. An xrun steps up
+    at once, sustained load above GOVERNOR_HIGH steps up after a few
+    blocks, and only a long stretch below GOVERNOR_LOW steps back down.
+    Xruns of the first settleBlocks blocks are the rings priming and
+    do not count, give it one lap of the ring buffers.
+    The caller applies the level, the governor only decides.
+*/
+class LoadGovernor {
+public:
+    LoadGovernor(uint32_t settleBlocks);
+
+    /* true if the level changed */
+    bool update(uint32_t loadPermille, bool xrun);
+
+    shed_level_t level() const;
+    uint32_t changes() const; // level changes since start
+
+private:
+    void _step(int direction);
+
+    shed_level_t _level;
+    uint32_t _over;
+    uint32_t _under;
+    uint32_t _recover;      // current recovery hold, blocks
+    uint32_t _sinceRecover; // blocks since the last step down
+    uint32_t _settle;       // blocks left whose xruns are ignored
+    uint32_t _changes;
+};
+
+#endif
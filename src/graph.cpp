@@ -0,0 +1,716 @@
+#include <string.h>
+#include <math.h>
+
+#include "pico/stdlib.h"
+#include "graph.h"
+
+static int32_t gainQ16(float dB)
+{
+    return (int32_t)(powf(10.0f, dB / 20.0f) * GAIN_UNITY);
+}
+
+graph_node_t graph_input(uint8_t channel)
+{
+    graph_node_t n = {};
+    n.type = node_input;
+    n.channel = channel;
+    return n;
+}
+
+graph_node_t graph_output(uint8_t source, uint8_t channel)
+{
+    graph_node_t n = {};
+    n.type = node_output;
+    n.sources = 1;
+    n.source[0] = source;
+    n.channel = channel;
+    return n;
+}
+
+graph_node_t graph_biquad(uint8_t source, biquad_design_t design)
+{
+    graph_node_t n = {};
+    n.type = node_biquad;
+    n.sources = 1;
+    n.source[0] = source;
+    n.biquad = design;
+    return n;
+}
+
+graph_node_t graph_biquad(uint8_t source, const biquad_coeffs_t &coeffs)
+{
+    graph_node_t n = {};
+    n.type = node_biquad;
+    n.sources = 1;
+    n.source[0] = source;
+    n.quantized = true;
+    n.coeffs = coeffs;
+    return n;
+}
+
+graph_node_t graph_gain(uint8_t source, float dB)
+{
+    graph_node_t n = {};
+    n.type = node_gain;
+    n.sources = 1;
+    n.source[0] = source;
+    n.gain[0] = dB;
+    return n;
+}
+
+graph_node_t graph_mix(uint8_t sourceA, float dBA, uint8_t sourceB, float dBB)
+{
+    const uint8_t sources[2] = {sourceA, sourceB};
+    const float dB[2] = {dBA, dBB};
+    return graph_mix(sources, dB, 2);
+}
+
+graph_node_t graph_mix(const uint8_t *sources, const float *dB, uint8_t count)
+{
+    graph_node_t n = {};
+    n.type = node_mix;
+    /* more than GRAPH_MAX_FANIN is left for compile() to refuse */
+    n.sources = count;
+    for (size_t k = 0; k < count && k < GRAPH_MAX_FANIN; k++)
+    {
+        n.source[k] = sources[k];
+        n.gain[k] = dB[k];
+    }
+    return n;
+}
+
+graph_node_t graph_delay(uint8_t source, uint32_t samples, uint32_t maxSamples)
+{
+    graph_node_t n = {};
+    n.type = node_delay;
+    n.sources = 1;
+    n.source[0] = source;
+    n.delay.samples = samples;
+    n.delay.max = maxSamples > samples ? maxSamples : samples;
+    return n;
+}
+
+graph_node_t graph_split(uint8_t source)
+{
+    graph_node_t n = {};
+    n.type = node_split;
+    n.sources = 1;
+    n.source[0] = source;
+    return n;
+}
+
+graph_node_t graph_merge(uint8_t source, uint8_t split)
+{
+    graph_node_t n = {};
+    n.type = node_merge;
+    n.sources = 1;
+    n.source[0] = source;
+    n.split = split;
+    return n;
+}
+
+graph_node_t graph_optional(graph_node_t node)
+{
+    node.optional = true;
+    return node;
+}
+
+/*
+    kernels
+    all of them read every input sample before writing the output
+    sample, so out may alias in[0]
+*/
+
+/* full rate position of this block within a running fade */
+static __force_inline int32_t fade_position(const plan_step_t &step)
+{
+    return (GRAPH_FADE_BLOCKS - step.fade) * GRAPH_BLOCK_SIZE;
+}
+
+static void __not_in_flash_func(kernel_biquad)(plan_step_t &step)
+{
+    if (!step.next)
+    {
+        step.biquad->filterBlock(step.in[0], step.out, step.length);
+        return;
+    }
+
+    /* both settings run on the same input until the fade is over,
+        the target first as out may alias the input */
+    int32_t next[GRAPH_BLOCK_SIZE];
+    step.next->filterBlock(step.in[0], next, step.length);
+    step.biquad->filterBlock(step.in[0], step.out, step.length);
+
+    int32_t position = fade_position(step);
+    for (size_t i = 0; i < step.length; i++)
+    {
+        int64_t difference = (int64_t)next[i] - step.out[i];
+        int32_t done = position + ((int32_t)i + 1) * step.stride;
+        step.out[i] += (int32_t)((difference * done) / GRAPH_FADE_SAMPLES);
+    }
+
+    if (--step.fade == 0)
+    {
+        *step.biquad = *step.next;
+        step.next = nullptr;
+    }
+}
+
+static __force_inline int32_t saturate(int64_t s)
+{
+    return (int32_t)(s > GRAPH_LIMIT ? GRAPH_LIMIT : (s < -GRAPH_LIMIT ? -GRAPH_LIMIT : s));
+}
+
+static void __not_in_flash_func(kernel_gain)(plan_step_t &step)
+{
+    const int32_t *in = step.in[0];
+    int32_t *out = step.out;
+    int32_t g = step.gain[0];
+
+    if (step.fade)
+    {
+        int32_t position = fade_position(step);
+        int32_t difference = step.nextGain - g;
+        for (size_t i = 0; i < step.length; i++)
+        {
+            int32_t done = position + ((int32_t)i + 1) * step.stride;
+            int32_t gi = g + (difference * done) / GRAPH_FADE_SAMPLES;
+            out[i] = saturate(((int64_t)in[i] * gi) >> 16);
+        }
+        if (--step.fade == 0)
+        {
+            step.gain[0] = step.nextGain;
+        }
+        return;
+    }
+
+    if (g == GAIN_UNITY)
+    {
+        if (in != out)
+        {
+            memcpy(out, in, step.length * sizeof(int32_t));
+        }
+        return;
+    }
+
+    for (size_t i = 0; i < step.length; i++)
+    {
+        out[i] = saturate(((int64_t)in[i] * g) >> 16);
+    }
+}
+
+static void __not_in_flash_func(kernel_mix)(plan_step_t &step)
+{
+    for (size_t i = 0; i < step.length; i++)
+    {
+        int64_t acc = 0;
+        for (size_t k = 0; k < step.inputs; k++)
+        {
+            acc += (int64_t)step.in[k][i] * step.gain[k];
+        }
+        step.out[i] = saturate(acc >> 16);
+    }
+}
+
+static void __not_in_flash_func(kernel_delay)(plan_step_t &step)
+{
+    step.delay->process(step.in[0], step.out, GRAPH_BLOCK_SIZE);
+}
+
+static void __not_in_flash_func(kernel_copy)(plan_step_t &step)
+{
+    memcpy(step.out, step.in[0], GRAPH_BLOCK_SIZE * sizeof(int32_t));
+}
+
+static void __not_in_flash_func(kernel_split)(plan_step_t &step)
+{
+    step.subband->split(step.in[0], step.out, GRAPH_BLOCK_SIZE);
+}
+
+static void __not_in_flash_func(kernel_merge)(plan_step_t &step)
+{
+    step.subband->merge(step.in[0], step.out, GRAPH_BLOCK_SIZE);
+}
+
+Graph::Graph()
+{
+    _steps = 0;
+    _cycles = 0;
+    _error = nullptr;
+    _skipOptional = false;
+    _biquadCount = 0;
+    _delayCount = 0;
+    _subbandCount = 0;
+    memset(_nodeStep, -1, sizeof(_nodeStep));
+    memset(_nodeStride, 1, sizeof(_nodeStride));
+    memset(_input, 0, sizeof(_input));
+    memset(_output, 0, sizeof(_output));
+}
+
+bool Graph::compile(const graph_node_t *nodes, size_t count)
+{
+    _steps = 0;
+    _cycles = 0;
+    _error = nullptr;
+    _biquadCount = 0;
+    _delayCount = 0;
+    _subbandCount = 0;
+    _arena.reset();
+    memset(_nodeStep, -1, sizeof(_nodeStep));
+    memset(_nodeStride, 1, sizeof(_nodeStride));
+
+    if (count > GRAPH_MAX_NODES)
+    {
+        _error = "too many nodes";
+        return false;
+    }
+
+    /* count consumers to know when a buffer can be released */
+    uint8_t consumers[GRAPH_MAX_NODES] = {};
+    int8_t outputOf[GRAPH_MAX_NODES];
+    memset(outputOf, -1, sizeof(outputOf));
+
+    /* the split a low band node derives from, -1 at the full rate */
+    int8_t band[GRAPH_MAX_NODES];
+    memset(band, -1, sizeof(band));
+    bool merged[GRAPH_MAX_NODES] = {};
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const graph_node_t &n = nodes[i];
+        if (n.sources > GRAPH_MAX_FANIN)
+        {
+            _error = "too many node inputs";
+            return false;
+        }
+        if ((n.type == node_input || n.type == node_output) && n.channel >= GRAPH_MAX_CHANNELS)
+        {
+            _error = "invalid channel";
+            return false;
+        }
+        for (size_t k = 0; k < n.sources; k++)
+        {
+            /* sources must come first, this makes the list a valid order */
+            if (n.source[k] >= i)
+            {
+                _error = "node listed before its source";
+                return false;
+            }
+            consumers[n.source[k]]++;
+        }
+        if (n.type == node_output)
+        {
+            outputOf[n.source[0]] = n.channel;
+        }
+        if (n.optional && n.type != node_biquad && n.type != node_gain)
+        {
+            _error = "only biquads and gains can be optional";
+            return false;
+        }
+
+        int8_t b = n.sources ? band[n.source[0]] : -1;
+        for (size_t k = 1; k < n.sources; k++)
+        {
+            if (band[n.source[k]] != b)
+            {
+                _error = "sources at different rates";
+                return false;
+            }
+        }
+        switch (n.type)
+        {
+        case node_split:
+            if (b >= 0)
+            {
+                _error = "split on the low band";
+                return false;
+            }
+            band[i] = (int8_t)i;
+            break;
+        case node_merge:
+            if (b < 0 || b != n.split || merged[n.split])
+            {
+                _error = "merge does not close its split";
+                return false;
+            }
+            merged[n.split] = true;
+            break;
+        case node_biquad:
+        case node_gain:
+        case node_mix:
+            band[i] = b;
+            break;
+        default:
+            if (b >= 0)
+            {
+                _error = "only biquads, gains and mixes on the low band";
+                return false;
+            }
+            break;
+        }
+    }
+    for (size_t i = 0; i < count; i++)
+    {
+        if (nodes[i].type == node_split && !merged[i])
+        {
+            _error = "split without merge";
+            return false;
+        }
+    }
+
+    /* check the delay memory up front, the arena never overcommits */
+    size_t delayWords = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (nodes[i].type == node_delay)
+        {
+            uint32_t size = 1;
+            while (size <= nodes[i].delay.max)
+            {
+                size <<= 1;
+            }
+            delayWords += size;
+        }
+    }
+    if (delayWords > _arena.capacity())
+    {
+        _error = "delay arena overcommitted";
+        return false;
+    }
+
+    /* buffer assignment, scratch buffers are recycled once their last reader ran */
+    int32_t *buffer[GRAPH_MAX_NODES] = {};
+    bool scratchUsed[GRAPH_MAX_BUFFERS] = {};
+
+    for (size_t i = 0; i < count; i++)
+    {
+        const graph_node_t &n = nodes[i];
+
+        if (n.type == node_input)
+        {
+            buffer[i] = _input[n.channel];
+            continue;
+        }
+
+        if (n.type == node_output && buffer[n.source[0]] == _output[n.channel])
+        {
+            /* the source already wrote straight into the output */
+            consumers[n.source[0]]--;
+            continue;
+        }
+
+        plan_step_t &step = _plan[_steps];
+        memset(&step, 0, sizeof(step));
+        bool low = band[i] >= 0 && n.type != node_split;
+        step.stride = low ? SUBBAND_FACTOR : 1;
+        step.length = GRAPH_BLOCK_SIZE / step.stride;
+        _nodeStride[i] = band[i] >= 0 ? SUBBAND_FACTOR : 1;
+        step.inputs = n.sources;
+        step.optional = n.optional;
+        for (size_t k = 0; k < n.sources; k++)
+        {
+            step.in[k] = buffer[n.source[k]];
+        }
+
+        /* pick the destination */
+        int32_t *out = nullptr;
+        if (n.type == node_output)
+        {
+            out = _output[n.channel];
+        }
+        else if (outputOf[i] >= 0 && consumers[i] == 1)
+        {
+            /* only feeds an output, write there directly */
+            out = _output[outputOf[i]];
+        }
+        else if (n.sources && consumers[n.source[0]] == 1)
+        {
+            /* last reader of the first source, process in place */
+            out = buffer[n.source[0]];
+            consumers[n.source[0]] = 0;
+        }
+        else
+        {
+            for (size_t b = 0; b < GRAPH_MAX_BUFFERS; b++)
+            {
+                if (!scratchUsed[b])
+                {
+                    scratchUsed[b] = true;
+                    out = _scratch[b];
+                    break;
+                }
+            }
+            if (!out)
+            {
+                _error = "out of scratch buffers";
+                return false;
+            }
+        }
+        step.out = out;
+        buffer[i] = out;
+
+        switch (n.type)
+        {
+        case node_biquad:
+            if (_biquadCount == GRAPH_MAX_BIQUADS)
+            {
+                _error = "too many biquads";
+                return false;
+            }
+            step.biquad = &_biquads[_biquadCount++];
+            *step.biquad = IIR();
+            step.biquad->setCoefficients(n.quantized ? n.coeffs : IIR::quantize(n.biquad));
+            step.kernel = kernel_biquad;
+            _cycles += CYCLES_BIQUAD * step.length;
+            break;
+        case node_gain:
+            step.gain[0] = gainQ16(n.gain[0]);
+            step.kernel = kernel_gain;
+            _cycles += CYCLES_GAIN * step.length;
+            break;
+        case node_mix:
+            for (size_t k = 0; k < n.sources; k++)
+            {
+                step.gain[k] = gainQ16(n.gain[k]);
+            }
+            step.kernel = kernel_mix;
+            _cycles += CYCLES_MIX_INPUT * n.sources * step.length;
+            break;
+        case node_delay:
+            if (_delayCount == GRAPH_MAX_DELAYS)
+            {
+                _error = "too many delays";
+                return false;
+            }
+            step.delay = &_delays[_delayCount++];
+            if (!step.delay->begin(_arena, n.delay.max, n.delay.samples))
+            {
+                _error = "delay arena overcommitted";
+                return false;
+            }
+            step.kernel = kernel_delay;
+            _cycles += CYCLES_DELAY * GRAPH_BLOCK_SIZE;
+            break;
+        case node_split:
+            if (_subbandCount == GRAPH_MAX_SUBBANDS)
+            {
+                _error = "too many splits";
+                return false;
+            }
+            step.subband = &_subbands[_subbandCount++];
+            step.subband->reset();
+            step.kernel = kernel_split;
+            _cycles += CYCLES_SPLIT * GRAPH_BLOCK_SIZE;
+            break;
+        case node_merge:
+            step.subband = _plan[_nodeStep[n.split]].subband;
+            step.kernel = kernel_merge;
+            _cycles += CYCLES_MERGE * GRAPH_BLOCK_SIZE;
+            break;
+        case node_output:
+            step.kernel = kernel_copy;
+            _cycles += CYCLES_COPY * GRAPH_BLOCK_SIZE;
+            break;
+        case node_input:
+            break;
+        }
+        _cycles += CYCLES_STEP;
+
+        /* release sources that have no readers left */
+        for (size_t k = 0; k < n.sources; k++)
+        {
+            uint8_t src = n.source[k];
+            if (consumers[src] && --consumers[src] == 0 && buffer[src] != out)
+            {
+                for (size_t b = 0; b < GRAPH_MAX_BUFFERS; b++)
+                {
+                    if (buffer[src] == _scratch[b])
+                    {
+                        scratchUsed[b] = false;
+                    }
+                }
+            }
+        }
+
+        _nodeStep[i] = (int8_t)_steps;
+        _steps++;
+    }
+
+    return true;
+}
+
+void __not_in_flash_func(Graph::process)()
+{
+    for (size_t i = 0; i < _steps; i++)
+    {
+        plan_step_t &step = _plan[i];
+        if (step.optional && _skipOptional)
+        {
+            if (step.in[0] != step.out)
+            {
+                memcpy(step.out, step.in[0], step.length * sizeof(int32_t));
+            }
+            continue;
+        }
+        step.kernel(step);
+    }
+}
+
+int32_t *__not_in_flash_func(Graph::input)(int channel)
+{
+    return _input[channel];
+}
+
+const int32_t *__not_in_flash_func(Graph::output)(int channel)
+{
+    return _output[channel];
+}
+
+bool __not_in_flash_func(Graph::setBiquad)(uint8_t node, const biquad_coeffs_t &c, bool fade)
+{
+    if (node >= GRAPH_MAX_NODES || _nodeStep[node] < 0 || !_plan[_nodeStep[node]].biquad)
+    {
+        return false;
+    }
+    plan_step_t &step = _plan[_nodeStep[node]];
+
+    /* a fade still running jumps to its target first */
+    if (step.next)
+    {
+        *step.biquad = *step.next;
+        step.next = nullptr;
+        step.fade = 0;
+    }
+
+    if (!fade)
+    {
+        step.biquad->setCoefficients(c);
+        return true;
+    }
+
+    /* the target starts from the current history */
+    IIR *next = &_fadeBiquads[step.biquad - _biquads];
+    *next = *step.biquad;
+    next->setCoefficients(c);
+    step.next = next;
+    step.fade = GRAPH_FADE_BLOCKS;
+    return true;
+}
+
+bool __not_in_flash_func(Graph::setGain)(uint8_t node, int32_t gain, bool fade)
+{
+    if (node >= GRAPH_MAX_NODES || _nodeStep[node] < 0 || _plan[_nodeStep[node]].kernel != kernel_gain)
+    {
+        return false;
+    }
+    plan_step_t &step = _plan[_nodeStep[node]];
+    if (step.fade)
+    {
+        step.gain[0] = step.nextGain;
+    }
+    step.nextGain = gain;
+    step.fade = fade ? GRAPH_FADE_BLOCKS : 0;
+    if (!fade)
+    {
+        step.gain[0] = gain;
+    }
+    return true;
+}
+
+bool __not_in_flash_func(Graph::setDelay)(uint8_t node, uint32_t samples)
+{
+    if (node >= GRAPH_MAX_NODES || _nodeStep[node] < 0 || !_plan[_nodeStep[node]].delay)
+    {
+        return false;
+    }
+    _plan[_nodeStep[node]].delay->setDelay(samples);
+    return true;
+}
+
+void __not_in_flash_func(Graph::setSkipOptional)(bool skip)
+{
+    _skipOptional = skip;
+}
+
+void __not_in_flash_func(Graph::setEconomy)(bool enable)
+{
+    for (size_t i = 0; i < _biquadCount; i++)
+    {
+        _biquads[i].setEconomy(enable);
+        _fadeBiquads[i].setEconomy(enable);
+    }
+}
+
+void __not_in_flash_func(Graph::clear)()
+{
+    for (size_t i = 0; i < _biquadCount; i++)
+    {
+        _biquads[i].clear();
+        _fadeBiquads[i].clear();
+    }
+    for (size_t i = 0; i < _delayCount; i++)
+    {
+        _delays[i].clear();
+    }
+    for (size_t i = 0; i < _subbandCount; i++)
+    {
+        _subbands[i].reset();
+    }
+}
+
+bool Graph::getBiquad(uint8_t node, biquad_coeffs_t *c) const
+{
+    if (node >= GRAPH_MAX_NODES || _nodeStep[node] < 0 || !_plan[_nodeStep[node]].biquad)
+    {
+        return false;
+    }
+    const plan_step_t &step = _plan[_nodeStep[node]];
+    *c = (step.next ? step.next : step.biquad)->getCoefficients();
+    return true;
+}
+
+bool Graph::getGain(uint8_t node, int32_t *gain) const
+{
+    if (node >= GRAPH_MAX_NODES || _nodeStep[node] < 0 || _plan[_nodeStep[node]].kernel != kernel_gain)
+    {
+        return false;
+    }
+    const plan_step_t &step = _plan[_nodeStep[node]];
+    *gain = step.fade ? step.nextGain : step.gain[0];
+    return true;
+}
+
+bool Graph::getDelay(uint8_t node, uint32_t *samples) const
+{
+    if (node >= GRAPH_MAX_NODES || _nodeStep[node] < 0 || !_plan[_nodeStep[node]].delay)
+    {
+        return false;
+    }
+    *samples = _plan[_nodeStep[node]].delay->getDelay();
+    return true;
+}
+
+const char *Graph::error() const
+{
+    return _error;
+}
+
+uint8_t Graph::decimation(uint8_t node) const
+{
+    return node < GRAPH_MAX_NODES ? _nodeStride[node] : 1;
+}
+
+size_t Graph::steps() const
+{
+    return _steps;
+}
+
+uint32_t Graph::estimateCycles() const
+{
+    return _cycles;
+}
+
+size_t Graph::delayWords() const
+{
+    return _arena.used();
+}
@@ -0,0 +1,198 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "iir.h"
+#include "delay.h"
+#include "subband.h"
+
+/*
+    Declarative processing graph.
+    The topology is described as a list of nodes, each naming the
+    nodes it reads from (edges). compile() turns the list into a flat
+    plan of kernel calls over pre-assigned scratch buffers, so the
+    audio loop runs without dispatch through objects or allocation.
+    Nodes must be listed after all of their sources.
+    Between a split and its merge, nodes run on the low band at
+    1/SUBBAND_FACTOR of the rate (see subband.h), only biquads, gains
+    and mixes are allowed there.
+*/
+
+/* frames per processing block, one ring buffer block of stereo 32 bit words */
+#define GRAPH_BLOCK_SIZE (32)
+
+#define GRAPH_MAX_NODES (32)
+#define GRAPH_MAX_FANIN (4)
+#define GRAPH_MAX_CHANNELS (2)
+#define GRAPH_MAX_BUFFERS (8)
+#define GRAPH_MAX_BIQUADS (16)
+#define GRAPH_MAX_DELAYS (8)
+#define GRAPH_MAX_SUBBANDS (2)
+
+static_assert(GRAPH_BLOCK_SIZE % SUBBAND_FACTOR == 0 && GRAPH_BLOCK_SIZE <= SUBBAND_MAX_BLOCK,
+              "blocks must split into whole low band blocks");
+
+/* blocks over which a faded biquad or gain change crossfades, 2.7ms at 48kHz */
+#define GRAPH_FADE_BLOCKS (4)
+#define GRAPH_FADE_SAMPLES (GRAPH_FADE_BLOCKS * GRAPH_BLOCK_SIZE)
+
+/* Q16 linear gain, shared with the control protocol */
+#define GAIN_UNITY ((int32_t)1 << 16)
+
+/* graph level full scale is 2^23, gains and mixes saturate here so the
+    DAC word (sample << 7) never wraps */
+#define GRAPH_LIMIT (((int32_t)1 << 24) - 1)
+
+/* rough M0+ cycles per sample of each kernel, for the plan estimate */
+#define CYCLES_BIQUAD (275)
+#define CYCLES_GAIN (20)
+#define CYCLES_MIX_INPUT (24)
+#define CYCLES_DELAY (16)
+#define CYCLES_COPY (4)
+#define CYCLES_SPLIT (100)
+#define CYCLES_MERGE (50)
+/* per kernel call */
+#define CYCLES_STEP (40)
+
+typedef enum
+{
+    node_input,
+    node_output,
+    node_biquad,
+    node_gain,
+    node_mix,
+    node_delay,
+    node_split,  // full rate to low band
+    node_merge   // low band back to full rate
+} node_type_t;
+
+typedef struct
+{
+    node_type_t type;
+    uint8_t sources;
+    uint8_t source[GRAPH_MAX_FANIN];
+    bool optional;                      // may be skipped under load, biquad and gain only
+    bool quantized;                     // biquad given as coeffs, not as a design
+    union
+    {
+        uint8_t channel;                // input, output
+        biquad_design_t biquad;         // biquad
+        biquad_coeffs_t coeffs;         // biquad, already quantized
+        float gain[GRAPH_MAX_FANIN];    // gain, mix (dB per source)
+        struct
+        {
+            uint32_t samples;
+            uint32_t max;               // largest delay settable at run time
+        } delay;                        // delay
+        uint8_t split;                  // merge, the split it closes
+    };
+} graph_node_t;
+
+/* node constructors, keep graph descriptions readable */
+graph_node_t graph_input(uint8_t channel);
+graph_node_t graph_output(uint8_t source, uint8_t channel);
+graph_node_t graph_biquad(uint8_t source, biquad_design_t design);
+/* from stored coefficients, compile() then skips the soft-float quantization */
+graph_node_t graph_biquad(uint8_t source, const biquad_coeffs_t &coeffs);
+graph_node_t graph_gain(uint8_t source, float dB);
+graph_node_t graph_mix(uint8_t sourceA, float dBA, uint8_t sourceB, float dBB);
+/* up to GRAPH_MAX_FANIN sources, mix gains are fixed once compiled */
+graph_node_t graph_mix(const uint8_t *sources, const float *dB, uint8_t count);
+graph_node_t graph_delay(uint8_t source, uint32_t samples, uint32_t maxSamples = 0);
+/* low band processing, biquads in between are designed at Fs / SUBBAND_FACTOR */
+graph_node_t graph_split(uint8_t source);
+graph_node_t graph_merge(uint8_t source, uint8_t split);
+/* marks a node the load governor may skip, it then passes its input through */
+graph_node_t graph_optional(graph_node_t node);
+
+typedef struct plan_step
+{
+    void (*kernel)(struct plan_step &step);
+    const int32_t *in[GRAPH_MAX_FANIN];
+    int32_t *out;
+    size_t length;   // samples per block, fewer on the low band
+    uint8_t stride;  // full rate samples per sample
+    uint8_t inputs;
+    bool optional;
+    int32_t gain[GRAPH_MAX_FANIN];
+    IIR *biquad;
+    DelayLine *delay;
+    Subband *subband;
+    /* faded change in progress: the target biquad or gain, blocks left */
+    IIR *next;
+    int32_t nextGain;
+    uint8_t fade;
+} plan_step_t;
+
+class Graph {
+public:
+    Graph();
+
+    /* returns false if the description does not fit the static limits,
+        error() then names the reason */
+    bool compile(const graph_node_t *nodes, size_t count);
+    const char *error() const;
+
+    /* one block, inputs filled by the caller beforehand */
+    void process();
+
+    int32_t *input(int channel);
+    const int32_t *output(int channel);
+
+    /* runtime updates, at block boundaries only
+        with fade the old setting crossfades into the new one over
+        GRAPH_FADE_BLOCKS, delays always crossfade */
+    bool setBiquad(uint8_t node, const biquad_coeffs_t &c, bool fade = false);
+    bool setGain(uint8_t node, int32_t gain, bool fade = false);
+    bool setDelay(uint8_t node, uint32_t samples);
+
+    /* current settings, false if the node has no such parameter */
+    bool getBiquad(uint8_t node, biquad_coeffs_t *c) const;
+    bool getGain(uint8_t node, int32_t *gain) const;
+    bool getDelay(uint8_t node, uint32_t *samples) const;
+
+    /* load shedding, at block boundaries only:
+        skip the optional steps, run the biquads in their economy variant */
+    void setSkipOptional(bool skip);
+    void setEconomy(bool enable);
+
+    /* silences every filter, delay and subband history, at block boundaries only */
+    void clear();
+
+    /* 1 at the full rate, SUBBAND_FACTOR on the low band */
+    uint8_t decimation(uint8_t node) const;
+
+    size_t steps() const;
+    uint32_t estimateCycles() const;
+    size_t delayWords() const;
+
+private:
+    plan_step_t _plan[GRAPH_MAX_NODES];
+    size_t _steps;
+    uint32_t _cycles;
+    const char *_error;
+    bool _skipOptional;
+
+    /* node -> plan step, -1 for nodes without a step */
+    int8_t _nodeStep[GRAPH_MAX_NODES];
+    uint8_t _nodeStride[GRAPH_MAX_NODES];
+
+    int32_t _input[GRAPH_MAX_CHANNELS][GRAPH_BLOCK_SIZE];
+    int32_t _output[GRAPH_MAX_CHANNELS][GRAPH_BLOCK_SIZE];
+    int32_t _scratch[GRAPH_MAX_BUFFERS][GRAPH_BLOCK_SIZE];
+
+    IIR _biquads[GRAPH_MAX_BIQUADS];
+    IIR _fadeBiquads[GRAPH_MAX_BIQUADS]; // same index, targets of running fades
+    size_t _biquadCount;
+
+    DelayLine _delays[GRAPH_MAX_DELAYS];
+    size_t _delayCount;
+
+    Subband _subbands[GRAPH_MAX_SUBBANDS];
+    size_t _subbandCount;
+    DelayArena _arena;
+};
+
+#endif
@@ -1,27 +1,66 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
 #include "iir.h"
+#include "packed16.h"
 
-void IIR::filter(int32_t *s)
+/*
+    accumulator >> shift for shifts of 1..31 and results that fit
+    32 bits, a variable 64 bit shift would be a library call on the M0+
+*/
+static __force_inline int32_t shiftDown(int64_t accumulator, uint8_t shift)
 {
-    /*
-        The state_error is the truncated part of the accumulator.
-        This acts as an error, which is fed back (without filter)
-        resulting in a rudimentary noise shaping feedback loop.
-        One could potentially add an LSB's worth of TPDF dither ontop.
-    */
-    int64_t accumulator = (int64_t)state_error;
+    uint32_t lo = (uint32_t)accumulator;
+    uint32_t hi = (uint32_t)(accumulator >> 32);
+    return (int32_t)((lo >> shift) | (hi << (32 - shift)));
+}
 
-    /* populate the accumulator, the explicit casts are required */
-    accumulator += (int64_t)b[0] * (int64_t)(*s);
-    accumulator += (int64_t)b[1] * (int64_t)x[0];
-    accumulator += (int64_t)b[2] * (int64_t)x[1];
-    accumulator += (int64_t)a[0] * (int64_t)y[0];
-    accumulator += (int64_t)a[1] * (int64_t)y[1];
+void __not_in_flash_func(IIR::filter)(int32_t *s)
+{
+    /* unused slot, pass through at no cost */
+    if (type == none)
+    {
+        return;
+    }
+
+    int32_t out;
+
+    if (economy)
+    {
+        /* 16 bit samples and coefficients of economyShift, 32 bit sum */
+        int32_t accumulator = state_error;
+        accumulator += economyB[0] * ((*s) >> IIR_ECONOMY_DROP);
+        accumulator += economyB[1] * (x[0] >> IIR_ECONOMY_DROP);
+        accumulator += economyB[2] * (x[1] >> IIR_ECONOMY_DROP);
+        accumulator += economyA[0] * (y[0] >> IIR_ECONOMY_DROP);
+        accumulator += economyA[1] * (y[1] >> IIR_ECONOMY_DROP);
+
+        state_error = accumulator & (((int32_t)1 << economyShift) - 1);
+        out = (accumulator >> economyShift) * (1 << IIR_ECONOMY_DROP);
+    }
+    else
+    {
+        /*
+            The state_error is the truncated part of the accumulator.
+            This acts as an error, which is fed back (without filter)
+            resulting in a rudimentary noise shaping feedback loop.
+            One could potentially add an LSB's worth of TPDF dither ontop.
+        */
+        int64_t accumulator = (int64_t)state_error;
 
-    // accumulator = CLAMP(accumulator, ACC_MAX, ACC_MIN);
+        /* populate the accumulator, the explicit casts are required */
+        accumulator += (int64_t)b[0] * (int64_t)(*s);
+        accumulator += (int64_t)b[1] * (int64_t)x[0];
+        accumulator += (int64_t)b[2] * (int64_t)x[1];
+        accumulator += (int64_t)a[0] * (int64_t)y[0];
+        accumulator += (int64_t)a[1] * (int64_t)y[1];
 
-    /* truncate the result */
-    state_error = accumulator & ACC_REM;
-    int32_t out = (int32_t)(accumulator >> (int64_t)(q));
+        // accumulator = CLAMP(accumulator, ACC_MAX, ACC_MIN);
+
+        /* truncate the result */
+        state_error = (int32_t)accumulator & (((int32_t)1 << shift) - 1);
+        out = shiftDown(accumulator, shift);
+    }
 
     /* shift the delay lines */
     x[1] = x[0];
@@ -34,13 +73,92 @@ void IIR::filter(int32_t *s)
     *s = out;
 }
 
+void __not_in_flash_func(IIR::filterBlock)(const int32_t *in, int32_t *out, size_t n)
+{
+    if (type == none)
+    {
+        if (in != out)
+        {
+            memcpy(out, in, n * sizeof(int32_t));
+        }
+        return;
+    }
+
+    /*
+        identical arithmetic to filter(), but the delay lines and
+        the error feedback stay in registers for the whole block
+        in and out may point to the same buffer
+    */
+    int32_t x0 = x[0], x1 = x[1];
+    int32_t y0 = y[0], y1 = y[1];
+    int32_t error = state_error;
+    const uint8_t sh = economy ? economyShift : shift;
+    const int32_t mask = ((int32_t)1 << sh) - 1;
+
+    if (economy)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            int32_t s = in[i];
+
+            int32_t accumulator = error;
+            accumulator += economyB[0] * (s >> IIR_ECONOMY_DROP);
+            accumulator += economyB[1] * (x0 >> IIR_ECONOMY_DROP);
+            accumulator += economyB[2] * (x1 >> IIR_ECONOMY_DROP);
+            accumulator += economyA[0] * (y0 >> IIR_ECONOMY_DROP);
+            accumulator += economyA[1] * (y1 >> IIR_ECONOMY_DROP);
+
+            error = accumulator & mask;
+            int32_t o = (accumulator >> sh) * (1 << IIR_ECONOMY_DROP);
+
+            x1 = x0;
+            x0 = s;
+            y1 = y0;
+            y0 = o;
+
+            out[i] = o;
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            int32_t s = in[i];
+
+            int64_t accumulator = (int64_t)error;
+            accumulator += (int64_t)b[0] * (int64_t)s;
+            accumulator += (int64_t)b[1] * (int64_t)x0;
+            accumulator += (int64_t)b[2] * (int64_t)x1;
+            accumulator += (int64_t)a[0] * (int64_t)y0;
+            accumulator += (int64_t)a[1] * (int64_t)y1;
+
+            error = (int32_t)accumulator & mask;
+            int32_t o = shiftDown(accumulator, sh);
+
+            x1 = x0;
+            x0 = s;
+            y1 = y0;
+            y0 = o;
+
+            out[i] = o;
+        }
+    }
+
+    x[0] = x0;
+    x[1] = x1;
+    y[0] = y0;
+    y[1] = y1;
+    state_error = error;
+}
+
 // https://www.earlevel.com/main/2011/01/02/biquad-formulas/
-IIR::IIR(filter_type_t type, float Fc, float Q, float peakGain, float Fs)
+biquad_design_t biquad_design(filter_type_t type, float Fc, float Q, float peakGain, float Fs)
 {
     /*
         calculate the iir filter coefficients based on more intuitively
         understandable parameters
-        the coefficients get scaled by the selected scaling factor
+        the coefficients are returned unscaled, quantization is left
+        to the filter implementation
     */
 
     float a0 = 0, a1 = 0, a2 = 0, b1 = 0, b2 = 0, norm = 0;
@@ -157,14 +275,318 @@ IIR::IIR(filter_type_t type, float Fc, float Q, float peakGain, float Fs)
         break;
     }
 
-    type = type;
+    biquad_design_t d = {type, a0, a1, a2, b1, b2};
+    return d;
+}
+
+/*
+    sum of the absolute impulse response, bounds |y| / |x| for any input
+    The response is run until the free response left in its state is
+    bounded below 0.1% of the sum so far, from the poles p1, p2: with
+    u the last output and w the next one, y[k] = c1 p1^k + c2 p2^k and
+    the rest sums to at most |c1| / (1 - |p1|) + |c2| / (1 - |p2|).
+    For poles too close for the c to be of use, the rest is at most
+    (|y1| + |b2 y2|) / (1 - r)^2 with r the larger radius.
+    Infinite if the filter is unstable or decays too slowly to tell.
+*/
+static float worstCaseGain(const biquad_design_t &d)
+{
+    /* poles of z^2 + b1 z + b2, re +- j im when complex, re +- im when real */
+    double disc = (double)d.b1 * d.b1 - 4.0 * d.b2;
+    bool oscillating = disc < 0;
+    double re = -d.b1 / 2.0;
+    double im = sqrt(fabs(disc)) / 2;
+    double r = oscillating ? sqrt((double)d.b2) : fabs(re) + im;
+    if (!(r < 1))
+    {
+        return INFINITY;
+    }
+
+    /* in double, the feed-forward terms of a low shelf cancel to a few
+        LSB of a float and its response would be off by percent */
+    double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    double gain = 0;
+
+    for (int n = 0; n < IIR_GAIN_SAMPLES; n++)
+    {
+        double x0 = n == 0 ? 1.0 : 0.0;
+        double y0 = d.a0 * x0 + d.a1 * x1 + d.a2 * x2 - d.b1 * y1 - d.b2 * y2;
+        gain += fabs(y0);
+
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = y0;
 
-    b[0] = (int32_t)(a0 * scaleQ);
-    b[1] = (int32_t)(a1 * scaleQ);
-    b[2] = (int32_t)(a2 * scaleQ);
+        /* the input is gone from n = 3 on, check every 16 samples */
+        if (n < 3 || (n & 15))
+        {
+            continue;
+        }
+        double w = -d.b1 * y1 - d.b2 * y2;
+        double tail = (fabs(y1) + fabs(d.b2 * y2)) / ((1 - r) * (1 - r));
+        if (im > 0 && oscillating)
+        {
+            /* c1 = conj(c2) = u / 2 - j (w - re u) / (2 im) */
+            double q = (w - re * y1) / im;
+            tail = fmin(tail, sqrt(y1 * y1 + q * q) * r / (1 - r));
+        }
+        else if (im > 0)
+        {
+            double p1 = re + im, p2 = re - im;
+            double c1 = (w - p2 * y1) / (2 * im), c2 = (p1 * y1 - w) / (2 * im);
+            tail = fmin(tail, fabs(c1 * p1) / (1 - fabs(p1)) + fabs(c2 * p2) / (1 - fabs(p2)));
+        }
+        if (tail <= gain * 1e-3)
+        {
+            return (float)(gain + tail);
+        }
+    }
+    return INFINITY;
+}
+
+/*
+    largest Q up to maxQ at which every coefficient fits 32 bits and
+    accBound (the worst-case accumulator sum for unit coefficients)
+    stays inside an accumulator of accBits
+*/
+static uint8_t fitShift(const biquad_design_t &d, float accBound, int accBits, int maxQ)
+{
+    float coeffMax = fmaxf(fmaxf(fabsf(d.a0), fabsf(d.a1)), fmaxf(fmaxf(fabsf(d.a2), fabsf(d.b1)), fabsf(d.b2)));
+
+    int shift = maxQ;
+    while (shift > 1 &&
+           (ldexpf(coeffMax, shift) >= ldexpf(1.0f, 31) ||
+            ldexpf(accBound, shift) >= ldexpf(1.0f, accBits - 1)))
+    {
+        shift--;
+    }
+    return (uint8_t)shift;
+}
+
+static float feedForwardSum(const biquad_design_t &d)
+{
+    return fabsf(d.a0) + fabsf(d.a1) + fabsf(d.a2);
+}
+
+static float feedbackSum(const biquad_design_t &d)
+{
+    return fabsf(d.b1) + fabsf(d.b2);
+}
+
+/* |H| at w radians per sample, in double as low poles cancel in the denominator */
+static double magnitude(const biquad_design_t &d, double w)
+{
+    double c1 = cos(w), s1 = sin(w), c2 = cos(2 * w), s2 = sin(2 * w);
+    double nr = d.a0 + d.a1 * c1 + d.a2 * c2, ni = d.a1 * s1 + d.a2 * s2;
+    double dr = 1 + d.b1 * c1 + d.b2 * c2, di = d.b1 * s1 + d.b2 * s2;
+    return sqrt((nr * nr + ni * ni) / (dr * dr + di * di));
+}
+
+/* difference in dB, anything below -40dB counts as -40dB (the bottom of a notch) */
+static double deviation(const biquad_design_t &a, const biquad_design_t &b, double w)
+{
+    return fabs(20 * log10((magnitude(a, w) + 1e-2) / (magnitude(b, w) + 1e-2)));
+}
+
+/* largest deviation across the resonance of 1 + c1 z^-1 + c2 z^-2, if it has one */
+static double resonanceDeviation(const biquad_design_t &a, const biquad_design_t &b, double c1, double c2)
+{
+    if (c1 * c1 - 4 * c2 >= 0 || c2 <= 0)
+    {
+        return 0;
+    }
+    double r = sqrt(c2);
+    double theta = acos(fmin(1.0, fmax(-1.0, -c1 / (2 * r))));
+    double width = fmax(fabs(1 - r), 1e-6);
+    double worst = 0;
+    for (int k = -8; k <= 8; k++)
+    {
+        double w = theta + k * width / 4;
+        if (w > 0 && w <= M_PI)
+        {
+            worst = fmax(worst, deviation(a, b, w));
+        }
+    }
+    return worst;
+}
+
+/*
+    largest difference of two responses in dB, at 24 frequencies per
+    decade from Nyquist down to 1e-4 of it (2.4Hz at 48kHz) and across
+    the poles and zeros of both, where a notch or peak is narrower
+    than the grid
+*/
+static float responseDeviation(const biquad_design_t &a, const biquad_design_t &b)
+{
+    double worst = 0;
+    for (int i = 0; i <= 96; i++)
+    {
+        worst = fmax(worst, deviation(a, b, M_PI * pow(10.0, -i / 24.0)));
+    }
+    const biquad_design_t *d[2] = {&a, &b};
+    for (int k = 0; k < 2; k++)
+    {
+        worst = fmax(worst, resonanceDeviation(a, b, d[k]->b1, d[k]->b2));
+        if (d[k]->a0 != 0)
+        {
+            worst = fmax(worst, resonanceDeviation(a, b, d[k]->a1 / d[k]->a0, d[k]->a2 / d[k]->a0));
+        }
+    }
+    return (float)worst;
+}
+
+/* the economy coefficients at Q economyShift, rounded as setCoefficients() does */
+static biquad_design_t economyDesign(const biquad_coeffs_t &c, int economyShift)
+{
+    int d = c.shift - economyShift;
+    int32_t half = d ? (int32_t)1 << (d - 1) : 0;
+    biquad_design_t e;
+    e.type = c.type;
+    e.a0 = ldexpf((float)((c.b[0] + half) >> d), -economyShift);
+    e.a1 = ldexpf((float)((c.b[1] + half) >> d), -economyShift);
+    e.a2 = ldexpf((float)((c.b[2] + half) >> d), -economyShift);
+    e.b1 = -ldexpf((float)((c.a[0] + half) >> d), -economyShift);
+    e.b2 = -ldexpf((float)((c.a[1] + half) >> d), -economyShift);
+    return e;
+}
+
+biquad_coeffs_t IIR::quantize(const biquad_design_t &d)
+{
+    biquad_coeffs_t c;
+    c.type = d.type;
+
+    /* every input and (through the worst-case gain) every output
+        sample at full scale, plus the fed back error */
+    float gain = worstCaseGain(d);
+    float sum = feedForwardSum(d) + feedbackSum(d) * gain;
+    float accBound = sum * ldexpf(1.0f, IIR_SAMPLE_BITS - 1) + 1.0f;
+    c.shift = fitShift(d, accBound, 64, IIR_MAX_Q);
+
+    /* no usable bound (slow decay, or a gain the 64 bit sum cannot hold
+        at IIR_MIN_Q): the coefficients alone set the Q, as for a fixed Q30 */
+    if (c.shift < IIR_MIN_Q)
+    {
+        c.shift = fitShift(d, 0.0f, 64, IIR_MAX_Q);
+    }
 
-    a[0] = (int32_t)(-b1 * scaleQ);
-    a[1] = (int32_t)(-b2 * scaleQ);
+    /* the coefficients get scaled by the selected scaling factor */
+    c.b[0] = (int32_t)ldexpf(d.a0, c.shift);
+    c.b[1] = (int32_t)ldexpf(d.a1, c.shift);
+    c.b[2] = (int32_t)ldexpf(d.a2, c.shift);
+
+    c.a[0] = (int32_t)ldexpf(-d.b1, c.shift);
+    c.a[1] = (int32_t)ldexpf(-d.b2, c.shift);
+
+    /* the same bound at 16 bits gives the economy variant, checked
+        again with the gain of its own rounded coefficients, which for
+        low poles can be far above the design's, and only kept if its
+        response stays within IIR_ECONOMY_MAX_DB of the design */
+    c.economyShift = 0;
+    if (d.type != none)
+    {
+        float economyBound = sum * ldexpf(1.0f, IIR16_SAMPLE_BITS - 1) + 1.0f;
+        for (int q = fitShift(d, economyBound, 32, IIR16_MAX_Q); q >= IIR_ECONOMY_MIN_Q; q--)
+        {
+            biquad_design_t e = economyDesign(c, q);
+            float economySum = feedForwardSum(e) + feedbackSum(e) * worstCaseGain(e);
+            if (ldexpf(economySum * ldexpf(1.0f, IIR16_SAMPLE_BITS - 1) + 1.0f, q) < ldexpf(1.0f, 31) &&
+                responseDeviation(d, e) <= IIR_ECONOMY_MAX_DB)
+            {
+                c.economyShift = (uint8_t)q;
+                break;
+            }
+        }
+    }
+
+    return c;
+}
+
+void __not_in_flash_func(IIR::setCoefficients)(const biquad_coeffs_t &c)
+{
+    /* the delay lines are kept, DF1 tolerates coefficient changes */
+    b[0] = c.b[0];
+    b[1] = c.b[1];
+    b[2] = c.b[2];
+
+    a[0] = c.a[0];
+    a[1] = c.a[1];
+
+    /* the fed back error is only meaningful in the old format */
+    if (c.shift != shift || c.economyShift != economyShift)
+    {
+        state_error = 0;
+    }
+    shift = c.shift;
+
+    /* economy coefficients are the full ones, rounded to economyShift */
+    economyShift = c.economyShift;
+    if (economyShift)
+    {
+        int d = shift - economyShift;
+        int32_t half = d ? (int32_t)1 << (d - 1) : 0;
+        for (int k = 0; k < 3; k++)
+        {
+            economyB[k] = (b[k] + half) >> d;
+        }
+        for (int k = 0; k < 2; k++)
+        {
+            economyA[k] = (a[k] + half) >> d;
+        }
+    }
+    economy = economy && economyShift;
+
+    type = c.type;
+}
+
+void __not_in_flash_func(IIR::setEconomy)(bool enable)
+{
+    enable = enable && economyShift;
+    if (enable != economy)
+    {
+        state_error = 0;
+    }
+    economy = enable;
+}
+
+void __not_in_flash_func(IIR::clear)()
+{
+    x[0] = 0;
+    x[1] = 0;
+    y[0] = 0;
+    y[1] = 0;
+    state_error = 0;
+}
+
+biquad_coeffs_t IIR::getCoefficients() const
+{
+    biquad_coeffs_t c = {};
+    c.type = type;
+    c.b[0] = b[0];
+    c.b[1] = b[1];
+    c.b[2] = b[2];
+    c.a[0] = a[0];
+    c.a[1] = a[1];
+    c.shift = shift;
+    c.economyShift = economyShift;
+    return c;
+}
+
+uint8_t IIR::getShift() const
+{
+    return shift;
+}
+
+IIR::IIR() : IIR(none, 0, 0, 0, 1)
+{
+}
+
+IIR::IIR(filter_type_t type, float Fc, float Q, float peakGain, float Fs)
+{
+    shift = 0;
+    economyShift = 0;
+    economy = false;
+    setCoefficients(quantize(biquad_design(type, Fc, Q, peakGain, Fs)));
 
     x[0] = 0;
     x[1] = 0;
@@ -174,3 +596,143 @@ IIR::IIR(filter_type_t type, float Fc, float Q, float peakGain, float Fs)
 
     state_error = 0;
 }
+
+void __not_in_flash_func(StereoIIR16::filter)(uint32_t *frame)
+{
+    /* same structure and noise shaping as IIR::filter, once per half-word */
+    int32_t accL = state_error[0];
+    int32_t accR = state_error[1];
+    int32_t fineL = fine_error[0];
+    int32_t fineR = fine_error[1];
+
+    int32_t inL = unpackLeft16(*frame), x0L = unpackLeft16(x[0]), x1L = unpackLeft16(x[1]);
+    int32_t y0L = unpackLeft16(y[0]), y1L = unpackLeft16(y[1]);
+    int32_t inR = unpackRight16(*frame), x0R = unpackRight16(x[0]), x1R = unpackRight16(x[1]);
+    int32_t y0R = unpackRight16(y[0]), y1R = unpackRight16(y[1]);
+
+    accL += b[0][0] * inL;
+    accL += b[0][1] * x0L;
+    accL += b[0][2] * x1L;
+    accL += a[0][0] * y0L;
+    accL += a[0][1] * y1L;
+
+    fineL += bFine[0][0] * inL;
+    fineL += bFine[0][1] * x0L;
+    fineL += bFine[0][2] * x1L;
+    fineL += aFine[0][0] * y0L;
+    fineL += aFine[0][1] * y1L;
+
+    accR += b[1][0] * inR;
+    accR += b[1][1] * x0R;
+    accR += b[1][2] * x1R;
+    accR += a[1][0] * y0R;
+    accR += a[1][1] * y1R;
+
+    fineR += bFine[1][0] * inR;
+    fineR += bFine[1][1] * x0R;
+    fineR += bFine[1][2] * x1R;
+    fineR += aFine[1][0] * y0R;
+    fineR += aFine[1][1] * y1R;
+
+    /* the fine sums carry the coefficient bits below the output Q */
+    accL += fineL >> IIR16_FINE_BITS;
+    accR += fineR >> IIR16_FINE_BITS;
+    fine_error[0] = fineL & ((1 << IIR16_FINE_BITS) - 1);
+    fine_error[1] = fineR & ((1 << IIR16_FINE_BITS) - 1);
+
+    state_error[0] = accL & (((int32_t)1 << shift[0]) - 1);
+    state_error[1] = accR & (((int32_t)1 << shift[1]) - 1);
+
+    uint32_t out = pack16(saturate16(accL >> shift[0]), saturate16(accR >> shift[1]));
+
+    /* one word moves both channels */
+    x[1] = x[0];
+    y[1] = y[0];
+
+    x[0] = *frame;
+    y[0] = out;
+
+    *frame = out;
+}
+
+biquad_coeffs_t StereoIIR16::quantize(const biquad_design_t &d)
+{
+    biquad_coeffs_t c;
+    c.type = d.type;
+
+    /* the output saturates, so the fed back samples never exceed full scale */
+    float full = ldexpf(1.0f, IIR16_SAMPLE_BITS - 1);
+    float accBound = (feedForwardSum(d) + feedbackSum(d)) * full + 1.0f;
+    c.shift = fitShift(d, accBound, 32, IIR16_MAX_Q);
+    /* splitting off the fine bits floors each coarse coefficient,
+        which adds up to one full scale sample per tap */
+    while (c.shift > 1 && ldexpf(accBound, c.shift) + 5 * full >= ldexpf(1.0f, 31))
+    {
+        c.shift--;
+    }
+    c.economyShift = 0;
+
+    /* round, at Q14 the feed-forward part of a low crossover
+        is only a handful of LSBs and truncation skews the gain */
+    int q = c.shift + IIR16_FINE_BITS;
+    c.b[0] = (int32_t)lroundf(ldexpf(d.a0, q));
+    c.b[1] = (int32_t)lroundf(ldexpf(d.a1, q));
+    c.b[2] = (int32_t)lroundf(ldexpf(d.a2, q));
+
+    c.a[0] = (int32_t)lroundf(ldexpf(-d.b1, q));
+    c.a[1] = (int32_t)lroundf(ldexpf(-d.b2, q));
+
+    return c;
+}
+
+void __not_in_flash_func(StereoIIR16::setCoefficients)(int channel, const biquad_coeffs_t &c)
+{
+    /* coarse part at the output Q, the remaining bits as a positive fraction */
+    const int32_t mask = (1 << IIR16_FINE_BITS) - 1;
+    for (int k = 0; k < 3; k++)
+    {
+        b[channel][k] = c.b[k] >> IIR16_FINE_BITS;
+        bFine[channel][k] = c.b[k] & mask;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        a[channel][k] = c.a[k] >> IIR16_FINE_BITS;
+        aFine[channel][k] = c.a[k] & mask;
+    }
+
+    if (c.shift != shift[channel])
+    {
+        state_error[channel] = 0;
+        fine_error[channel] = 0;
+    }
+    shift[channel] = c.shift;
+}
+
+void __not_in_flash_func(StereoIIR16::clear)()
+{
+    x[0] = 0;
+    x[1] = 0;
+    y[0] = 0;
+    y[1] = 0;
+    state_error[0] = 0;
+    state_error[1] = 0;
+}
+
+StereoIIR16::StereoIIR16(biquad_design_t left, biquad_design_t right)
+{
+    shift[0] = 0;
+    shift[1] = 0;
+    setCoefficients(0, quantize(left));
+    setCoefficients(1, quantize(right));
+
+    state_error[0] = 0;
+    state_error[1] = 0;
+    fine_error[0] = 0;
+    fine_error[1] = 0;
+
+    x[0] = 0;
+    x[1] = 0;
+
+    y[0] = 0;
+    y[1] = 0;
+}
@@ -3,16 +3,47 @@
 #pragma once
 
 #include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #define CLAMP(x, a, b) (x > a ? a : (x < b ? b : x))
 
-#define q (30)
-#define scaleQ (powf(2.0, q))
-
 #define ACC_MAX ((int64_t)  0x7FFFFFFFFF)
 #define ACC_MIN ((int64_t) -0x8000000000)
-#define ACC_REM ((uint64_t)0x3FFFFFFFU)
+
+/*
+    Coefficient formats are chosen per filter when it is quantized.
+    The coefficient Q is also the output shift, it is the largest
+    that fits the coefficients into 32 bits and the worst-case
+    accumulator sum into the accumulator.
+*/
+#define IIR_MAX_Q (30)
+/* sample width IIR is designed for, graph samples are the I2S word >> 8 */
+#define IIR_SAMPLE_BITS (24)
+/* the 64 bit accumulator holds a gain of 2^19 at this Q, a bound that
+    asks for less is not trusted and the coefficients alone set the Q */
+#define IIR_MIN_Q (20)
+/* impulse response the worst-case gain is looked for in, a 20Hz Q10
+    bandpass at 48kHz takes 56257 samples (in soft double on core0) */
+#define IIR_GAIN_SAMPLES (65536)
+
+/* 16 bit path, the output saturates so only the coefficients bound the sum */
+#define IIR16_MAX_Q (14)
+#define IIR16_SAMPLE_BITS (16)
+/* coefficient bits of the 16 bit path below its output Q, summed apart,
+    Q13 alone cannot place a bass pole at 96kHz (1 + b1 + b2 is below one LSB) */
+#define IIR16_FINE_BITS (10)
+
+/*
+    economy variant of a wide filter, for load shedding: samples are
+    cut to 16 bits around a 32 bit accumulator, the history stays at
+    full width so the filter can switch back and forth while running
+*/
+#define IIR_ECONOMY_DROP (IIR_SAMPLE_BITS - IIR16_SAMPLE_BITS)
+/* with fewer coefficient bits low poles move audibly, no economy then */
+#define IIR_ECONOMY_MIN_Q (12)
+/* largest response error of the economy variant, no economy beyond */
+#define IIR_ECONOMY_MAX_DB (1.0f)
 
 #define BIQUAD_Q_ORDER_2 0.70710678
 #define BIQUAD_Q_ORDER_4_1 0.54119610
@@ -30,6 +61,27 @@ typedef enum
     none
 } filter_type_t;
 
+/* unscaled biquad coefficients, a = feed-forward and b = feedback */
+typedef struct
+{
+    filter_type_t type;
+    float a0, a1, a2;
+    float b1, b2;
+} biquad_design_t;
+
+biquad_design_t biquad_design(filter_type_t type, float Fc, float Q, float peakGain, float Fs);
+
+/* scaled coefficients, ready to be loaded into a running filter,
+    StereoIIR16 coefficients are IIR16_FINE_BITS finer than its output Q */
+typedef struct
+{
+    filter_type_t type;
+    int32_t b[3];
+    int32_t a[2];
+    uint8_t shift;  // coefficient Q and output shift
+    uint8_t economyShift; // Q of the reduced precision variant, 0 for none
+} biquad_coeffs_t;
+
 class IIR {
 private:
     int32_t a[2];
@@ -39,11 +91,60 @@ private:
     int32_t y[2];
     int32_t state_error;
 
+    uint8_t shift;
+
+    int32_t economyA[2];
+    int32_t economyB[3];
+    uint8_t economyShift;
+    bool economy;
+
 public:
     filter_type_t type;
 
     void filter(int32_t *s);
+    void filterBlock(const int32_t *in, int32_t *out, size_t n);
+    void setCoefficients(const biquad_coeffs_t &c);
+    biquad_coeffs_t getCoefficients() const;
+    uint8_t getShift() const;
+    /* switch to the economy variant, if the filter has one */
+    void setEconomy(bool enable);
+    /* drops the history, the filter restarts from silence */
+    void clear();
+    static biquad_coeffs_t quantize(const biquad_design_t &d);
     IIR(filter_type_t type, float Fc, float Q, float peakGain, float Fs);
+    IIR(); // pass-through, coefficients loaded later
+};
+
+/*
+    Q15 biquad operating on a packed 16 bit stereo frame (see packed16.h).
+    Both channels share one call and one history shift, each channel
+    runs its own coefficients so a crossover pair (e.g. lowpass left,
+    highpass right) fits into a single stage.
+    The 32 bit accumulator is sufficient at this width, quantize()
+    lowers the coefficient Q where a filter could otherwise wrap it.
+    Coefficients are quantized IIR16_FINE_BITS below the output Q,
+    their low bits run through a second 32 bit sum.
+*/
+class StereoIIR16 {
+private:
+    int32_t a[2][2];
+    int32_t b[2][3];
+    int32_t aFine[2][2];
+    int32_t bFine[2][3];
+    uint8_t shift[2];
+
+    /* delay lines hold packed frames */
+    uint32_t x[2];
+    uint32_t y[2];
+    int32_t state_error[2];
+    int32_t fine_error[2];
+
+public:
+    void filter(uint32_t *frame);
+    void setCoefficients(int channel, const biquad_coeffs_t &c);
+    void clear();
+    static biquad_coeffs_t quantize(const biquad_design_t &d);
+    StereoIIR16(biquad_design_t left, biquad_design_t right);
 };
 
 #endif
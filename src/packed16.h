@@ -0,0 +1,35 @@
+#ifndef PACKED16_H
+#define PACKED16_H
+#pragma once
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+/*
+    16 bit stereo frames are packed into a single 32 bit word.
+    The I2S PIOs shift MSB first, so the left sample occupies the
+    upper half-word and the right sample the lower half-word.
+*/
+
+static __force_inline uint32_t pack16(int16_t l, int16_t r)
+{
+    return ((uint32_t)(uint16_t)l << 16) | (uint32_t)(uint16_t)r;
+}
+
+static __force_inline int16_t unpackLeft16(uint32_t frame)
+{
+    return (int16_t)(frame >> 16);
+}
+
+static __force_inline int16_t unpackRight16(uint32_t frame)
+{
+    return (int16_t)(frame & 0xFFFF);
+}
+
+static __force_inline int16_t saturate16(int32_t s)
+{
+    return (int16_t)(s > INT16_MAX ? INT16_MAX : (s < INT16_MIN ? INT16_MIN : s));
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "preset.h"
+
+/* whole pages, programmed from a RAM copy */
+#define PRESET_FLASH_BYTES ((sizeof(preset_t) + FLASH_PAGE_SIZE - 1) & ~(FLASH_PAGE_SIZE - 1))
+static_assert(PRESET_FLASH_BYTES <= FLASH_SECTOR_SIZE, "a preset must fit one flash sector");
+
+/* end of the program image, from the SDK linker script */
+extern char __flash_binary_end;
+
+static uint32_t crc32(const uint8_t *data, size_t length)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= data[i];
+        for (int k = 0; k < 8; k++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static uint32_t preset_checksum(const preset_t &p)
+{
+    return crc32((const uint8_t *)&p, offsetof(preset_t, checksum));
+}
+
+void preset_init(preset_t &p, const char *name)
+{
+    memset(&p, 0, sizeof(p));
+    p.magic = PRESET_MAGIC;
+    p.version = PRESET_VERSION;
+    p.size = sizeof(preset_t);
+    strncpy(p.name, name, PRESET_NAME - 1);
+}
+
+bool preset_set(preset_t &p, const dsp_command_t &cmd)
+{
+    if (cmd.type != command_filter && cmd.type != command_gain && cmd.type != command_delay)
+    {
+        return false;
+    }
+
+    size_t i = 0;
+    while (i < p.count && !(p.entry[i].type == cmd.type && p.entry[i].node == cmd.node))
+    {
+        i++;
+    }
+    if (i == PRESET_MAX_ENTRIES)
+    {
+        return false;
+    }
+
+    preset_entry_t &e = p.entry[i];
+    memset(&e, 0, sizeof(e));
+    e.type = cmd.type;
+    e.node = cmd.node;
+    switch (cmd.type)
+    {
+    case command_filter:
+        e.coeffs = cmd.coeffs;
+        break;
+    case command_gain:
+        e.gain = cmd.gain;
+        break;
+    default:
+        e.delay = cmd.delay;
+        break;
+    }
+    if (i == p.count)
+    {
+        p.count++;
+    }
+    return true;
+}
+
+dsp_command_t preset_command(const preset_entry_t &e)
+{
+    dsp_command_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = (command_type_t)e.type;
+    cmd.node = e.node;
+    switch (e.type)
+    {
+    case command_filter:
+        cmd.coeffs = e.coeffs;
+        break;
+    case command_gain:
+        cmd.gain = e.gain;
+        break;
+    case command_delay:
+        cmd.delay = e.delay;
+        break;
+    }
+    return cmd;
+}
+
+bool PresetBank::begin()
+{
+    _usable = (uintptr_t)&__flash_binary_end - XIP_BASE <= PRESET_FLASH_OFFSET;
+    return _usable;
+}
+
+const preset_t *PresetBank::_slot(uint8_t slot) const
+{
+    return (const preset_t *)(uintptr_t)(XIP_BASE + PRESET_FLASH_OFFSET + slot * FLASH_SECTOR_SIZE);
+}
+
+const char *PresetBank::name(uint8_t slot) const
+{
+    if (!_usable || slot >= PRESET_SLOTS)
+    {
+        return nullptr;
+    }
+    const preset_t *p = _slot(slot);
+    if (p->magic != PRESET_MAGIC || p->version != PRESET_VERSION || p->size != sizeof(preset_t) ||
+        p->count > PRESET_MAX_ENTRIES || p->checksum != preset_checksum(*p))
+    {
+        return nullptr;
+    }
+    return p->name;
+}
+
+bool PresetBank::load(uint8_t slot, preset_t *p) const
+{
+    if (!name(slot))
+    {
+        return false;
+    }
+    memcpy(p, _slot(slot), sizeof(preset_t));
+    return true;
+}
+
+bool PresetBank::save(uint8_t slot, preset_t &p)
+{
+    if (!_usable || slot >= PRESET_SLOTS)
+    {
+        return false;
+    }
+
+    static uint8_t page[PRESET_FLASH_BYTES];
+    p.checksum = preset_checksum(p);
+    memset(page, 0xFF, sizeof(page));
+    memcpy(page, &p, sizeof(p));
+
+    /* the erase and program routines run from ROM and RAM, only this
+        core's interrupt handlers could still fetch from flash */
+    uint32_t offset = PRESET_FLASH_OFFSET + slot * FLASH_SECTOR_SIZE;
+    uint32_t interrupts = save_and_disable_interrupts();
+    flash_range_erase(offset, FLASH_SECTOR_SIZE);
+    flash_range_program(offset, page, sizeof(page));
+    restore_interrupts(interrupts);
+
+    /* read back through XIP */
+    return name(slot) && !memcmp(_slot(slot), &p, sizeof(p));
+}
@@ -0,0 +1,83 @@
+#ifndef PRESET_H
+#define PRESET_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "hardware/flash.h"
+#include "iir.h"
+#include "control.h"
+#include "spsc.h"
+
+#define PRESET_SLOTS (4)
+#define PRESET_NAME (16)
+#define PRESET_MAX_ENTRIES (GRAPH_MAX_NODES)
+#define PRESET_MAGIC (0x54455350) // "PSET"
+#define PRESET_VERSION (1)
+
+/* the bank takes the last PRESET_SLOTS sectors of flash, one preset per
+    sector so saving one never erases another */
+#define PRESET_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - PRESET_SLOTS * FLASH_SECTOR_SIZE)
+
+/* one node setting, as it would arrive in a dsp_command_t */
+typedef struct
+{
+    uint8_t type;  // command_filter, command_gain or command_delay
+    uint8_t node;
+    union
+    {
+        biquad_coeffs_t coeffs;  // pre-quantized, loaded without soft-float
+        int32_t gain;            // Q16 linear
+        uint32_t delay;          // samples
+    };
+} preset_entry_t;
+
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;      // sizeof(preset_t), catches layout changes
+    char name[PRESET_NAME];
+    uint32_t count;
+    preset_entry_t entry[PRESET_MAX_ENTRIES];
+    uint32_t checksum;  // CRC-32 of everything before it
+} preset_t;
+
+/* control core -> audio core, applied whole at one block boundary */
+typedef SpscRing<preset_t, 2> PresetQueue;
+
+void preset_init(preset_t &p, const char *name);
+
+/* records a filter, gain or delay command, replacing an earlier
+    setting of the same node; false for other commands or when full */
+bool preset_set(preset_t &p, const dsp_command_t &cmd);
+
+/* the entry as a command, for validation against the topology */
+dsp_command_t preset_command(const preset_entry_t &e);
+
+/*
+    Presets stored in the reserved flash sectors, read and written by
+    the control core only.
+    Writing does not pause the audio core: it runs from RAM only, so
+    its instruction fetches never touch XIP while flash is busy. The
+    control core masks its own interrupts for the erase and program
+    (roughly 50ms per slot).
+*/
+class PresetBank {
+public:
+    /* false if the program itself reaches into the reserved sectors */
+    bool begin();
+
+    /* copies a valid preset out of flash, false for empty or corrupt slots */
+    bool load(uint8_t slot, preset_t *p) const;
+    bool save(uint8_t slot, preset_t &p);
+
+    /* name of a valid preset, nullptr otherwise */
+    const char *name(uint8_t slot) const;
+
+private:
+    const preset_t *_slot(uint8_t slot) const;
+    bool _usable = false;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "requantize.h"
+
+/*
+    error feedback taps in Q12, least squares fits that minimise the noise
+    weighted by the threshold of hearing at 48kHz (linear prediction on
+    the weighting, so the noise transfer function is minimum phase).
+    order:        1      2      3      4      5
+    weighted:  -5.3  -10.6  -13.0  -17.3  -19.3 dB
+    total:     +2.3   +6.1   +9.7  +13.9  +17.6 dB
+*/
+#define SHAPING_Q (12)
+static const int16_t __not_in_flash("requantize") shapingTaps[REQUANTIZE_MAX_ORDER + 1][REQUANTIZE_MAX_ORDER] = {
+    {0, 0, 0, 0, 0},
+    {3435, 0, 0, 0, 0},
+    {6324, -3445, 0, 0, 0},
+    {8574, -7576, 2676, 0, 0},
+    {10685, -13552, 9439, -3230, 0},
+    {12648, -19286, 17672, -9722, 2489}};
+
+Requantizer::Requantizer()
+{
+    _bits = 0;
+    _order = 0;
+    _dither = false;
+    memset(_coeffs, 0, sizeof(_coeffs));
+    memset(_error, 0, sizeof(_error));
+    _rng = 0x2545F491;
+}
+
+bool __not_in_flash_func(Requantizer::configure)(uint8_t bits, uint8_t order, bool dither)
+{
+    if (bits < 1 || bits > 24 || order > REQUANTIZE_MAX_ORDER)
+    {
+        return false;
+    }
+    _bits = bits;
+    _order = order;
+    _dither = dither;
+    for (int k = 0; k < REQUANTIZE_MAX_ORDER; k++)
+    {
+        _coeffs[k] = shapingTaps[order][k];
+    }
+    memset(_error, 0, sizeof(_error));
+    return true;
+}
+
+void __not_in_flash_func(Requantizer::process)(int32_t *s, size_t n)
+{
+    if (!_bits)
+    {
+        return;
+    }
+
+    const int32_t step = (int32_t)1 << _bits;
+    const int32_t mask = ~(step - 1);
+    const int32_t half = step >> 1;
+    int32_t e0 = _error[0], e1 = _error[1], e2 = _error[2], e3 = _error[3], e4 = _error[4];
+    uint32_t rng = _rng;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        /* subtract the filtered past errors */
+        int64_t fb = (int64_t)_coeffs[0] * e0 + (int64_t)_coeffs[1] * e1 + (int64_t)_coeffs[2] * e2 +
+                     (int64_t)_coeffs[3] * e3 + (int64_t)_coeffs[4] * e4;
+        int64_t v = (int64_t)s[i] - (fb >> SHAPING_Q);
+
+        int64_t d = half;
+        if (_dither)
+        {
+            /* xorshift32, two uniform draws of one step each form a triangle of +-1 step */
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            d += (int64_t)(rng & (step - 1));
+            rng ^= rng << 13;
+            rng ^= rng >> 17;
+            rng ^= rng << 5;
+            d += (int64_t)(rng & (step - 1)) - step;
+        }
+
+        int64_t y = (v + d) & mask;
+        y = y > INT32_MAX ? (INT32_MAX & mask) : (y < INT32_MIN ? INT32_MIN : y);
+
+        /* bounded, so a clipped sample cannot wind up the feedback */
+        int64_t e = y - v;
+        e = e > 2 * step ? 2 * step : (e < -2 * step ? -2 * step : e);
+
+        e4 = e3;
+        e3 = e2;
+        e2 = e1;
+        e1 = e0;
+        e0 = (int32_t)e;
+
+        s[i] = (int32_t)y;
+    }
+
+    _error[0] = e0;
+    _error[1] = e1;
+    _error[2] = e2;
+    _error[3] = e3;
+    _error[4] = e4;
+    _rng = rng;
+}
+
+uint8_t Requantizer::getBits() const
+{
+    return _bits;
+}
+
+uint8_t Requantizer::getOrder() const
+{
+    return _order;
+}
+
+bool Requantizer::getDither() const
+{
+    return _dither;
+}
@@ -0,0 +1,46 @@
+#ifndef REQUANTIZE_H
+#define REQUANTIZE_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define REQUANTIZE_MAX_ORDER (5)
+
+/*
+    Requantization to a coarser step with error feedback noise shaping
+    and optional TPDF dither.
+    The samples keep their scale, only the lowest `bits` are cleared,
+    so the stage can sit at any point where precision gets dropped
+    (the DAC word, a narrower accumulator, ...).
+    At 48kHz there is almost no room above the audio band, so instead of
+    (1 - z^-1)^order the taps follow the ear's sensitivity: the noise is
+    pulled out of the 2-5kHz region and pushed above 12kHz. Total noise
+    goes up with the order, audible noise goes down.
+    Order 0 is plain rounding.
+*/
+class Requantizer {
+public:
+    Requantizer(); // pass-through
+
+    /* bits 1..24, order 0..5, dither adds +-1 step of triangular noise */
+    bool configure(uint8_t bits, uint8_t order, bool dither);
+
+    /* in place */
+    void process(int32_t *s, size_t n);
+
+    uint8_t getBits() const;
+    uint8_t getOrder() const;
+    bool getDither() const;
+
+private:
+    uint8_t _bits;
+    uint8_t _order;
+    bool _dither;
+
+    int32_t _coeffs[REQUANTIZE_MAX_ORDER];
+    int32_t _error[REQUANTIZE_MAX_ORDER]; // newest first
+    uint32_t _rng;
+};
+
+#endif
@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <new>
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "selftest.h"
+#include "iir.h"
+#include "packed16.h"
+#include "spectrum.h"
+#include "graph.h"
+#include "delay.h"
+#include "circular.h"
+#include "convolve.h"
+
+/* excitation, followed by silence for the limit cycle check */
+#define SELFTEST_LENGTH (1024)
+#define SELFTEST_TAIL (512)
+#define SELFTEST_BLOCK (32)
+
+typedef enum
+{
+    signal_impulse,
+    signal_sweep,
+    signal_noise,
+    signal_square,
+    signal_count
+} signal_type_t;
+
+static const char *signalNames[] = {"impulse", "sweep", "noise", "square"};
+
+static const char *typeNames[] = {
+    "lowpass",
+    "highpass",
+    "bandpass",
+    "notch",
+    "peak",
+    "lowshelf",
+    "highshelf",
+    "none"};
+
+typedef struct
+{
+    signal_type_t type;
+    int32_t amplitude;
+    float Fs;
+    double phase;
+    uint32_t rng;
+} corpus_t;
+
+static int32_t corpus_sample(corpus_t &c, size_t n)
+{
+    if (n >= SELFTEST_LENGTH)
+    {
+        return 0;
+    }
+
+    switch (c.type)
+    {
+    case signal_impulse:
+        return n == 0 ? c.amplitude : 0;
+    case signal_sweep:
+    {
+        /* logarithmic, 20Hz to Nyquist over the excitation */
+        double f = 20.0 * pow(c.Fs / 2 / 20.0, (double)n / SELFTEST_LENGTH);
+        c.phase += 2 * M_PI * f / c.Fs;
+        return (int32_t)(c.amplitude * sin(c.phase));
+    }
+    case signal_noise:
+        c.rng ^= c.rng << 13;
+        c.rng ^= c.rng >> 17;
+        c.rng ^= c.rng << 5;
+        return (int32_t)(((int64_t)(int32_t)c.rng * c.amplitude) >> 31);
+    case signal_square:
+    default:
+        /* 64 samples period, full scale edges excite every overshoot */
+        return (n & 32) ? -c.amplitude : c.amplitude;
+    }
+}
+
+/*
+    direct form 1 in double precision, running the quantized coefficients
+    so only the arithmetic is compared, the output saturates where the
+    kernel is meant to
+*/
+typedef struct
+{
+    double b[3], a[2];
+    double x[2], y[2];
+    double limit;
+    bool clipped;
+} model_t;
+
+static void model_init(model_t &m, const biquad_coeffs_t &c, double scale, double limit)
+{
+    memset(&m, 0, sizeof(m));
+    m.limit = limit;
+    if (c.type == none)
+    {
+        m.b[0] = 1;
+        return;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+        m.b[k] = c.b[k] / scale;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        m.a[k] = c.a[k] / scale;
+    }
+}
+
+static double model_filter(model_t &m, double s)
+{
+    double y = m.b[0] * s + m.b[1] * m.x[0] + m.b[2] * m.x[1] + m.a[0] * m.y[0] + m.a[1] * m.y[1];
+    if (fabs(y) > m.limit)
+    {
+        y = y < 0 ? -m.limit - 1 : m.limit;
+        m.clipped = true;
+    }
+    m.x[1] = m.x[0];
+    m.x[0] = s;
+    m.y[1] = m.y[0];
+    m.y[0] = y;
+    return y;
+}
+
+/* a coefficient that did not fit its word was clipped by the quantizer */
+static bool coeffs_fit(const biquad_design_t &d, const biquad_coeffs_t &c, int fineBits)
+{
+    double scale = ldexp(1.0, c.shift + fineBits);
+    if (d.type == none)
+    {
+        return true;
+    }
+    double ideal[5] = {d.a0, d.a1, d.a2, -d.b1, -d.b2};
+    int32_t actual[5] = {c.b[0], c.b[1], c.b[2], c.a[0], c.a[1]};
+    for (int k = 0; k < 5; k++)
+    {
+        if (fabs(ideal[k] * scale - actual[k]) > 1.0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* accumulated over one signal */
+typedef struct
+{
+    double reference;
+    double noise;
+    int32_t tail;
+    double tailModel;
+    bool exact;
+} stats_t;
+
+static void stats_init(stats_t &st, int32_t amplitude)
+{
+    memset(&st, 0, sizeof(st));
+    /* noise is measured against a full scale sine, the corpus signals
+        themselves differ too much in energy to be a fair reference */
+    st.reference = (double)amplitude * amplitude / 2 * SELFTEST_LENGTH;
+    st.exact = true;
+}
+
+static void stats_add(stats_t &st, size_t n, int32_t out, double model)
+{
+    if (n < SELFTEST_LENGTH)
+    {
+        st.noise += (out - model) * (out - model);
+    }
+    else if (n >= SELFTEST_LENGTH + SELFTEST_TAIL / 2)
+    {
+        int32_t a = out < 0 ? -out : out;
+        st.tail = a > st.tail ? a : st.tail;
+        st.tailModel = fabs(model) > st.tailModel ? fabs(model) : st.tailModel;
+    }
+}
+
+static double stats_snr(const stats_t &st)
+{
+    if (st.noise == 0)
+    {
+        return INFINITY;
+    }
+    return 10 * log10(st.reference / st.noise);
+}
+
+/*
+    prints the case if it fails, returns the verdict
+    once a recursive filter clips, the smallest difference in rounding
+    takes it down another path, so clipped cases skip the SNR
+*/
+static bool stats_check(const char *kernel, int type, int signal, const stats_t &st, double minSnr, bool overflow, bool clipped)
+{
+    double snr = stats_snr(st);
+    bool limitCycle = st.tail > SELFTEST_LIMIT_CYCLE + ceil(st.tailModel);
+    bool ok = st.exact && (clipped || snr >= minSnr) && !overflow && !limitCycle;
+
+    if (ok && clipped)
+    {
+        printf("selftest %s %s %s: clips, snr not checked\n", kernel, typeNames[type], signalNames[signal]);
+    }
+
+    if (!ok)
+    {
+        printf("selftest %s %s %s:%s snr %.1fdB%s%s\n",
+               kernel, typeNames[type], signalNames[signal],
+               st.exact ? "" : " block mismatch",
+               snr,
+               overflow ? " overflow" : "",
+               limitCycle ? " limit cycle" : "");
+    }
+    return ok;
+}
+
+/* filterBlock in uneven pieces, in place, to catch state hand-over errors */
+static const size_t pieces[] = {1, 7, 24};
+
+static bool test_iir(const biquad_design_t &design, int signal, float Fs, double *worst)
+{
+    biquad_coeffs_t c = IIR::quantize(design);
+    IIR reference, block;
+    reference.setCoefficients(c);
+    block.setCoefficients(c);
+    /* the economy variant, where there is one, is only held to bit exactness */
+    IIR economyReference, economyBlock;
+    economyReference.setCoefficients(c);
+    economyBlock.setCoefficients(c);
+    economyReference.setEconomy(true);
+    economyBlock.setEconomy(true);
+    model_t m;
+    model_init(m, c, ldexp(1.0, c.shift), INT32_MAX);
+
+    /* graph level, 24 bit samples */
+    corpus_t corpus = {(signal_type_t)signal, (1 << (IIR_SAMPLE_BITS - 1)) - 1, Fs, 0, 0x2545F491};
+    stats_t st;
+    stats_init(st, corpus.amplitude);
+
+    int32_t in[SELFTEST_BLOCK], ref[SELFTEST_BLOCK];
+    int32_t economyIn[SELFTEST_BLOCK], economyRef[SELFTEST_BLOCK];
+    for (size_t n = 0; n < SELFTEST_LENGTH + SELFTEST_TAIL; n += SELFTEST_BLOCK)
+    {
+        for (size_t i = 0; i < SELFTEST_BLOCK; i++)
+        {
+            in[i] = corpus_sample(corpus, n + i);
+            ref[i] = in[i];
+            reference.filter(&ref[i]);
+            economyIn[i] = in[i];
+            economyRef[i] = in[i];
+            economyReference.filter(&economyRef[i]);
+            stats_add(st, n + i, ref[i], model_filter(m, in[i]));
+        }
+
+        size_t i = 0;
+        for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++)
+        {
+            block.filterBlock(&in[i], &in[i], pieces[p]);
+            economyBlock.filterBlock(&economyIn[i], &economyIn[i], pieces[p]);
+            i += pieces[p];
+        }
+
+        if (memcmp(in, ref, sizeof(in)) || memcmp(economyIn, economyRef, sizeof(economyIn)))
+        {
+            st.exact = false;
+        }
+    }
+
+    double snr = stats_snr(st);
+    *worst = snr < *worst ? snr : *worst;
+    /* the 32 bit path does not saturate, reaching the rail means it wrapped */
+    return stats_check("IIR", design.type, signal, st, SELFTEST_SNR_32, m.clipped, false);
+}
+
+static bool test_iir16(const biquad_design_t &design, int signal, float Fs, double *worst)
+{
+    biquad_coeffs_t c = StereoIIR16::quantize(design);
+    StereoIIR16 stereo(design, design);
+    model_t m[2];
+    model_init(m[0], c, ldexp(1.0, c.shift + IIR16_FINE_BITS), INT16_MAX);
+    model_init(m[1], c, ldexp(1.0, c.shift + IIR16_FINE_BITS), INT16_MAX);
+
+    /* packed path level, 1 bit of headroom below full scale */
+    corpus_t corpus = {(signal_type_t)signal, INT16_MAX >> 1, Fs, 0, 0x2545F491};
+    stats_t st[2];
+    stats_init(st[0], corpus.amplitude);
+    stats_init(st[1], corpus.amplitude);
+
+    for (size_t n = 0; n < SELFTEST_LENGTH + SELFTEST_TAIL; n++)
+    {
+        /* the right lane runs inverted, crosstalk between lanes shows up as error */
+        int32_t s = corpus_sample(corpus, n);
+        uint32_t frame = pack16(s, -s);
+        stereo.filter(&frame);
+        stats_add(st[0], n, unpackLeft16(frame), model_filter(m[0], s));
+        stats_add(st[1], n, unpackRight16(frame), model_filter(m[1], -s));
+    }
+
+    bool ok = true;
+    for (int ch = 0; ch < 2; ch++)
+    {
+        /* saturating is intended here, quantize() rules out a wrapped accumulator */
+        if (!m[ch].clipped)
+        {
+            double snr = stats_snr(st[ch]);
+            *worst = snr < *worst ? snr : *worst;
+        }
+        ok &= stats_check(ch ? "StereoIIR16 right" : "StereoIIR16 left", design.type, signal, st[ch], SELFTEST_SNR_16, false, m[ch].clipped);
+    }
+    return ok;
+}
+
+bool selftest_run(float Fs)
+{
+    bool ok = true;
+
+    for (int type = lowpass; type <= none; type++)
+    {
+        /* mid band design, +6dB where the type has a gain */
+        biquad_design_t design = biquad_design((filter_type_t)type, 1000, BIQUAD_Q_ORDER_2, 6.0, Fs);
+
+        double worst32 = INFINITY, worst16 = INFINITY;
+        bool pass = true;
+        if (!coeffs_fit(design, IIR::quantize(design), 0))
+        {
+            printf("selftest IIR %s: coefficients out of range\n", typeNames[type]);
+            pass = false;
+        }
+        if (!coeffs_fit(design, StereoIIR16::quantize(design), IIR16_FINE_BITS))
+        {
+            printf("selftest StereoIIR16 %s: coefficients out of range\n", typeNames[type]);
+            pass = false;
+        }
+        for (int signal = 0; signal < signal_count; signal++)
+        {
+            pass &= test_iir(design, signal, Fs, &worst32);
+            pass &= test_iir16(design, signal, Fs, &worst16);
+        }
+
+        printf("selftest %-9s %s, worst snr IIR %.1fdB StereoIIR16 %.1fdB\n",
+               typeNames[type], pass ? "ok" : "FAILED", worst32, worst16);
+        ok &= pass;
+    }
+
+    return ok;
+}
+
+bool selftest_fft(float Fs)
+{
+    int32_t *frame = new (std::nothrow) int32_t[FFT_MAX_SIZE];
+    if (!frame)
+    {
+        printf("selftest fft: no memory\n");
+        return false;
+    }
+
+    bool ok = true;
+    uint32_t rng = 1;
+    float cyclesPerUs = clock_get_hz(clk_sys) / 1e6f;
+    for (size_t n = SPECTRUM_MIN_SIZE; n <= FFT_MAX_SIZE; n *= 2)
+    {
+        /* the worst of a few, the first one with a cold flash cache */
+        uint32_t worst = 0;
+        for (int run = 0; run < 4; run++)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                rng = rng * 1664525 + 1013904223;
+                frame[i] = (int32_t)rng >> 1;
+            }
+            uint32_t start = time_us_32();
+            fft_real(frame, n);
+            uint32_t us = time_us_32() - start;
+            worst = us > worst ? us : worst;
+        }
+
+        uint32_t cycles = (uint32_t)(worst * cyclesPerUs);
+        uint32_t budget = (uint32_t)(clock_get_hz(clk_sys) / Fs * n);
+        bool pass = cycles <= budget;
+        printf("selftest fft %4u points %s, %lu cycles (%lu%% of the frame)\n", (unsigned)n,
+               pass ? "ok" : "FAILED", (unsigned long)cycles, (unsigned long)(cycles * 100ull / budget));
+        ok &= pass;
+    }
+
+    delete[] frame;
+    return ok;
+}
+
+bool selftest_delay()
+{
+    DelayArena *arena = new (std::nothrow) DelayArena();
+    if (!arena)
+    {
+        printf("selftest DelayLine: no memory\n");
+        return false;
+    }
+
+    /* 10ms, the line wraps within every timed run */
+    const uint32_t delay = 480;
+    const size_t blocks = 64;
+    DelayLine line;
+    line.begin(*arena, 1000, delay);
+
+    int32_t in[SELFTEST_BLOCK], out[SELFTEST_BLOCK];
+    bool ok = true;
+    uint32_t elapsed = 0;
+    for (size_t b = 0; b < 2 * blocks; b++)
+    {
+        for (size_t i = 0; i < SELFTEST_BLOCK; i++)
+        {
+            in[i] = (int32_t)(b * SELFTEST_BLOCK + i);
+        }
+        uint32_t start = time_us_32();
+        line.process(in, out, SELFTEST_BLOCK);
+        if (b >= blocks)
+        {
+            elapsed += time_us_32() - start;
+        }
+        for (size_t i = 0; i < SELFTEST_BLOCK; i++)
+        {
+            int32_t n = (int32_t)(b * SELFTEST_BLOCK + i);
+            ok &= out[i] == (n >= (int32_t)delay ? n - (int32_t)delay : 0);
+        }
+    }
+    delete arena;
+
+    float cycles = elapsed * (clock_get_hz(clk_sys) / 1e6f) / (blocks * SELFTEST_BLOCK);
+    printf("selftest DelayLine %s %s, %.1f cycles per sample (plan estimate %d)\n",
+           DSP_INTERP ? "interpolator" : "software cursor", ok ? "ok" : "FAILED", cycles, CYCLES_DELAY);
+
+    return ok;
+}
+
+bool selftest_convolve(float Fs)
+{
+    /* 24kB, only while it is measured */
+    Convolver *c = new (std::nothrow) Convolver();
+    if (!c)
+    {
+        printf("selftest Convolver: no memory\n");
+        return false;
+    }
+
+    uint32_t rng = 1;
+    float taps[CONVOLVE_BLOCK];
+    for (size_t k = 0; k < CONVOLVE_MAX_PARTITIONS; k++)
+    {
+        for (size_t i = 0; i < CONVOLVE_BLOCK; i++)
+        {
+            rng = rng * 1664525 + 1013904223;
+            taps[i] = (float)(int32_t)rng * 0x1p-38f;
+        }
+        c->load(k, taps, CONVOLVE_BLOCK);
+    }
+    c->swap(CONVOLVE_MAX_PARTITIONS);
+
+    /* the first lap fills the delay line, the second one is timed */
+    int32_t block[CONVOLVE_BLOCK];
+    uint32_t worst = 0, total = 0;
+    for (size_t b = 0; b < 2 * CONVOLVE_MAX_PARTITIONS; b++)
+    {
+        for (size_t i = 0; i < CONVOLVE_BLOCK; i++)
+        {
+            rng = rng * 1664525 + 1013904223;
+            block[i] = (int32_t)rng >> 10;
+        }
+        uint32_t start = time_us_32();
+        c->process(block, block);
+        uint32_t us = time_us_32() - start;
+        if (b >= CONVOLVE_MAX_PARTITIONS)
+        {
+            worst = us > worst ? us : worst;
+            total += us;
+        }
+    }
+    delete c;
+
+    float cyclesPerUs = clock_get_hz(clk_sys) / 1e6f;
+    uint32_t budget = (uint32_t)(clock_get_hz(clk_sys) / Fs * CONVOLVE_BLOCK);
+    uint32_t worstCycles = (uint32_t)(worst * cyclesPerUs);
+    bool ok = worstCycles <= budget;
+    printf("selftest Convolver %d taps %s, worst %lu cycles, mean %lu per block (%lu%% of %lu)\n",
+           CONVOLVE_MAX_TAPS, ok ? "ok" : "FAILED", (unsigned long)worstCycles,
+           (unsigned long)(total * cyclesPerUs / CONVOLVE_MAX_PARTITIONS),
+           (unsigned long)(worstCycles * 100 / budget), (unsigned long)budget);
+    return ok;
+}
@@ -0,0 +1,56 @@
+#ifndef SELFTEST_H
+#define SELFTEST_H
+#pragma once
+
+#include <stdbool.h>
+
+/*
+    Accuracy check of the filter kernels, run on the target at boot
+    when built with DSP_SELFTEST=1.
+    Every filter type is driven with a corpus of impulses, sweeps,
+    noise and full-scale squares at the levels the audio path uses:
+      - IIR::filterBlock must match IIR::filter bit for bit, in the
+        full and the economy variant, IIR::filter is the golden
+        reference for any faster kernel
+      - IIR and StereoIIR16 must stay within a stated SNR of a double
+        precision model running the same quantized coefficients
+      - the quantized coefficients must fit their format
+      - the 32 bit path must not reach the rail, it wraps instead of
+        saturating (the 16 bit path saturates, clipped cases are noted)
+      - the output must decay to a few LSB once the input stops,
+        anything larger is a limit cycle
+    Results are printed per case, takes a few seconds on the RP2040.
+*/
+
+/* minimum SNR against the double model, dB */
+#define SELFTEST_SNR_32 (100.0)
+#define SELFTEST_SNR_16 (60.0)
+
+/* largest output allowed after the input went silent, LSB */
+#define SELFTEST_LIMIT_CYCLE (2)
+
+bool selftest_run(float Fs);
+
+/*
+    Q31 transform at every analyzer size, timed on core0 from flash,
+    in cycles against the duration of one frame at Fs, fails above it.
+*/
+bool selftest_fft(float Fs);
+
+/*
+    DelayLine steady state on the cursors DSP_INTERP selects, timed on
+    core0 from RAM, in cycles per sample next to the plan's estimate;
+    builds with and without DSP_INTERP give the before and after.
+    Fails only on a wrong output.
+*/
+bool selftest_delay();
+
+/*
+    Worst case block of the convolution engine, timed where it runs:
+    on core0 from flash, every partition of the longest response
+    loaded and no silent block to skip. Prints the cycles per block
+    against the block period at Fs, fails above it.
+*/
+bool selftest_convolve(float Fs);
+
+#endif
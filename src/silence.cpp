@@ -0,0 +1,65 @@
+#include <math.h>
+
+#include "pico/stdlib.h"
+#include "silence.h"
+#include "graph.h"
+
+SilenceDetector::SilenceDetector()
+{
+    _threshold = 0;
+    _hold = 0;
+    _quiet = 0;
+    _idle = false;
+    _idleBlocks = 0;
+}
+
+void __not_in_flash_func(SilenceDetector::configure)(int32_t threshold, uint32_t holdBlocks)
+{
+    _threshold = threshold;
+    _hold = holdBlocks;
+    _quiet = 0;
+}
+
+silence_state_t __not_in_flash_func(SilenceDetector::update)(int32_t peak)
+{
+    if (!_hold || peak > _threshold)
+    {
+        _quiet = 0;
+        _idle = false;
+        return silence_active;
+    }
+
+    if (_idle)
+    {
+        _idleBlocks++;
+        return silence_idle;
+    }
+
+    if (++_quiet >= _hold)
+    {
+        _idle = true;
+        return silence_stop;
+    }
+    return silence_active;
+}
+
+bool __not_in_flash_func(SilenceDetector::idle)() const
+{
+    return _idle;
+}
+
+uint32_t __not_in_flash_func(SilenceDetector::idleBlocks)() const
+{
+    return _idleBlocks;
+}
+
+int32_t silence_threshold(float dB)
+{
+    return (int32_t)(powf(10.0f, dB / 20.0f) * (float)(1 << 23));
+}
+
+uint32_t silence_hold(float ms, float Fs)
+{
+    uint32_t blocks = (uint32_t)(ms * Fs / 1000.0f / GRAPH_BLOCK_SIZE);
+    return ms > 0 && blocks == 0 ? 1 : blocks;
+}
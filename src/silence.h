@@ -0,0 +1,50 @@
+#ifndef SILENCE_H
+#define SILENCE_H
+#pragma once
+
+#include <stdint.h>
+
+/* input peak relative to full scale below which a block counts as silent */
+#define SILENCE_THRESHOLD_DB (-90.0f)
+/* silence before processing stops, outlasts every filter and delay tail */
+#define SILENCE_HOLD_MS (2000)
+
+typedef enum
+{
+    silence_active, // process as usual
+    silence_stop,   // last processed block, faded out, the histories are cleared after it
+    silence_idle    // nothing runs, the output is digital silence
+} silence_state_t;
+
+/*
+    Idle detection of the audio core.
+    Fed once per block with the absolute input peak. After the input
+    stayed below the threshold for the hold time, processing stops; the
+    first block above it is processed again, so nothing is lost.
+    The caller applies the state, the detector only decides.
+*/
+class SilenceDetector {
+public:
+    SilenceDetector(); // disabled
+
+    /* quiet up to threshold, at graph level (24 bit full scale), hold 0 disables */
+    void configure(int32_t threshold, uint32_t holdBlocks);
+
+    silence_state_t update(int32_t peak);
+
+    bool idle() const;
+    uint32_t idleBlocks() const; // blocks skipped since start
+
+private:
+    int32_t _threshold;
+    uint32_t _hold;
+    uint32_t _quiet; // consecutive blocks below the threshold
+    bool _idle;
+    uint32_t _idleBlocks;
+};
+
+/* conversions for configure(), in soft-float, not for the audio core */
+int32_t silence_threshold(float dB);
+uint32_t silence_hold(float ms, float Fs);
+
+#endif
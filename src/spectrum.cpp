@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "pico/stdlib.h"
+#include "spectrum.h"
+
+/* bin power of a full scale sine: Q31 amplitude, halved by the
+    transform and again by the Hann window's coherent gain */
+#define FULL_SCALE_POWER (powf(2.0f, 29) * powf(2.0f, 29))
+
+SpectrumAnalyzer::SpectrumAnalyzer()
+{
+    _size = 0;
+    _fill = 0;
+    _averages = 0;
+    _count = 0;
+    _fftTime = 0;
+}
+
+bool SpectrumAnalyzer::begin(size_t size, uint16_t averages)
+{
+    if (size < SPECTRUM_MIN_SIZE || size > FFT_MAX_SIZE || (size & (size - 1)) || !averages)
+    {
+        return false;
+    }
+    _size = size;
+    _averages = averages;
+    _fill = 0;
+    _count = 0;
+    memset(_power, 0, sizeof(_power));
+    return true;
+}
+
+void SpectrumAnalyzer::end()
+{
+    _size = 0;
+}
+
+bool SpectrumAnalyzer::active() const
+{
+    return _size != 0;
+}
+
+bool SpectrumAnalyzer::poll(TapQueue &tap)
+{
+    dsp_tap_t block;
+
+    if (!_size)
+    {
+        /* keep the ring empty while nothing reads it */
+        while (tap.pop(&block));
+        return false;
+    }
+
+    /* the previous average was handed out, start over */
+    if (_count == _averages)
+    {
+        _count = 0;
+        memset(_power, 0, sizeof(_power));
+    }
+
+    while (_fill < _size && tap.pop(&block))
+    {
+        /* graph level to Q31, then windowed */
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++, _fill++)
+        {
+            int32_t s = block.s[i] << 7;
+            _frame[_fill] = (int32_t)(((int64_t)s * fft_hann(_fill, _size)) >> 15);
+        }
+    }
+
+    if (_fill < _size)
+    {
+        return false;
+    }
+
+    uint32_t start = time_us_32();
+    fft_real(_frame, _size);
+    _fftTime = time_us_32() - start;
+
+    size_t bins = _size / 2;
+    _power[0] += (float)_frame[0] * (float)_frame[0];
+    _power[bins] += (float)_frame[1] * (float)_frame[1];
+    for (size_t k = 1; k < bins; k++)
+    {
+        float re = (float)_frame[2 * k];
+        float im = (float)_frame[2 * k + 1];
+        _power[k] += re * re + im * im;
+    }
+
+    /* blocks queued during the transform may have gaps, start fresh */
+    while (tap.pop(&block));
+    _fill = 0;
+
+    return ++_count == _averages;
+}
+
+void SpectrumAnalyzer::print(float Fs) const
+{
+    printf("spectrum %u %lu %u %luus:",
+           (unsigned)_size, (unsigned long)Fs, (unsigned)_count, (unsigned long)_fftTime);
+
+    float scale = 1.0f / (FULL_SCALE_POWER * _count);
+    for (size_t k = 0; k <= _size / 2; k++)
+    {
+        float p = _power[k] * scale;
+        /* floor at -200dB, an empty bin would be -inf */
+        int dB = p > 1e-20f ? (int)lroundf(100.0f * log10f(p)) : -2000;
+        printf(" %d", dB);
+    }
+    printf("\n");
+}
@@ -0,0 +1,49 @@
+#ifndef SPECTRUM_H
+#define SPECTRUM_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "fft.h"
+#include "control.h"
+
+/* smaller transforms are for the convolution engine, too coarse to read */
+#define SPECTRUM_MIN_SIZE (256)
+
+/*
+    Averaged magnitude spectrum of one output channel, computed on the
+    control core from the blocks the audio core copies into a TapQueue.
+    Frames are Hann windowed and transformed in Q31. The tap is flushed
+    after every transform, so a frame never spans blocks that were
+    dropped while the previous one was being transformed.
+    The audio core pays only for the block copy.
+*/
+class SpectrumAnalyzer {
+public:
+    SpectrumAnalyzer();
+
+    /* size is a power of two in SPECTRUM_MIN_SIZE..FFT_MAX_SIZE */
+    bool begin(size_t size, uint16_t averages);
+    void end();
+    bool active() const;
+
+    /* control core main loop, true once a new average is complete,
+        it stays readable until the next call */
+    bool poll(TapQueue &tap);
+
+    /* one line: size, Fs, averages, transform time, then every bin
+        in tenths of a dB relative to a full scale sine */
+    void print(float Fs) const;
+
+private:
+    int32_t _frame[FFT_MAX_SIZE];
+    float _power[FFT_MAX_SIZE / 2 + 1];
+
+    size_t _size;
+    size_t _fill;
+    uint16_t _averages;
+    uint16_t _count;
+    uint32_t _fftTime;
+};
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef SPSC_H
+#define SPSC_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+#include "pico/stdlib.h"
+
+/*
+    Single producer, single consumer ring for passing fixed-size
+    messages between the two cores.
+    Storage is part of the object, nothing is allocated. Neither side
+    ever waits: push fails when full and pop fails when empty.
+    Size must be a power of two, one slot is never wasted as head and
+    tail run freely and only get masked on access.
+    push and pop are forced inline, so a caller running from RAM never
+    fetches them from flash.
+*/
+template <typename T, size_t Size>
+class SpscRing {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "SpscRing size must be a power of two");
+
+public:
+    SpscRing() : _head(0), _tail(0) {}
+
+    /* producer side only */
+    __force_inline bool push(const T &item)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == Size)
+        {
+            return false;
+        }
+        _items[head & (Size - 1)] = item;
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* consumer side only */
+    __force_inline bool pop(T *item)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (_head.load(std::memory_order_acquire) == tail)
+        {
+            return false;
+        }
+        *item = _items[tail & (Size - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /* snapshot, may be stale by the time it is used */
+    size_t count() const
+    {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_acquire);
+    }
+
+private:
+    T _items[Size];
+    std::atomic<uint32_t> _head;
+    std::atomic<uint32_t> _tail;
+};
+
+#endif
@@ -0,0 +1,196 @@
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "subband.h"
+#include "circular.h"
+
+/*
+    Equiripple filters in Q15, each passes SUBBAND_PASSBAND at unity.
+    The halfbands list the taps next to the center (0.5) at odd offsets
+    1, 3, 5, ..., the even ones are zero, they sum to 8192.
+    The decimators keep everything above Fs/16 out of the low band,
+    the last one, where the transition is narrowest, is a full lowpass
+    at Fs/4. The interpolators only carry the change of the filters
+    and reject its images:
+        stage  rate   decimator         interpolator
+        1      Fs     3 pairs  89dB     3 pairs  91dB
+        2      Fs/2   5 pairs  83dB     3 pairs 100dB
+        3      Fs/4   31 taps  80dB     4 pairs  95dB
+    Decimation delays 5 + 18 + 60, interpolation 5 + 10 + 28 full rate
+    samples, SUBBAND_LATENCY in all.
+*/
+static const int16_t __not_in_flash("subband") halfband1[] = {9673, -1714, 233};
+static const int16_t __not_in_flash("subband") decimator2[] = {10084, -2553, 857, -233, 37};
+static const int16_t __not_in_flash("subband") interpolator2[] = {9633, -1650, 209};
+static const int16_t __not_in_flash("subband") interpolator3[] = {9894, -2137, 500, -65};
+
+/* the center tap and the taps at offsets 1, 2, ..., sum 32768 */
+static const int16_t __not_in_flash("subband") lowpass3[(SUBBAND_LOWPASS_TAPS + 1) / 2] = {
+    10592, 8740, 4418, 292, -1653, -1365, -200, 532, 488, 102, -145, -139, -35, 24, 23, 6};
+
+typedef struct
+{
+    const int16_t *taps;
+    size_t pairs;
+} halfband_t;
+
+#define HALFBAND(taps) {taps, sizeof(taps) / sizeof(taps[0])}
+
+static const halfband_t __not_in_flash("subband") decimators[SUBBAND_STAGES - 1] = {
+    HALFBAND(halfband1),
+    HALFBAND(decimator2)};
+
+static const halfband_t __not_in_flash("subband") interpolators[SUBBAND_STAGES] = {
+    HALFBAND(halfband1),
+    HALFBAND(interpolator2),
+    HALFBAND(interpolator3)};
+
+/*
+    sum of taps * pairs in Q15 without a 64 bit product: every pair
+    is split into its upper bits and 15 lower bits, both partial sums
+    fit 32 bits for samples up to 2^25 (the lowpass taps add up to
+    46916 in magnitude)
+*/
+#define SPLIT_HI(v) ((v) >> 15)
+#define SPLIT_LO(v) ((v) & 0x7FFF)
+
+/* n samples in, n / 2 out, the delay is 2 * pairs - 1 input samples */
+static void __not_in_flash_func(decimate2)(const halfband_t &hb, int32_t *history, const int32_t *in, int32_t *out, size_t n)
+{
+    const size_t keep = 4 * hb.pairs - 2;
+    int32_t w[4 * SUBBAND_MAX_PAIRS - 2 + SUBBAND_MAX_BLOCK];
+    memcpy(w, history, keep * sizeof(int32_t));
+    memcpy(w + keep, in, n * sizeof(int32_t));
+
+    for (size_t m = 0; m < n / 2; m++)
+    {
+        const int32_t *c = &w[2 * m + 2 * hb.pairs - 1];
+
+        /* the center tap is 0.5, 16384 in Q15 */
+        int32_t hi = SPLIT_HI(c[0]) * 16384;
+        int32_t lo = SPLIT_LO(c[0]) * 16384 + (1 << 14);
+        for (size_t k = 0; k < hb.pairs; k++)
+        {
+            int32_t pair = c[-(int32_t)(2 * k + 1)] + c[2 * k + 1];
+            hi += hb.taps[k] * SPLIT_HI(pair);
+            lo += hb.taps[k] * SPLIT_LO(pair);
+        }
+        out[m] = hi + (lo >> 15);
+    }
+
+    memcpy(history, w + n, keep * sizeof(int32_t));
+}
+
+/* the same with lowpass3, the delay is (taps - 1) / 2 input samples */
+static void __not_in_flash_func(decimate2Lowpass)(int32_t *history, const int32_t *in, int32_t *out, size_t n)
+{
+    const size_t half = (SUBBAND_LOWPASS_TAPS - 1) / 2;
+    int32_t w[SUBBAND_LOWPASS_TAPS - 1 + SUBBAND_MAX_BLOCK / 4];
+    memcpy(w, history, 2 * half * sizeof(int32_t));
+    memcpy(w + 2 * half, in, n * sizeof(int32_t));
+
+    for (size_t m = 0; m < n / 2; m++)
+    {
+        const int32_t *c = &w[2 * m + half];
+
+        int32_t hi = lowpass3[0] * SPLIT_HI(c[0]);
+        int32_t lo = lowpass3[0] * SPLIT_LO(c[0]) + (1 << 14);
+        for (size_t k = 1; k <= half; k++)
+        {
+            int32_t pair = c[-(int32_t)k] + c[k];
+            hi += lowpass3[k] * SPLIT_HI(pair);
+            lo += lowpass3[k] * SPLIT_LO(pair);
+        }
+        out[m] = hi + (lo >> 15);
+    }
+
+    memcpy(history, w + n, 2 * half * sizeof(int32_t));
+}
+
+/*
+    n samples in, 2n out, gain 2 to make up for the inserted zeros.
+    One output phase is the input delayed, the other the halfband
+    taps, the delay is 2 * pairs - 1 output samples
+*/
+static void __not_in_flash_func(interpolate2)(const halfband_t &hb, int32_t *history, const int32_t *in, int32_t *out, size_t n)
+{
+    const size_t keep = 2 * hb.pairs - 1;
+    int32_t w[2 * SUBBAND_MAX_PAIRS - 1 + SUBBAND_MAX_BLOCK / 2];
+    memcpy(w, history, keep * sizeof(int32_t));
+    memcpy(w + keep, in, n * sizeof(int32_t));
+
+    for (size_t m = 0; m < n; m++)
+    {
+        /* the taps are centered between c[0] and c[1] */
+        const int32_t *c = &w[m + hb.pairs - 1];
+
+        int32_t hi = 0;
+        int32_t lo = 1 << 13;
+        for (size_t k = 0; k < hb.pairs; k++)
+        {
+            int32_t pair = c[k + 1] + c[-(int32_t)k];
+            hi += hb.taps[k] * SPLIT_HI(pair);
+            lo += hb.taps[k] * SPLIT_LO(pair);
+        }
+        out[2 * m] = 2 * hi + (lo >> 14);
+        out[2 * m + 1] = c[1];
+    }
+
+    memcpy(history, w + n, keep * sizeof(int32_t));
+}
+
+Subband::Subband()
+{
+    reset();
+}
+
+void __not_in_flash_func(Subband::reset)()
+{
+    memset(_decimate, 0, sizeof(_decimate));
+    memset(_lowpass, 0, sizeof(_lowpass));
+    memset(_interpolate, 0, sizeof(_interpolate));
+    memset(_low, 0, sizeof(_low));
+    memset(_direct, 0, sizeof(_direct));
+    _position = 0;
+}
+
+void __not_in_flash_func(Subband::split)(const int32_t *in, int32_t *low, size_t n)
+{
+    /* before anything is written, low may alias in */
+    CircularCursor direct(0, _direct, SUBBAND_DIRECT_WORDS - 1, _position);
+    for (size_t i = 0; i < n; i++)
+    {
+        *direct.next() = in[i];
+    }
+
+    int32_t half[SUBBAND_MAX_BLOCK / 2];
+    int32_t quarter[SUBBAND_MAX_BLOCK / 4];
+    decimate2(decimators[0], _decimate[0], in, half, n);
+    decimate2(decimators[1], _decimate[1], half, quarter, n / 2);
+    decimate2Lowpass(_lowpass, quarter, _low, n / 4);
+
+    memcpy(low, _low, n / SUBBAND_FACTOR * sizeof(int32_t));
+}
+
+void __not_in_flash_func(Subband::merge)(const int32_t *processed, int32_t *out, size_t n)
+{
+    /* only the change the filters made goes through the interpolators */
+    int32_t change[SUBBAND_MAX_BLOCK / SUBBAND_FACTOR] = {};
+    for (size_t i = 0; i < n / SUBBAND_FACTOR; i++)
+    {
+        change[i] = processed[i] - _low[i];
+    }
+
+    int32_t quarter[SUBBAND_MAX_BLOCK / 4];
+    int32_t half[SUBBAND_MAX_BLOCK / 2];
+    interpolate2(interpolators[2], _interpolate[2], change, quarter, n / SUBBAND_FACTOR);
+    interpolate2(interpolators[1], _interpolate[1], quarter, half, n / 4);
+    interpolate2(interpolators[0], _interpolate[0], half, out, n / 2);
+
+    CircularCursor direct(0, _direct, SUBBAND_DIRECT_WORDS - 1, _position - SUBBAND_LATENCY);
+    for (size_t i = 0; i < n; i++)
+    {
+        out[i] += *direct.next();
+    }
+    _position += n;
+}
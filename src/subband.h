@@ -0,0 +1,71 @@
+#ifndef SUBBAND_H
+#define SUBBAND_H
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+    Low band split for filters that only act in the bass region.
+    split() decimates by SUBBAND_FACTOR with two halfbands and a
+    lowpass, the filters then run on the low band, and merge()
+    interpolates their change (processed - unprocessed low band) back
+    up and adds it to the input, delayed by the latency of the round
+    trip:
+
+        out = in(n - SUBBAND_LATENCY) + I(F(D(in)) - D(in))
+
+    With the filters at unity the output is the delayed input bit for
+    bit. Decimator aliasing and truncation only reach the output
+    where the filters differ from unity, so the low band may be coarse
+    where nothing is changed.
+    The filters must keep their effect below SUBBAND_PASSBAND of the
+    full rate (1kHz at 48kHz). Everything above Fs/16 (3kHz) reaches
+    the low band at least 80dB down, whatever it aliases to.
+*/
+
+#define SUBBAND_FACTOR (8)
+#define SUBBAND_PASSBAND(Fs) ((Fs) / 48)
+
+/* full rate samples from split() input to merge() output */
+#define SUBBAND_LATENCY (126)
+
+/* largest block split() and merge() accept, a multiple of SUBBAND_FACTOR */
+#define SUBBAND_MAX_BLOCK (32)
+
+#define SUBBAND_STAGES (3)
+#define SUBBAND_MAX_PAIRS (5)
+#define SUBBAND_LOWPASS_TAPS (31)
+#define SUBBAND_DIRECT_WORDS (256)
+
+static_assert(SUBBAND_DIRECT_WORDS >= SUBBAND_LATENCY + SUBBAND_MAX_BLOCK, "direct path too short for the latency");
+
+class Subband {
+public:
+    Subband();
+    void reset();
+
+    /* n full rate samples to n / SUBBAND_FACTOR low band samples,
+        low may alias in */
+    void split(const int32_t *in, int32_t *low, size_t n);
+
+    /* the processed low band of the last split() back to n full rate
+        samples, out may alias processed */
+    void merge(const int32_t *processed, int32_t *out, size_t n);
+
+private:
+    /* filter histories, halfband decimators keep 4 * pairs - 2,
+        the lowpass taps - 1, interpolators 2 * pairs - 1 */
+    int32_t _decimate[SUBBAND_STAGES - 1][4 * SUBBAND_MAX_PAIRS - 2];
+    int32_t _lowpass[SUBBAND_LOWPASS_TAPS - 1];
+    int32_t _interpolate[SUBBAND_STAGES][2 * SUBBAND_MAX_PAIRS - 1];
+
+    /* the unprocessed low band of the current block */
+    int32_t _low[SUBBAND_MAX_BLOCK / SUBBAND_FACTOR];
+
+    /* the input, for the direct path */
+    int32_t _direct[SUBBAND_DIRECT_WORDS];
+    uint32_t _position;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef HOST_HARDWARE_FLASH_H
+#define HOST_HARDWARE_FLASH_H
+#pragma once
+
+/*
+    flash programming against the image a test maps at host_xip,
+    with the NOR rules of the real part: erase sets whole sectors to
+    0xFF, programming whole pages can only clear bits
+*/
+
+#include <string.h>
+
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+
+#define FLASH_PAGE_SIZE (1u << 8)
+#define FLASH_SECTOR_SIZE (1u << 12)
+
+/* misaligned, out of range or with interrupts enabled */
+inline uint32_t host_flash_faults = 0;
+
+/* the linker's end of the program image, moved into the mapped image
+    by the test: `extern char __flash_binary_end;` declares this pointer */
+inline char *host_flash_end = nullptr;
+#define __flash_binary_end *host_flash_end
+
+static inline bool host_flash_check(uint32_t offset, size_t count, size_t unit)
+{
+    if (!host_xip || offset % unit || count % unit || offset + count > PICO_FLASH_SIZE_BYTES ||
+        !host_interrupts_disabled)
+    {
+        host_flash_faults++;
+        return false;
+    }
+    return true;
+}
+
+static inline void flash_range_erase(uint32_t offset, size_t count)
+{
+    if (host_flash_check(offset, count, FLASH_SECTOR_SIZE))
+    {
+        memset(host_xip + offset, 0xFF, count);
+    }
+}
+
+static inline void flash_range_program(uint32_t offset, const uint8_t *data, size_t count)
+{
+    if (host_flash_check(offset, count, FLASH_PAGE_SIZE))
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            host_xip[offset + i] &= data[i];
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef HOST_HARDWARE_INTERP_H
+#define HOST_HARDWARE_INTERP_H
+#pragma once
+
+/*
+    functional model of the SIO interpolators, as far as the kernels
+    use them: lanes 0 and 1 shift and mask their accumulator, the
+    results add the bases, a POP writes lanes 0 and 1 back
+    no sign extension, cross input, blend or clamp
+    BASE2 and the results are 32 bits, so pointers built on them only
+    work on buffers below 4GB (see test_circular)
+*/
+
+#include <stdint.h>
+
+#include "pico/stdlib.h"
+
+typedef struct
+{
+    uint32_t ctrl;
+} interp_config;
+
+struct interp_hw_t;
+
+/* reading pop[i] has the side effect of the register */
+struct interp_pop_t
+{
+    interp_hw_t *hw;
+    uint32_t operator[](int i) const;
+};
+
+struct interp_hw_t
+{
+    uint32_t accum[2];
+    uint32_t base[3];
+    uint32_t ctrl[2];
+    interp_pop_t pop;
+
+    interp_hw_t() : accum{}, base{}, ctrl{}, pop{this} {}
+
+    uint32_t lane(int l) const
+    {
+        uint32_t shift = ctrl[l] & 31, lsb = (ctrl[l] >> 5) & 31, msb = (ctrl[l] >> 10) & 31;
+        uint32_t mask = (msb == 31 ? 0xFFFFFFFFu : (1u << (msb + 1)) - 1) & ~((1u << lsb) - 1);
+        return (accum[l] >> shift) & mask;
+    }
+};
+
+inline uint32_t interp_pop_t::operator[](int i) const
+{
+    uint32_t l0 = hw->lane(0), l1 = hw->lane(1);
+    uint32_t result[3] = {hw->base[0] + l0, hw->base[1] + l1, hw->base[2] + l0 + l1};
+    hw->accum[0] = result[0];
+    hw->accum[1] = result[1];
+    return result[i];
+}
+
+/* one pair, the host has a single core */
+inline interp_hw_t host_interp[2];
+#define interp0 (&host_interp[0])
+#define interp1 (&host_interp[1])
+
+static inline interp_config interp_default_config()
+{
+    interp_config c;
+    c.ctrl = 31u << 10;
+    return c;
+}
+
+static inline void interp_config_set_mask(interp_config *c, uint lsb, uint msb)
+{
+    c->ctrl = (c->ctrl & ~0x7FE0u) | (lsb << 5) | (msb << 10);
+}
+
+static inline void interp_set_config(interp_hw_t *interp, uint lane, interp_config *c)
+{
+    interp->ctrl[lane] = c->ctrl;
+}
+
+#endif
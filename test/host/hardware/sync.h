@@ -0,0 +1,22 @@
+#ifndef HOST_HARDWARE_SYNC_H
+#define HOST_HARDWARE_SYNC_H
+#pragma once
+
+#include <stdint.h>
+
+/* the host has no interrupts, the state only lets the flash shim check */
+inline bool host_interrupts_disabled = false;
+
+static inline uint32_t save_and_disable_interrupts()
+{
+    uint32_t state = host_interrupts_disabled;
+    host_interrupts_disabled = true;
+    return state;
+}
+
+static inline void restore_interrupts(uint32_t state)
+{
+    host_interrupts_disabled = state != 0;
+}
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+#pragma once
+
+/* the parts of the SDK the DSP modules use, for building them on a host */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+typedef unsigned int uint;
+
+#define __not_in_flash_func(f) f
+#define __not_in_flash(group)
+#define __force_inline inline __attribute__((always_inline))
+
+#define PICO_FLASH_SIZE_BYTES (2 * 1024 * 1024)
+
+/* where a test maps its flash image, reads through XIP land there */
+inline uint8_t *host_xip = nullptr;
+#define XIP_BASE ((uintptr_t)host_xip)
+
+static inline uint64_t time_us_64()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static inline uint32_t time_us_32()
+{
+    return (uint32_t)time_us_64();
+}
+
+static inline void __wfe() {}
+static inline void __sev() {}
+static inline void tight_loop_contents() {}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef REFERENCE_H
+#define REFERENCE_H
+#pragma once
+
+#include <math.h>
+#include <complex>
+#include <vector>
+
+/* double precision references the fixed-point code is measured against */
+
+typedef std::complex<double> complex_t;
+
+/* in place radix-2 FFT, n a power of two, unscaled */
+static inline void reference_fft(std::vector<complex_t> &a)
+{
+    size_t n = a.size();
+    for (size_t i = 1, j = 0; i < n; i++)
+    {
+        size_t bit = n >> 1;
+        for (; j & bit; bit >>= 1)
+        {
+            j ^= bit;
+        }
+        j ^= bit;
+        if (i < j)
+        {
+            std::swap(a[i], a[j]);
+        }
+    }
+    for (size_t len = 2; len <= n; len <<= 1)
+    {
+        complex_t wl = std::polar(1.0, -2 * M_PI / (double)len);
+        for (size_t i = 0; i < n; i += len)
+        {
+            complex_t w = 1;
+            for (size_t j = 0; j < len / 2; j++)
+            {
+                complex_t u = a[i + j], v = a[i + j + len / 2] * w;
+                a[i + j] = u + v;
+                a[i + j + len / 2] = u - v;
+                w *= wl;
+            }
+        }
+    }
+}
+
+/* power in dB of a ratio, floored so empty bands stay finite */
+static inline double reference_db(double ratio)
+{
+    return 10 * log10(ratio + 1e-30);
+}
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef TEST_H
+#define TEST_H
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/* failed checks are printed and counted, main returns test_result() */
+static int test_failures = 0;
+
+#define CHECK(cond, ...)                                              \
+    do                                                                \
+    {                                                                 \
+        if (!(cond))                                                  \
+        {                                                             \
+            printf("%s:%d: %s: ", __FILE__, __LINE__, #cond);         \
+            printf(__VA_ARGS__);                                      \
+            printf("\n");                                             \
+            test_failures++;                                          \
+        }                                                             \
+    } while (0)
+
+static inline int test_result(const char *name)
+{
+    printf("%s: %s\n", name, test_failures ? "FAILED" : "ok");
+    return test_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+#endif
@@ -0,0 +1,161 @@
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <new>
+#include <initializer_list>
+
+#include "test.h"
+#include "circular.h"
+#include "delay.h"
+
+/*
+    CircularCursor and the DelayLine loop built on it, against plain
+    masked indexing. Built twice, with the software cursor and with
+    DSP_INTERP=1 on a model of the interpolators (host/hardware/interp.h):
+      - every mask from a one word line to 2^28 words, starting at
+        offsets inside, at the edge of and beyond the buffer, for more
+        than one lap, next() and position() must follow the reference
+      - both units at once, as DelayLine uses them, must not disturb
+        each other, a new cursor on a unit starts over
+      - DelayLine in blocks of 1, 7 and 32 must return the input
+        delayed exactly, at zero, the largest and odd delays, after
+        a retune's crossfade too
+    Also prints the host time of DelayLine::process per sample, the
+    target's is printed by the selftest.
+*/
+
+#if DSP_INTERP
+#define KERNEL "interpolator"
+#else
+#define KERNEL "software"
+#endif
+
+#ifndef MAP_32BIT
+#define MAP_32BIT (0)
+#endif
+
+/* the interpolators add 32 bit addresses, keep every buffer below 4GB */
+static void *low_alloc(size_t bytes)
+{
+    void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (p == MAP_FAILED)
+    {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static void test_cursor(int32_t *line)
+{
+    /* up to 2^28 words, the byte offsets stay within 32 bit addresses */
+    for (uint32_t bits = 0; bits <= 28; bits++)
+    {
+        uint32_t mask = (1u << bits) - 1;
+        uint32_t laps = mask < 64 ? 3 * (mask + 1) : 200;
+        for (uint32_t start : {0u, 1u, mask, mask + 1, mask + 5, 0xFFFFFFFFu})
+        {
+            /* unit 1 walks from another offset at the same time */
+            CircularCursor a(0, line, mask, start);
+            CircularCursor b(1, line, mask, start + 3);
+            bool ok = true;
+            for (uint32_t i = 0; i < laps && ok; i++)
+            {
+                uint32_t expected = (start + i) & mask;
+                ok &= a.position() == expected;
+                ok &= a.next() == line + expected;
+                ok &= b.position() == ((start + 3 + i) & mask);
+                ok &= b.next() == line + ((start + 3 + i) & mask);
+            }
+            CHECK(ok, "mask 0x%x from %u walks off the reference", mask, start);
+        }
+    }
+
+    /* a new cursor on a unit drops the old one's state */
+    CircularCursor first(0, line, 7, 2);
+    first.next();
+    CircularCursor second(0, line + 8, 15, 11);
+    CHECK(second.position() == 11 && second.next() == line + 8 + 11, "new cursor kept the old state");
+}
+
+#define LENGTH (16384)
+
+static void test_delay(DelayArena &arena, const int32_t *x, int32_t *y)
+{
+    for (uint32_t maxDelay : {0u, 1u, 31u, 32u, 33u, 1000u, (uint32_t)DELAY_ARENA_WORDS - 1})
+    {
+        for (uint32_t delay : {0u, 1u, maxDelay / 3, maxDelay})
+        {
+            delay = delay > maxDelay ? maxDelay : delay;
+            for (size_t block : {(size_t)1, (size_t)7, (size_t)32})
+            {
+                arena.reset();
+                DelayLine d;
+                CHECK(d.begin(arena, maxDelay, delay), "no line of %u", maxDelay);
+
+                /* steady state, then a retune and its crossfade */
+                uint32_t retune = maxDelay - delay / 2;
+                bool ok = true;
+                for (size_t i = 0; i < LENGTH; i += block)
+                {
+                    size_t n = LENGTH - i < block ? LENGTH - i : block;
+                    if (i >= LENGTH / 2 && i < LENGTH / 2 + block)
+                    {
+                        d.setDelay(retune);
+                    }
+                    d.process(x + i, y + i, n);
+                }
+                for (size_t i = 0; i < LENGTH / 2; i++)
+                {
+                    ok &= y[i] == (i >= delay ? x[i - delay] : 0);
+                }
+                size_t settled = ((LENGTH / 2 + block - 1) / block) * block + DELAY_CROSSFADE;
+                for (size_t i = settled; i < LENGTH; i++)
+                {
+                    ok &= y[i] == (i >= retune ? x[i - retune] : 0);
+                }
+                CHECK(ok, "line of %u, delay %u then %u, blocks of %zu: wrong output", maxDelay, delay, retune,
+                      block);
+            }
+        }
+    }
+}
+
+static void bench(DelayArena &arena, const int32_t *x, int32_t *y)
+{
+    arena.reset();
+    DelayLine d;
+    d.begin(arena, 1000, 480);
+    uint64_t best = UINT64_MAX;
+    for (int run = 0; run < 200; run++)
+    {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        for (size_t i = 0; i < LENGTH; i += 32)
+        {
+            d.process(x + i, y + i, 32);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        uint64_t ns = (t1.tv_sec - t0.tv_sec) * 1000000000ull + t1.tv_nsec - t0.tv_nsec;
+        best = ns < best ? ns : best;
+    }
+    printf("DelayLine, %s cursor on the host: %.2fns per sample\n", KERNEL, (double)best / LENGTH);
+}
+
+int main()
+{
+    int32_t *line = (int32_t *)low_alloc(64 * sizeof(int32_t));
+    DelayArena *arena = new (low_alloc(sizeof(DelayArena))) DelayArena();
+    int32_t *x = (int32_t *)low_alloc(2 * LENGTH * sizeof(int32_t));
+    int32_t *y = x + LENGTH;
+    for (size_t i = 0; i < LENGTH; i++)
+    {
+        x[i] = (int32_t)(i * 2654435761u) >> 8;
+    }
+
+    test_cursor(line);
+    test_delay(*arena, x, y);
+    bench(*arena, x, y);
+    return test_result("circular " KERNEL);
+}
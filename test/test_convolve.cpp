@@ -0,0 +1,319 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <initializer_list>
+
+#include "test.h"
+#include "convolve.h"
+
+/*
+    Convolver against direct convolution in double precision:
+      - noise through 512 and 2048 tap responses at -1, -20 and
+        -60dBFS, SNR over the whole run
+      - single taps on either side of every kind of partition edge,
+        driven by impulses at either end of a block, must land on the
+        right sample with the right gain and nothing elsewhere
+      - tap gains from 2^-12 to 1.9 and inputs down to a few LSB keep
+        their scale, anything over CONVOLVE_LIMIT saturates
+      - silence in gives silence out, reset() forgets the history and
+        a loaded response only runs after swap()
+    Also prints the host time of the worst case block (every partition
+    loaded, no silence), the target's is printed by the selftest.
+*/
+
+/* graph level full scale */
+#define FULL_SCALE (1 << 23)
+/* SNR against the direct convolution, quiet outputs may reach the floor instead */
+#define CONVOLVE_SNR (72.0)
+#define CONVOLVE_FLOOR (1.0)
+/* error of a single tap, relative to its output peak */
+#define CONVOLVE_IMPULSE_ERROR (1.0 / 8192)
+
+static uint32_t noise_state = 1;
+
+static double noise()
+{
+    noise_state = noise_state * 1664525 + 1013904223;
+    return (double)(int32_t)noise_state / 2147483648.0;
+}
+
+static void convolver_load(Convolver &c, const float *h, size_t taps)
+{
+    size_t partitions = (taps + CONVOLVE_BLOCK - 1) / CONVOLVE_BLOCK;
+    for (size_t k = 0; k < partitions; k++)
+    {
+        size_t n = taps - k * CONVOLVE_BLOCK;
+        c.load(k, h + k * CONVOLVE_BLOCK, n > CONVOLVE_BLOCK ? CONVOLVE_BLOCK : n);
+    }
+    c.swap(partitions);
+}
+
+/* runs x through the engine block by block */
+static void convolver_run(Convolver &c, const int32_t *x, int32_t *y, size_t length)
+{
+    for (size_t i = 0; i < length; i += CONVOLVE_BLOCK)
+    {
+        c.process(x + i, y + i);
+    }
+}
+
+static double direct(const float *h, size_t taps, const int32_t *x, size_t n)
+{
+    double y = 0;
+    for (size_t k = 0; k < taps && k <= n; k++)
+    {
+        y += (double)h[k] * x[n - k];
+    }
+    return y;
+}
+
+static Convolver c;
+static float h[CONVOLVE_MAX_TAPS];
+
+#define LENGTH (4 * CONVOLVE_MAX_TAPS)
+static int32_t x[LENGTH], y[LENGTH];
+
+/* of y against the direct convolution of x, rounded to the integer output,
+    also the RMS error in LSB */
+static double run_snr(size_t taps, size_t length, double *rms)
+{
+    double signal = 0, error = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        double r = direct(h, taps, x, i);
+        double e = y[i] - nearbyint(r);
+        signal += r * r;
+        error += e * e;
+    }
+    *rms = sqrt(error / length);
+    return error ? 10.0 * log10(signal / error) : INFINITY;
+}
+
+static void test_noise()
+{
+    for (size_t taps : {512, CONVOLVE_MAX_TAPS})
+    {
+        /* decaying noise, 0.5 RMS gain so -1dBFS noise stays below the limit */
+        double energy = 0;
+        for (size_t k = 0; k < taps; k++)
+        {
+            h[k] = (float)(noise() * exp(-6.0 * k / taps));
+            energy += (double)h[k] * h[k];
+        }
+        for (size_t k = 0; k < taps; k++)
+        {
+            h[k] = (float)(h[k] * 0.5 / sqrt(energy));
+        }
+        convolver_load(c, h, taps);
+
+        for (double dB : {-1.0, -20.0, -60.0})
+        {
+            double level = pow(10.0, dB / 20.0) * FULL_SCALE;
+            for (size_t i = 0; i < LENGTH; i++)
+            {
+                x[i] = (int32_t)lrint(noise() * level);
+            }
+            c.reset();
+            convolver_run(c, x, y, LENGTH);
+
+            double rms;
+            double snr = run_snr(taps, LENGTH, &rms);
+            printf("%4zu taps %5.0fdBFS noise: snr %.1fdB, error %.2f LSB rms\n", taps, dB, snr, rms);
+            CHECK(snr >= CONVOLVE_SNR || rms <= CONVOLVE_FLOOR, "%zu taps at %.0fdBFS: snr %.1fdB, %.2f LSB rms",
+                  taps, dB, snr, rms);
+        }
+    }
+}
+
+static void test_edges()
+{
+    /* partition edges, the first and the last tap of the response */
+    const size_t positions[] = {0, 1, CONVOLVE_BLOCK - 1, CONVOLVE_BLOCK, CONVOLVE_BLOCK + 1,
+                                2 * CONVOLVE_BLOCK - 1, 2 * CONVOLVE_BLOCK, 1000,
+                                CONVOLVE_MAX_TAPS - CONVOLVE_BLOCK, CONVOLVE_MAX_TAPS - 1};
+    const size_t impulses[] = {0, CONVOLVE_BLOCK - 1, 3 * CONVOLVE_BLOCK + 5};
+    const size_t length = CONVOLVE_MAX_TAPS + 4 * CONVOLVE_BLOCK;
+
+    for (size_t t : positions)
+    {
+        memset(h, 0, sizeof(h));
+        h[t] = 0.5f;
+        convolver_load(c, h, CONVOLVE_MAX_TAPS);
+        for (size_t p : impulses)
+        {
+            const int32_t amplitude = FULL_SCALE / 2;
+            memset(x, 0, sizeof(x));
+            x[p] = amplitude;
+            c.reset();
+            convolver_run(c, x, y, length);
+
+            double expected = 0.5 * amplitude;
+            double worst = 0;
+            for (size_t i = 0; i < length; i++)
+            {
+                double e = fabs(y[i] - (i == p + t ? expected : 0.0));
+                worst = e > worst ? e : worst;
+            }
+            CHECK(worst <= expected * CONVOLVE_IMPULSE_ERROR, "tap %zu, impulse at %zu: error %.0f LSB of %.0f",
+                  t, p, worst, expected);
+        }
+    }
+}
+
+static void test_scale()
+{
+    const size_t length = 16 * CONVOLVE_BLOCK;
+
+    /* one tap in the middle of a partition, input at -6dBFS */
+    for (double g : {1.9, 1.0, 0.5, 1.0 / 3, 1.0 / 256, 1.0 / 4096})
+    {
+        memset(h, 0, sizeof(h));
+        h[CONVOLVE_BLOCK + 7] = (float)g;
+        convolver_load(c, h, 2 * CONVOLVE_BLOCK);
+        for (size_t i = 0; i < length; i++)
+        {
+            x[i] = (int32_t)lrint(noise() * FULL_SCALE / 2);
+        }
+        c.reset();
+        convolver_run(c, x, y, length);
+
+        double rms;
+        double snr = run_snr(2 * CONVOLVE_BLOCK, length, &rms);
+        CHECK(snr >= CONVOLVE_SNR || rms <= CONVOLVE_FLOOR, "tap gain %g: snr %.1fdB, %.2f LSB rms", g, snr, rms);
+    }
+
+    /* every partition adds in phase at DC, the sum needs all the headroom */
+    for (size_t k = 0; k < CONVOLVE_MAX_TAPS; k++)
+    {
+        h[k] = 1.0f / CONVOLVE_MAX_TAPS;
+    }
+    convolver_load(c, h, CONVOLVE_MAX_TAPS);
+    for (size_t i = 0; i < LENGTH; i++)
+    {
+        x[i] = (i / 3000) & 1 ? FULL_SCALE - 1 : 0;
+    }
+    c.reset();
+    convolver_run(c, x, y, LENGTH);
+    double rms;
+    double snr = run_snr(CONVOLVE_MAX_TAPS, LENGTH, &rms);
+    CHECK(snr >= CONVOLVE_SNR || rms <= CONVOLVE_FLOOR, "%d tap average: snr %.1fdB, %.2f LSB rms",
+          CONVOLVE_MAX_TAPS, snr, rms);
+
+    /* a few LSB of input keep their value, block floating point */
+    memset(h, 0, sizeof(h));
+    h[0] = 1.0f;
+    convolver_load(c, h, CONVOLVE_BLOCK);
+    int32_t worst = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        x[i] = (int32_t)lrint(noise() * 8);
+    }
+    c.reset();
+    convolver_run(c, x, y, length);
+    for (size_t i = 0; i < length; i++)
+    {
+        int32_t e = abs(y[i] - x[i]);
+        worst = e > worst ? e : worst;
+    }
+    CHECK(worst <= 1, "unity response on 8 LSB noise: error %d LSB", worst);
+
+    /* +12dB on a full scale square saturates, never wraps */
+    h[0] = 4.0f;
+    convolver_load(c, h, CONVOLVE_BLOCK);
+    for (size_t i = 0; i < length; i++)
+    {
+        x[i] = (i / 50) & 1 ? FULL_SCALE - 1 : -FULL_SCALE;
+    }
+    c.reset();
+    convolver_run(c, x, y, length);
+    bool limited = true;
+    for (size_t i = 0; i < length; i++)
+    {
+        limited &= y[i] == (x[i] > 0 ? CONVOLVE_LIMIT : -CONVOLVE_LIMIT);
+    }
+    CHECK(limited, "+12dB on a full scale square not held at CONVOLVE_LIMIT");
+}
+
+static void test_state()
+{
+    const size_t length = 8 * CONVOLVE_BLOCK;
+
+    /* the response of test_scale is running, a new one waits for swap() */
+    memset(h, 0, sizeof(h));
+    h[0] = 1.0f;
+    convolver_load(c, h, CONVOLVE_BLOCK);
+    memset(h, 0, sizeof(h));
+    h[CONVOLVE_BLOCK] = 0.25f;
+    c.load(0, h, CONVOLVE_BLOCK);
+    c.load(1, h + CONVOLVE_BLOCK, CONVOLVE_BLOCK);
+    CHECK(c.partitions() == 1, "%zu partitions before swap", c.partitions());
+
+    memset(x, 0, sizeof(x));
+    x[0] = FULL_SCALE / 2;
+    c.reset();
+    convolver_run(c, x, y, length);
+    CHECK(y[0] == FULL_SCALE / 2 && y[CONVOLVE_BLOCK] == 0, "loading changed the running response");
+
+    c.swap(2);
+    c.reset();
+    convolver_run(c, x, y, length);
+    CHECK(y[0] == 0 && abs(y[CONVOLVE_BLOCK] - FULL_SCALE / 8) <= 1, "swapped response %d %d",
+          y[0], y[CONVOLVE_BLOCK]);
+
+    /* a reset drops the tail of the impulse still in the delay line */
+    c.process(x, y);
+    c.reset();
+    int32_t zero[CONVOLVE_BLOCK] = {};
+    bool silent = true;
+    for (size_t b = 0; b < 4; b++)
+    {
+        c.process(zero, y);
+        for (size_t i = 0; i < CONVOLVE_BLOCK; i++)
+        {
+            silent &= y[i] == 0;
+        }
+    }
+    CHECK(silent, "output after reset and silence");
+}
+
+static void bench()
+{
+    for (size_t k = 0; k < CONVOLVE_MAX_TAPS; k++)
+    {
+        h[k] = (float)(noise() * 0.01);
+    }
+    convolver_load(c, h, CONVOLVE_MAX_TAPS);
+    for (size_t i = 0; i < LENGTH; i++)
+    {
+        x[i] = (int32_t)lrint(noise() * FULL_SCALE / 4);
+    }
+
+    /* the delay line fills during the first pass */
+    c.reset();
+    convolver_run(c, x, y, LENGTH);
+    uint64_t worst = 0, total = 0;
+    const size_t blocks = LENGTH / CONVOLVE_BLOCK;
+    for (size_t b = 0; b < blocks; b++)
+    {
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        c.process(x + b * CONVOLVE_BLOCK, y + b * CONVOLVE_BLOCK);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        uint64_t ns = (t1.tv_sec - t0.tv_sec) * 1000000000ull + t1.tv_nsec - t0.tv_nsec;
+        worst = ns > worst ? ns : worst;
+        total += ns;
+    }
+    printf("%d taps on the host: worst %lluns, mean %lluns per block of %d\n", CONVOLVE_MAX_TAPS,
+           (unsigned long long)worst, (unsigned long long)(total / blocks), CONVOLVE_BLOCK);
+}
+
+int main()
+{
+    test_noise();
+    test_edges();
+    test_scale();
+    test_state();
+    bench();
+    return test_result("convolve");
+}
@@ -0,0 +1,248 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <initializer_list>
+
+#include "test.h"
+#include "fft.h"
+#include "spectrum.h"
+
+/*
+    fft_real and fft_real_inverse against a naive DFT in double
+    precision, Q15 and Q31, every size from FFT_MIN_SIZE to
+    FFT_MAX_SIZE:
+      - noise and a tone, SNR over all bins, in the documented layout
+        and 1/n scale
+      - a full scale cosine on a bin reads half full scale there
+      - the inverse of a spectrum against the inverse DFT
+      - unsupported sizes are refused and leave the data alone
+    fft_hann must match the raised cosine to an LSB. Also prints the
+    host time of a Q31 transform at each analyzer size, the target's is
+    printed by the selftest and by the analyzer with every result.
+*/
+
+/* Q31 is limited by the Q15 twiddles, Q15 by the halving at every
+    stage, it loses 3dB per doubling of the size */
+#define FFT_SNR_31 (85.0)
+#define FFT_SNR_15 (58.0) // at FFT_MIN_SIZE
+
+static uint32_t noise_state = 1;
+
+static double noise()
+{
+    noise_state = noise_state * 1664525 + 1013904223;
+    return (double)(int32_t)noise_state / 2147483648.0;
+}
+
+template <typename T>
+struct format;
+
+template <>
+struct format<int16_t>
+{
+    static constexpr double fullScale = 32768.0;
+    static double snr(size_t n) { return FFT_SNR_15 - 3.0 * log2((double)n / FFT_MIN_SIZE); }
+    static constexpr const char *name = "Q15";
+};
+
+template <>
+struct format<int32_t>
+{
+    static constexpr double fullScale = 2147483648.0;
+    static double snr(size_t) { return FFT_SNR_31; }
+    static constexpr const char *name = "Q31";
+};
+
+static double re[FFT_MAX_SIZE / 2 + 1], im[FFT_MAX_SIZE / 2 + 1];
+
+/* DFT of n real samples scaled by 1/n, bins 0..n/2 */
+static void dft(const double *x, size_t n)
+{
+    for (size_t k = 0; k <= n / 2; k++)
+    {
+        double r = 0, i = 0;
+        for (size_t t = 0; t < n; t++)
+        {
+            /* exact phase index, no drift over long sums */
+            double a = 2 * M_PI * (double)((k * t) % n) / n;
+            r += x[t] * cos(a);
+            i -= x[t] * sin(a);
+        }
+        re[k] = r / n;
+        im[k] = i / n;
+    }
+}
+
+/* a spectrum in fft_real's layout against re, im */
+template <typename T>
+static double spectrum_snr(const T *data, size_t n)
+{
+    double signal = 0, error = 0;
+    for (size_t k = 0; k <= n / 2; k++)
+    {
+        double r, i;
+        if (k == 0 || k == n / 2)
+        {
+            r = data[k ? 1 : 0];
+            i = 0;
+        }
+        else
+        {
+            r = data[2 * k];
+            i = data[2 * k + 1];
+        }
+        signal += re[k] * re[k] + im[k] * im[k];
+        error += (r - re[k]) * (r - re[k]) + (i - im[k]) * (i - im[k]);
+    }
+    return error ? 10.0 * log10(signal / error) : INFINITY;
+}
+
+template <typename T>
+static void test_forward(size_t n)
+{
+    static T data[FFT_MAX_SIZE];
+    static double x[FFT_MAX_SIZE];
+    const double fs = format<T>::fullScale;
+
+    /* noise at -1dBFS, a -6dBFS tone between bins with some noise under it */
+    for (int signal = 0; signal < 2; signal++)
+    {
+        for (size_t t = 0; t < n; t++)
+        {
+            double v = signal ? 0.5 * sin(2 * M_PI * 10.3 * t / n) + 0.01 * noise() : 0.89 * noise();
+            data[t] = (T)lrint(v * (fs - 1));
+            x[t] = data[t];
+        }
+        dft(x, n);
+        CHECK(fft_real(data, n), "%s n %zu refused", format<T>::name, n);
+        double snr = spectrum_snr(data, n);
+        CHECK(snr >= format<T>::snr(n), "%s n %zu %s: snr %.1fdB", format<T>::name, n, signal ? "tone" : "noise", snr);
+        if (n == FFT_MIN_SIZE || n == FFT_MAX_SIZE)
+        {
+            printf("%s %4zu point %s: snr %.1fdB\n", format<T>::name, n, signal ? "tone" : "noise", snr);
+        }
+    }
+
+    /* full scale cosine on bin n/8, half full scale in that bin */
+    for (size_t t = 0; t < n; t++)
+    {
+        data[t] = (T)lrint(cos(2 * M_PI * (double)((t * (n / 8)) % n) / n) * (fs - 1));
+    }
+    fft_real(data, n);
+    double bin = data[2 * (n / 8)] / (fs / 2);
+    CHECK(fabs(20 * log10(bin)) < 0.01, "%s n %zu: full scale cosine at %.3fdB of half scale",
+          format<T>::name, n, 20 * log10(bin));
+}
+
+template <typename T>
+static void test_inverse(size_t n)
+{
+    static T data[FFT_MAX_SIZE];
+    static double x[FFT_MAX_SIZE];
+    const double fs = format<T>::fullScale;
+
+    /* bins of noise within half full scale, DC and Nyquist real */
+    for (size_t i = 0; i < n; i++)
+    {
+        data[i] = (T)lrint(noise() * (fs / 2 - 1) / sqrt(2.0));
+    }
+    for (size_t t = 0; t < n; t++)
+    {
+        double v = data[0] + ((t & 1) ? -data[1] : data[1]);
+        for (size_t k = 1; k < n / 2; k++)
+        {
+            double a = 2 * M_PI * (double)((k * t) % n) / n;
+            v += 2 * (data[2 * k] * cos(a) - data[2 * k + 1] * sin(a));
+        }
+        x[t] = v / n;
+    }
+
+    CHECK(fft_real_inverse(data, n), "%s n %zu inverse refused", format<T>::name, n);
+    double signal = 0, error = 0;
+    for (size_t t = 0; t < n; t++)
+    {
+        signal += x[t] * x[t];
+        error += (data[t] - x[t]) * (data[t] - x[t]);
+    }
+    double snr = 10.0 * log10(signal / error);
+    CHECK(snr >= format<T>::snr(n), "%s n %zu inverse: snr %.1fdB", format<T>::name, n, snr);
+    if (n == FFT_MIN_SIZE || n == FFT_MAX_SIZE)
+    {
+        printf("%s %4zu point inverse: snr %.1fdB\n", format<T>::name, n, snr);
+    }
+}
+
+template <typename T>
+static void test_sizes()
+{
+    T data[FFT_MIN_SIZE];
+    for (size_t n : {(size_t)0, (size_t)FFT_MIN_SIZE / 2, (size_t)FFT_MIN_SIZE + 1, (size_t)FFT_MAX_SIZE * 2})
+    {
+        for (size_t i = 0; i < FFT_MIN_SIZE; i++)
+        {
+            data[i] = (T)i;
+        }
+        bool refused = !fft_real(data, n) && !fft_real_inverse(data, n);
+        for (size_t i = 0; i < FFT_MIN_SIZE; i++)
+        {
+            refused &= data[i] == (T)i;
+        }
+        CHECK(refused, "%s n %zu not refused untouched", format<T>::name, n);
+    }
+}
+
+static void test_hann()
+{
+    for (size_t n : {(size_t)FFT_MIN_SIZE, (size_t)SPECTRUM_MIN_SIZE, (size_t)FFT_MAX_SIZE})
+    {
+        int worst = 0;
+        for (size_t i = 0; i < n; i++)
+        {
+            int expected = (int)lrint(32767 * 0.5 * (1 - cos(2 * M_PI * i / n)));
+            int e = abs(fft_hann(i, n) - expected);
+            worst = e > worst ? e : worst;
+        }
+        CHECK(worst <= 1, "hann n %zu: %d LSB off", n, worst);
+    }
+}
+
+static void bench()
+{
+    static int32_t data[FFT_MAX_SIZE];
+    for (size_t n = SPECTRUM_MIN_SIZE; n <= FFT_MAX_SIZE; n *= 2)
+    {
+        const int runs = 200;
+        uint64_t best = UINT64_MAX;
+        for (int r = 0; r < runs; r++)
+        {
+            for (size_t t = 0; t < n; t++)
+            {
+                data[t] = (int32_t)(noise() * (1 << 30));
+            }
+            struct timespec t0, t1;
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            fft_real(data, n);
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            uint64_t ns = (t1.tv_sec - t0.tv_sec) * 1000000000ull + t1.tv_nsec - t0.tv_nsec;
+            best = ns < best ? ns : best;
+        }
+        printf("Q31 %4zu point on the host: %lluns\n", n, (unsigned long long)best);
+    }
+}
+
+int main()
+{
+    for (size_t n = FFT_MIN_SIZE; n <= FFT_MAX_SIZE; n *= 2)
+    {
+        test_forward<int16_t>(n);
+        test_forward<int32_t>(n);
+        test_inverse<int16_t>(n);
+        test_inverse<int32_t>(n);
+    }
+    test_sizes<int16_t>();
+    test_sizes<int32_t>();
+    test_hann();
+    bench();
+    return test_result("fft");
+}
@@ -0,0 +1,494 @@
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <complex>
+
+#include "test.h"
+#include "iir.h"
+#include "packed16.h"
+
+/*
+    filter kernels against the float design they were quantized from,
+    over low cutoffs, high Q and shelves, at the graph rate, a low rate
+    and the packed 16 bit rate. The reference is frozen in this file, a double
+    precision direct form 1 of the unquantized design, so it does not
+    move with the quantizer or the kernels:
+      - IIR::filter follows the reference on a log sweep within
+        FILTERS_SNR_32, and decays to a few LSB once the sweep stops
+      - its steady state gain at fc/2, fc and 2fc is the design's
+      - IIR::filterBlock matches IIR::filter bit for bit, in the full
+        and in the economy variant, fed in uneven pieces
+      - the economy variant holds the design's gain within
+        IIR_ECONOMY_MAX_DB
+      - StereoIIR16 follows its own quantized coefficients within
+        FILTERS_SNR_16 on both lanes and the design within
+        FILTERS_SNR_16_DESIGN, at the packed rate, as do the stages of
+        the packed chain
+      - a full scale impulse, full scale white noise and a full scale
+        square never wrap either kernel: IIR stays within
+        FILTERS_ERROR_32 of the reference on every sample, StereoIIR16
+        within FILTERS_ERROR_16 of one saturated step of the reference
+*/
+
+/* sweep error against the reference, dB below the sweep */
+#define FILTERS_SNR_32 (70.0)
+/* the 16 bit path against a full scale sine, its sweep is lowered by
+    the peak gain; a 20Hz lowpass at Q10 reaches 41.6dB */
+#define FILTERS_SNR_16 (38.0)
+#define FILTERS_SNR_16_DESIGN (35.0)
+/* steady state gain error of the full kernel, dB */
+#define FILTERS_GAIN_DB (0.01)
+/* largest output once the input went silent and the poles decayed, LSB,
+    the first order error feedback leaves a deadband at high Q and next
+    to z = 1, where the fed back error leaks away by hundredths of an LSB
+    (15 LSB for a 20Hz shelf on the 16 bit path at 96kHz) */
+#define FILTERS_LIMIT_CYCLE (24)
+/* samples the tail is watched for */
+#define FILTERS_TAIL (1024)
+/* largest error of a single sample on the full scale vectors, a wrapped
+    accumulator is off by about full scale or more: IIR in dB below full
+    scale or the peak of the reference if higher, StereoIIR16 in LSB of
+    one step of its sum */
+#define FILTERS_ERROR_32 (-60.0)
+#define FILTERS_ERROR_16 (2.0)
+/* samples of each full scale vector */
+#define FILTERS_VECTOR (8192)
+
+static const char *typeNames[] = {"lowpass", "highpass", "bandpass", "notch", "peak", "lowshelf", "highshelf"};
+static const float qualities[] = {0.5, 0.707, 2, 10};
+static const float gains[] = {-12, 12};
+
+typedef struct
+{
+    float Fs;
+    float cutoffs[5];
+    bool packed; // StereoIIR16 of the packed build, else IIR
+} rate_t;
+
+/* integer cutoffs keep fc/2 on a whole number of cycles per second */
+static const rate_t rates[] = {
+    {48000, {20, 40, 100, 1000, 10000}, false},
+    {6000, {20, 40, 100, 500, 2000}, false},
+    {96000, {20, 40, 100, 1000, 10000}, true},
+};
+
+/* graph level, -12dBFS of 24 bit samples, +20dB of resonance still fits */
+static const int32_t amplitude = 1 << (IIR_SAMPLE_BITS - 3);
+/* packed path level, the output peaks at -6dBFS of 16 bit samples */
+static const int32_t amplitude16 = 1 << (IIR16_SAMPLE_BITS - 2);
+
+/* the frozen reference, in the design's sign convention */
+typedef struct
+{
+    double b[3], a[2];
+    double x[2], y[2];
+    double limit; // the output saturates here, 0 for none
+} reference_t;
+
+static void reference_init(reference_t &r, double b0, double b1, double b2, double a1, double a2)
+{
+    memset(&r, 0, sizeof(r));
+    r.b[0] = b0;
+    r.b[1] = b1;
+    r.b[2] = b2;
+    r.a[0] = a1;
+    r.a[1] = a2;
+}
+
+static void reference_init(reference_t &r, const biquad_design_t &d)
+{
+    reference_init(r, d.a0, d.a1, d.a2, d.b1, d.b2);
+}
+
+static void reference_init(reference_t &r, const biquad_coeffs_t &c, double scale)
+{
+    reference_init(r, c.b[0] / scale, c.b[1] / scale, c.b[2] / scale, -c.a[0] / scale, -c.a[1] / scale);
+}
+
+static double reference_filter(reference_t &r, double s)
+{
+    double y = r.b[0] * s + r.b[1] * r.x[0] + r.b[2] * r.x[1] - r.a[0] * r.y[0] - r.a[1] * r.y[1];
+    if (r.limit > 0)
+    {
+        y = fmin(fmax(y, -r.limit - 1), r.limit);
+    }
+    r.x[1] = r.x[0];
+    r.x[0] = s;
+    r.y[1] = r.y[0];
+    r.y[0] = y;
+    return y;
+}
+
+static double response(const biquad_design_t &d, double f, double Fs)
+{
+    std::complex<double> z1 = std::polar(1.0, -2 * M_PI * f / Fs);
+    std::complex<double> z2 = z1 * z1;
+    return abs(((double)d.a0 + (double)d.a1 * z1 + (double)d.a2 * z2) / (1.0 + (double)d.b1 * z1 + (double)d.b2 * z2));
+}
+
+/* largest gain of the design, the 16 bit path saturates beyond full scale */
+static double peakGain(const biquad_design_t &d, double Fs)
+{
+    /* log spaced from 1Hz, a Q10 bass resonance is only a few Hz wide */
+    double peak = 0;
+    for (int i = 0; i <= 4096; i++)
+    {
+        peak = fmax(peak, response(d, pow(Fs / 2, i / 4096.0), Fs));
+    }
+    return peak;
+}
+
+/* samples until the slowest pole of the design has decayed by 120dB,
+    twice over for the n r^n of a double pole */
+static size_t settling(const biquad_design_t &d)
+{
+    double b1 = d.b1, b2 = d.b2;
+    double r;
+    if (b1 * b1 < 4 * b2)
+    {
+        r = sqrt(b2);
+    }
+    else
+    {
+        double root = sqrt(b1 * b1 - 4 * b2);
+        r = fmax(fabs(-b1 + root), fabs(-b1 - root)) / 2;
+    }
+    return r > 0 ? 2 * (size_t)(log(1e-6) / log(r)) + 64 : 64;
+}
+
+/* log sweep 20Hz to Nyquist over one second, then silence */
+typedef struct
+{
+    double phase;
+    float Fs;
+} sweep_t;
+
+static double sweep_sample(sweep_t &s, size_t n)
+{
+    size_t length = (size_t)s.Fs;
+    if (n >= length)
+    {
+        return 0;
+    }
+    s.phase += 2 * M_PI * 20.0 * pow(s.Fs / 2 / 20.0, (double)n / length) / s.Fs;
+    return sin(s.phase);
+}
+
+/* full scale vectors, a wrapped accumulator shows up on the first of them that overflows it */
+typedef enum
+{
+    vector_impulse,
+    vector_noise,
+    vector_square,
+    vector_count
+} vector_t;
+
+static const char *vectorNames[] = {"impulse", "white noise", "square"};
+
+static uint32_t noise_state;
+
+/* -1..1, the square at fc so a resonance rings on every edge */
+static double vector_sample(vector_t v, size_t n, float fc, float Fs)
+{
+    switch (v)
+    {
+    case vector_impulse:
+        return n == 0 ? 1 : 0;
+    case vector_noise:
+        noise_state ^= noise_state << 13;
+        noise_state ^= noise_state >> 17;
+        noise_state ^= noise_state << 5;
+        return (int32_t)noise_state / 2147483648.0;
+    default:
+        return fmod(n * fc / Fs, 1.0) < 0.5 ? 1 : -1;
+    }
+}
+
+/* filterBlock in uneven pieces, in place, to catch state hand-over errors */
+static const size_t pieces[] = {1, 7, 24};
+#define FILTERS_BLOCK (32)
+
+static double snr(double signal, double noise)
+{
+    return noise == 0 ? INFINITY : 10 * log10(signal / noise);
+}
+
+static void test_sweep(const char *name, const biquad_design_t &d, float Fs)
+{
+    biquad_coeffs_t c = IIR::quantize(d);
+    IIR single, block, economySingle, economyBlock;
+    single.setCoefficients(c);
+    block.setCoefficients(c);
+    economySingle.setCoefficients(c);
+    economyBlock.setCoefficients(c);
+    economySingle.setEconomy(true);
+    economyBlock.setEconomy(true);
+    reference_t r;
+    reference_init(r, d);
+
+    sweep_t sweep = {0, Fs};
+    size_t length = (size_t)Fs;
+    size_t silent = length + settling(d);
+    double signal = 0, noise = 0;
+    int32_t tail = 0;
+    bool exact = true;
+    int32_t in[FILTERS_BLOCK], out[FILTERS_BLOCK], economyIn[FILTERS_BLOCK], economyOut[FILTERS_BLOCK];
+    for (size_t n = 0; n < silent + FILTERS_TAIL; n += FILTERS_BLOCK)
+    {
+        for (size_t i = 0; i < FILTERS_BLOCK; i++)
+        {
+            double s = amplitude * sweep_sample(sweep, n + i);
+            in[i] = (int32_t)lrint(s);
+            out[i] = in[i];
+            single.filter(&out[i]);
+            economyIn[i] = in[i];
+            economyOut[i] = in[i];
+            economySingle.filter(&economyOut[i]);
+
+            double e = out[i] - reference_filter(r, in[i]);
+            if (n + i < length)
+            {
+                signal += s * s;
+                noise += e * e;
+            }
+            else if (n + i >= silent)
+            {
+                tail = abs(out[i]) > tail ? abs(out[i]) : tail;
+            }
+        }
+
+        size_t i = 0;
+        for (size_t p = 0; p < sizeof(pieces) / sizeof(pieces[0]); p++)
+        {
+            block.filterBlock(&in[i], &in[i], pieces[p]);
+            economyBlock.filterBlock(&economyIn[i], &economyIn[i], pieces[p]);
+            i += pieces[p];
+        }
+        exact &= !memcmp(in, out, sizeof(in)) && !memcmp(economyIn, economyOut, sizeof(economyIn));
+    }
+
+    CHECK(snr(signal, noise) >= FILTERS_SNR_32, "%s: IIR sweep snr %.1fdB, Q%d", name, snr(signal, noise), c.shift);
+    CHECK(tail <= FILTERS_LIMIT_CYCLE, "%s: IIR limit cycle of %d LSB", name, tail);
+    CHECK(exact, "%s: IIR::filterBlock differs from IIR::filter", name);
+}
+
+/* steady state gain of a kernel to a tone of whole cycles per second */
+static double toneGain(IIR &f, double tone, float Fs, size_t settle)
+{
+    size_t length = (size_t)Fs;
+    double re = 0, im = 0;
+    for (size_t n = 0; n < settle + length; n++)
+    {
+        double phase = 2 * M_PI * fmod(tone * n, Fs) / Fs;
+        int32_t s = (int32_t)lrint(amplitude * sin(phase));
+        f.filter(&s);
+        if (n >= settle)
+        {
+            re += s * sin(phase);
+            im += s * cos(phase);
+        }
+    }
+    return 2 * sqrt(re * re + im * im) / length / amplitude;
+}
+
+static void test_tones(const char *name, const biquad_design_t &d, float Fs, float fc)
+{
+    biquad_coeffs_t c = IIR::quantize(d);
+    size_t settle = settling(d);
+
+    const double tones[] = {fc / 2, fc, fc * 2};
+    for (double tone : tones)
+    {
+        if (tone >= Fs * 0.45)
+        {
+            continue;
+        }
+        IIR full, economy;
+        full.setCoefficients(c);
+        economy.setCoefficients(c);
+        economy.setEconomy(true);
+        double ideal = response(d, tone, Fs);
+        double gain = toneGain(full, tone, Fs, settle);
+        /* deep in a stopband or a notch the error is held absolute, at -100dB */
+        double db = 20 * log10(gain / ideal);
+        CHECK(fabs(db) <= FILTERS_GAIN_DB || fabs(gain - ideal) < 1e-5,
+              "%s: IIR gain at %.0fHz %.4f, design %.4f (%+.3fdB)", name, tone, gain, ideal, db);
+
+        if (c.economyShift)
+        {
+            /* as the quantizer sizes it, with anything below -40dB counting as -40dB */
+            gain = toneGain(economy, tone, Fs, settle);
+            db = 20 * log10(fmax(gain, 0.01) / fmax(ideal, 0.01));
+            CHECK(fabs(db) <= IIR_ECONOMY_MAX_DB,
+                  "%s: IIR economy gain at %.0fHz %.4f, design %.4f (%+.3fdB)", name, tone, gain, ideal, db);
+        }
+    }
+}
+
+/* full scale vectors through IIR, the 32 bit path does not saturate so
+    every sample must stay next to the reference */
+static void test_vectors(const char *name, const biquad_design_t &d, float Fs, float fc)
+{
+    const double full = (1 << (IIR_SAMPLE_BITS - 1)) - 1;
+
+    for (int v = 0; v < vector_count; v++)
+    {
+        IIR iir;
+        iir.setCoefficients(IIR::quantize(d));
+        reference_t r;
+        reference_init(r, d);
+        noise_state = 0x2545F491;
+
+        size_t wrapped = 0;
+        double error = 0, peak = 0;
+        for (size_t n = 0; n < FILTERS_VECTOR; n++)
+        {
+            int32_t s = (int32_t)lrint(full * vector_sample((vector_t)v, n, fc, Fs));
+            double expected = reference_filter(r, s);
+            iir.filter(&s);
+            /* sign flipped on a sample well away from zero */
+            wrapped += fabs(expected) > full / 2 && (s < 0) != (expected < 0);
+            error = fmax(error, fabs(s - expected));
+            peak = fmax(peak, fabs(expected));
+        }
+
+        CHECK(wrapped == 0, "%s: IIR wrapped on %zu samples of a full scale %s", name, wrapped, vectorNames[v]);
+        CHECK(error <= fmax(full, peak) * pow(10.0, FILTERS_ERROR_32 / 20), "%s: IIR %s error %.0f LSB at a peak of %.0f", name, vectorNames[v], error, peak);
+    }
+}
+
+static void test_stereo16(const char *name, const biquad_design_t &d, float Fs)
+{
+    biquad_coeffs_t c = StereoIIR16::quantize(d);
+    StereoIIR16 stereo(d, d);
+    reference_t quantized[2], design;
+    reference_init(quantized[0], c, ldexp(1.0, c.shift + IIR16_FINE_BITS));
+    reference_init(quantized[1], c, ldexp(1.0, c.shift + IIR16_FINE_BITS));
+    reference_init(design, d);
+
+    sweep_t sweep = {0, Fs};
+    size_t length = (size_t)Fs;
+    size_t silent = length + settling(d);
+    double level = amplitude16 / fmax(1.0, peakGain(d, Fs));
+    double noise[2] = {0, 0}, designNoise = 0;
+    int32_t tail = 0;
+    for (size_t n = 0; n < silent + FILTERS_TAIL; n++)
+    {
+        /* the right lane runs inverted, crosstalk between lanes shows up as error */
+        double s = level * sweep_sample(sweep, n);
+        int16_t x = (int16_t)lrint(s);
+        uint32_t frame = pack16(x, -x);
+        stereo.filter(&frame);
+        int16_t out[2] = {unpackLeft16(frame), unpackRight16(frame)};
+
+        double e[2] = {out[0] - reference_filter(quantized[0], x), out[1] - reference_filter(quantized[1], -x)};
+        double ed = out[0] - reference_filter(design, x);
+        if (n < length)
+        {
+            noise[0] += e[0] * e[0];
+            noise[1] += e[1] * e[1];
+            designNoise += ed * ed;
+        }
+        else if (n >= silent)
+        {
+            tail = abs(out[0]) > tail ? abs(out[0]) : tail;
+            tail = abs(out[1]) > tail ? abs(out[1]) : tail;
+        }
+    }
+
+    /* against a full scale sine, the sweep itself is lowered by the peak gain */
+    double signal = (double)INT16_MAX * INT16_MAX / 2 * length;
+    for (int ch = 0; ch < 2; ch++)
+    {
+        CHECK(snr(signal, noise[ch]) >= FILTERS_SNR_16, "%s: StereoIIR16 %s sweep snr %.1fdB, Q%d",
+              name, ch ? "right" : "left", snr(signal, noise[ch]), c.shift);
+    }
+    CHECK(snr(signal, designNoise) >= FILTERS_SNR_16_DESIGN, "%s: StereoIIR16 sweep snr against the design %.1fdB, Q%d",
+          name, snr(signal, designNoise), c.shift);
+    CHECK(tail <= FILTERS_LIMIT_CYCLE, "%s: StereoIIR16 limit cycle of %d LSB", name, tail);
+}
+
+/* full scale vectors through StereoIIR16, which saturates: the reference
+    is fed back the kernel's own outputs, so a clipped sample does not set
+    the two apart for good and a wrapped accumulator stands out at once */
+static void test_vectors16(const char *name, const biquad_design_t &d, float Fs, float fc)
+{
+    biquad_coeffs_t c = StereoIIR16::quantize(d);
+
+    for (int v = 0; v < vector_count; v++)
+    {
+        StereoIIR16 stereo(d, d);
+        reference_t r[2];
+        for (int ch = 0; ch < 2; ch++)
+        {
+            reference_init(r[ch], c, ldexp(1.0, c.shift + IIR16_FINE_BITS));
+            r[ch].limit = INT16_MAX;
+        }
+        noise_state = 0x2545F491;
+
+        size_t wrapped = 0;
+        double error = 0;
+        for (size_t n = 0; n < FILTERS_VECTOR; n++)
+        {
+            int16_t x = (int16_t)lrint(INT16_MAX * vector_sample((vector_t)v, n, fc, Fs));
+            uint32_t frame = pack16(x, -x);
+            stereo.filter(&frame);
+            int16_t out[2] = {unpackLeft16(frame), unpackRight16(frame)};
+            double expected[2] = {reference_filter(r[0], x), reference_filter(r[1], -x)};
+            for (int ch = 0; ch < 2; ch++)
+            {
+                r[ch].y[0] = out[ch];
+                wrapped += fabs(expected[ch]) > INT16_MAX / 2 && (out[ch] < 0) != (expected[ch] < 0);
+                error = fmax(error, fabs(out[ch] - expected[ch]));
+            }
+        }
+
+        CHECK(wrapped == 0, "%s: StereoIIR16 wrapped on %zu samples of a full scale %s", name, wrapped, vectorNames[v]);
+        CHECK(error <= FILTERS_ERROR_16, "%s: StereoIIR16 %s error %.1f LSB", name, vectorNames[v], error);
+    }
+}
+
+int main()
+{
+    for (const rate_t &rate : rates)
+    {
+        for (int type = lowpass; type <= highshelf; type++)
+        {
+            /* the gain only shapes peaks and shelves */
+            size_t gainCount = type >= peak ? sizeof(gains) / sizeof(gains[0]) : 1;
+            for (float fc : rate.cutoffs)
+            {
+                for (float Q : qualities)
+                {
+                    for (size_t g = 0; g < gainCount; g++)
+                    {
+                        biquad_design_t d = biquad_design((filter_type_t)type, fc, Q, gains[g], rate.Fs);
+                        char name[64];
+                        snprintf(name, sizeof(name), "%s %.0fHz Q%.3f %+.0fdB at %.0fHz",
+                                 typeNames[type], fc, Q, gains[g], rate.Fs);
+                        if (rate.packed)
+                        {
+                            test_stereo16(name, d, rate.Fs);
+                            test_vectors16(name, d, rate.Fs, fc);
+                        }
+                        else
+                        {
+                            test_sweep(name, d, rate.Fs);
+                            test_tones(name, d, rate.Fs, fc);
+                            test_vectors(name, d, rate.Fs, fc);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /* the stages of the packed chain in main.cpp */
+    test_stereo16("crossover lowpass 880Hz", biquad_design(lowpass, 880, BIQUAD_Q_ORDER_4_1, 0.0, 96000), 96000);
+    test_stereo16("crossover highpass 880Hz", biquad_design(highpass, 880, BIQUAD_Q_ORDER_4_1, 0.0, 96000), 96000);
+    test_stereo16("crossover lowpass 880Hz Q2", biquad_design(lowpass, 880, BIQUAD_Q_ORDER_4_2, 0.0, 96000), 96000);
+    test_stereo16("crossover highpass 880Hz Q2", biquad_design(highpass, 880, BIQUAD_Q_ORDER_4_2, 0.0, 96000), 96000);
+    test_stereo16("bass peak 80Hz", biquad_design(peak, 80, BIQUAD_Q_ORDER_2, 6.0, 96000), 96000);
+
+    return test_result("filters");
+}
@@ -0,0 +1,56 @@
+#include <stdint.h>
+
+#include "test.h"
+#include "governor.h"
+
+/*
+    load shedding decisions of LoadGovernor:
+      - xruns while the rings prime (the settle blocks) are ignored,
+        the first one after it steps up at once
+      - sustained load above GOVERNOR_HIGH steps up after
+        GOVERNOR_ESCALATE_BLOCKS, a recovery needs
+        GOVERNOR_RECOVER_BLOCKS below GOVERNOR_LOW
+*/
+
+#define SETTLE (32)
+
+int main()
+{
+    LoadGovernor g(SETTLE);
+
+    /* startup, every block of the first lap reports an xrun */
+    for (int i = 0; i < SETTLE; i++)
+    {
+        CHECK(!g.update(100, true), "xrun in settle block %d stepped up", i);
+    }
+    CHECK(g.level() == shed_none && g.changes() == 0, "level %d after priming", g.level());
+
+    g.update(100, true);
+    CHECK(g.level() == shed_optional, "first xrun after priming left level %d", g.level());
+
+    /* sustained overload */
+    for (int i = 0; i < GOVERNOR_ESCALATE_BLOCKS - 1; i++)
+    {
+        g.update(GOVERNOR_HIGH + 1, false);
+    }
+    CHECK(g.level() == shed_optional, "stepped up before %d blocks over", GOVERNOR_ESCALATE_BLOCKS);
+    g.update(GOVERNOR_HIGH + 1, false);
+    CHECK(g.level() == shed_economy, "no step up after %d blocks over", GOVERNOR_ESCALATE_BLOCKS);
+
+    /* recovery */
+    for (int i = 0; i < GOVERNOR_RECOVER_BLOCKS - 1; i++)
+    {
+        g.update(GOVERNOR_LOW - 1, false);
+    }
+    CHECK(g.level() == shed_economy, "stepped down before %d blocks under", GOVERNOR_RECOVER_BLOCKS);
+    g.update(GOVERNOR_LOW - 1, false);
+    CHECK(g.level() == shed_optional, "no step down after %d blocks under", GOVERNOR_RECOVER_BLOCKS);
+    CHECK(g.changes() == 3, "%u level changes", (unsigned)g.changes());
+
+    /* a governor without a settle time takes the first xrun */
+    LoadGovernor immediate(0);
+    immediate.update(100, true);
+    CHECK(immediate.level() == shed_optional, "xrun without settle left level %d", immediate.level());
+
+    return test_result("governor");
+}
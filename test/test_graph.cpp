@@ -0,0 +1,389 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+#include "graph.h"
+
+/*
+    Graph::compile and process against a naive evaluation that gives
+    every node its own buffer for the whole run, so any scratch buffer
+    reused too early or written in place while still read shows up:
+      - one node fanned out to two outputs
+      - chains processed in place, mixes of up to GRAPH_MAX_FANIN
+        sources, a delay
+      - optional nodes, run and skipped, in place and on a fanned out
+        source
+      - biquad and gain changes crossfaded over several blocks, one of
+        them landing while the previous fade still runs
+      - gains and mixes on a full scale square at +12dB saturate at
+        GRAPH_LIMIT, never wrap
+    Outputs must match bit for bit, block after block.
+*/
+
+#define FS (48000.0f)
+#define FULL_SCALE (1 << 23)
+#define BLOCKS (64)
+#define LENGTH (BLOCKS * GRAPH_BLOCK_SIZE)
+
+static uint32_t noise_state = 1;
+
+static int32_t noise(int32_t level)
+{
+    noise_state = noise_state * 1664525 + 1013904223;
+    return (int32_t)(((int64_t)(int32_t)noise_state * level) >> 31);
+}
+
+static int32_t input[GRAPH_MAX_CHANNELS][LENGTH];
+static int32_t node[GRAPH_MAX_NODES][LENGTH];
+static int32_t output[GRAPH_MAX_CHANNELS][LENGTH];
+static int32_t result[GRAPH_MAX_CHANNELS][LENGTH];
+
+static int32_t gain_q16(float dB)
+{
+    return (int32_t)(powf(10.0f, dB / 20.0f) * GAIN_UNITY);
+}
+
+static int32_t limit(int64_t s)
+{
+    return (int32_t)(s > GRAPH_LIMIT ? GRAPH_LIMIT : (s < -GRAPH_LIMIT ? -GRAPH_LIMIT : s));
+}
+
+/* every node over the whole run, one after the other, skipped ones pass their input */
+static void evaluate(const graph_node_t *nodes, size_t count, bool skipOptional)
+{
+    memset(output, 0, sizeof(output));
+    for (size_t i = 0; i < count; i++)
+    {
+        const graph_node_t &n = nodes[i];
+        const int32_t *x = n.sources ? node[n.source[0]] : nullptr;
+        int32_t *y = node[i];
+        IIR biquad;
+        if (n.optional && skipOptional)
+        {
+            memcpy(y, x, sizeof(node[i]));
+            continue;
+        }
+        switch (n.type)
+        {
+        case node_input:
+            memcpy(y, input[n.channel], sizeof(node[i]));
+            break;
+        case node_output:
+            memcpy(y, x, sizeof(node[i]));
+            memcpy(output[n.channel], x, sizeof(node[i]));
+            break;
+        case node_biquad:
+            biquad.setCoefficients(n.quantized ? n.coeffs : IIR::quantize(n.biquad));
+            for (size_t t = 0; t < LENGTH; t++)
+            {
+                y[t] = x[t];
+                biquad.filter(&y[t]);
+            }
+            break;
+        case node_gain:
+            for (size_t t = 0; t < LENGTH; t++)
+            {
+                y[t] = limit(((int64_t)x[t] * gain_q16(n.gain[0])) >> 16);
+            }
+            break;
+        case node_mix:
+            for (size_t t = 0; t < LENGTH; t++)
+            {
+                int64_t acc = 0;
+                for (size_t k = 0; k < n.sources; k++)
+                {
+                    acc += (int64_t)node[n.source[k]][t] * gain_q16(n.gain[k]);
+                }
+                y[t] = limit(acc >> 16);
+            }
+            break;
+        case node_delay:
+            for (size_t t = 0; t < LENGTH; t++)
+            {
+                y[t] = t >= n.delay.samples ? x[t - n.delay.samples] : 0;
+            }
+            break;
+        case node_split:
+        case node_merge:
+            CHECK(false, "the low band is covered by test_subband");
+            break;
+        }
+    }
+}
+
+/* the graph block by block, its outputs against the evaluation */
+static void run(const char *name, const graph_node_t *nodes, size_t count, bool skipOptional = false)
+{
+    static Graph graph;
+    CHECK(graph.compile(nodes, count), "%s: %s", name, graph.error());
+    graph.setSkipOptional(skipOptional);
+    evaluate(nodes, count, skipOptional);
+
+    size_t wrong = 0;
+    for (size_t b = 0; b < BLOCKS; b++)
+    {
+        for (int c = 0; c < GRAPH_MAX_CHANNELS; c++)
+        {
+            memcpy(graph.input(c), &input[c][b * GRAPH_BLOCK_SIZE], GRAPH_BLOCK_SIZE * sizeof(int32_t));
+        }
+        graph.process();
+        for (int c = 0; c < GRAPH_MAX_CHANNELS; c++)
+        {
+            for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+            {
+                result[c][b * GRAPH_BLOCK_SIZE + i] = graph.output(c)[i];
+                wrong += graph.output(c)[i] != output[c][b * GRAPH_BLOCK_SIZE + i];
+            }
+        }
+    }
+    CHECK(wrong == 0, "%s: %zu samples off the evaluation", name, wrong);
+}
+
+static void fill_noise(int32_t level)
+{
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        input[0][t] = noise(level);
+        input[1][t] = noise(level);
+    }
+}
+
+static void test_routing()
+{
+    fill_noise(FULL_SCALE / 2);
+
+    /* one biquad feeds both outputs, neither may run in place on it */
+    {
+        graph_node_t g[] = {
+            graph_input(0),
+            graph_biquad(0, biquad_design(lowpass, 1000, BIQUAD_Q_ORDER_2, 0, FS)),
+            graph_output(1, 0),
+            graph_output(1, 1),
+        };
+        run("fan-out", g, sizeof(g) / sizeof(g[0]));
+    }
+
+    /* chains in place, the input fanned out into a chain and a delay */
+    {
+        graph_node_t g[] = {
+            graph_input(0),
+            graph_input(1),
+            graph_biquad(0, biquad_design(highpass, 200, BIQUAD_Q_ORDER_2, 0, FS)),
+            graph_biquad(2, biquad_design(peak, 2000, 2.0f, 6.0f, FS)),
+            graph_gain(3, -3.0f),
+            graph_biquad(4, biquad_design(lowpass, 8000, BIQUAD_Q_ORDER_2, 0, FS)),
+            graph_delay(0, 45),
+            graph_mix(5, 0.0f, 6, -6.0f),
+            graph_output(7, 0),
+            graph_gain(1, 2.0f),
+            graph_output(9, 1),
+        };
+        run("chains", g, sizeof(g) / sizeof(g[0]));
+    }
+
+    /* every source of a full mix stays alive until the mix ran */
+    {
+        const uint8_t sources[GRAPH_MAX_FANIN] = {0, 2, 1, 3};
+        const float dB[GRAPH_MAX_FANIN] = {-6.0f, -12.0f, -3.0f, 0.0f};
+        graph_node_t g[] = {
+            graph_input(0),
+            graph_input(1),
+            graph_biquad(0, biquad_design(lowshelf, 100, BIQUAD_Q_ORDER_2, 6.0f, FS)),
+            graph_biquad(1, biquad_design(highshelf, 5000, BIQUAD_Q_ORDER_2, -6.0f, FS)),
+            graph_mix(sources, dB, GRAPH_MAX_FANIN),
+            graph_output(4, 0),
+            graph_mix(sources + 1, dB + 1, 3),
+            graph_output(6, 1),
+        };
+        run("mix", g, sizeof(g) / sizeof(g[0]));
+    }
+
+    /* more sources than GRAPH_MAX_FANIN are refused */
+    {
+        const uint8_t sources[GRAPH_MAX_FANIN + 1] = {};
+        const float dB[GRAPH_MAX_FANIN + 1] = {};
+        graph_node_t g[] = {
+            graph_input(0),
+            graph_mix(sources, dB, GRAPH_MAX_FANIN + 1),
+            graph_output(1, 0),
+        };
+        Graph graph;
+        CHECK(!graph.compile(g, sizeof(g) / sizeof(g[0])), "mix of %d sources compiled", GRAPH_MAX_FANIN + 1);
+    }
+}
+
+static void test_optional()
+{
+    fill_noise(FULL_SCALE / 2);
+
+    /* an optional biquad and gain in place in a chain, an optional
+        biquad on a source that also feeds the other output */
+    graph_node_t g[] = {
+        graph_input(0),
+        graph_input(1),
+        graph_biquad(0, biquad_design(highpass, 100, BIQUAD_Q_ORDER_2, 0, FS)),
+        graph_optional(graph_biquad(2, biquad_design(peak, 80, BIQUAD_Q_ORDER_2, 6.0f, FS))),
+        graph_optional(graph_gain(3, -6.0f)),
+        graph_output(4, 0),
+        graph_optional(graph_biquad(1, biquad_design(lowshelf, 200, BIQUAD_Q_ORDER_2, -6.0f, FS))),
+        graph_mix(6, -3.0f, 1, -3.0f),
+        graph_output(7, 1),
+    };
+    run("optional", g, sizeof(g) / sizeof(g[0]), false);
+    run("optional skipped", g, sizeof(g) / sizeof(g[0]), true);
+
+    /* only biquads and gains can be skipped */
+    graph_node_t d[] = {
+        graph_input(0),
+        graph_optional(graph_delay(0, 10)),
+        graph_output(1, 0),
+    };
+    Graph graph;
+    CHECK(!graph.compile(d, sizeof(d) / sizeof(d[0])), "optional delay compiled");
+}
+
+/* a lowpass cutoff and a gain, faded in at the start of a block */
+typedef struct
+{
+    size_t block;
+    float Fc;
+    float dB;
+} change_t;
+
+static void test_fade()
+{
+    /* a full scale square on the faded chain, noise on the other */
+    fill_noise(FULL_SCALE / 2);
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        input[0][t] = (t / 50) & 1 ? FULL_SCALE - 1 : -FULL_SCALE;
+    }
+
+    /* the second change lands two blocks into the first fade, which
+        jumps to its target; the gains saturate the square during a fade */
+    const change_t changes[] = {{8, 4000, 6.0f}, {10, 300, -12.0f}, {30, 2000, 12.0f}};
+    const size_t count = sizeof(changes) / sizeof(changes[0]);
+
+    graph_node_t g[] = {
+        graph_input(0),
+        graph_biquad(0, biquad_design(lowpass, 1000, BIQUAD_Q_ORDER_2, 0, FS)),
+        graph_gain(1, 0.0f),
+        graph_output(2, 0),
+        graph_input(1),
+        graph_output(4, 1),
+    };
+    static Graph graph;
+    CHECK(graph.compile(g, sizeof(g) / sizeof(g[0])), "fade: %s", graph.error());
+
+    /* the evaluation, sample by sample: both filters run while fading,
+        the target starting from the history of the running one */
+    IIR now, target;
+    now.setCoefficients(IIR::quantize(g[1].biquad));
+    int32_t gain = gain_q16(0.0f), nextGain = gain;
+    size_t fade = 0, c = 0;
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        if (c < count && t == changes[c].block * GRAPH_BLOCK_SIZE)
+        {
+            if (fade)
+            {
+                now = target;
+                gain = nextGain;
+            }
+            target = now;
+            target.setCoefficients(IIR::quantize(biquad_design(lowpass, changes[c].Fc, BIQUAD_Q_ORDER_2, 0, FS)));
+            nextGain = gain_q16(changes[c].dB);
+            fade = GRAPH_FADE_SAMPLES;
+            c++;
+        }
+
+        int32_t s = input[0][t];
+        now.filter(&s);
+        if (fade)
+        {
+            int32_t position = GRAPH_FADE_SAMPLES - fade + 1;
+            int32_t next = input[0][t];
+            target.filter(&next);
+            s += (int32_t)(((int64_t)next - s) * position / GRAPH_FADE_SAMPLES);
+            output[0][t] = limit(((int64_t)s * (gain + (nextGain - gain) * position / GRAPH_FADE_SAMPLES)) >> 16);
+            if (--fade == 0)
+            {
+                now = target;
+                gain = nextGain;
+            }
+        }
+        else
+        {
+            output[0][t] = limit(((int64_t)s * gain) >> 16);
+        }
+    }
+
+    size_t wrong = 0;
+    c = 0;
+    for (size_t b = 0; b < BLOCKS; b++)
+    {
+        if (c < count && b == changes[c].block)
+        {
+            graph.setBiquad(1, IIR::quantize(biquad_design(lowpass, changes[c].Fc, BIQUAD_Q_ORDER_2, 0, FS)), true);
+            graph.setGain(2, gain_q16(changes[c].dB), true);
+            c++;
+        }
+        memcpy(graph.input(0), &input[0][b * GRAPH_BLOCK_SIZE], GRAPH_BLOCK_SIZE * sizeof(int32_t));
+        memcpy(graph.input(1), &input[1][b * GRAPH_BLOCK_SIZE], GRAPH_BLOCK_SIZE * sizeof(int32_t));
+        graph.process();
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            wrong += graph.output(0)[i] != output[0][b * GRAPH_BLOCK_SIZE + i];
+            wrong += graph.output(1)[i] != input[1][b * GRAPH_BLOCK_SIZE + i];
+        }
+    }
+    CHECK(wrong == 0, "fade: %zu samples off the evaluation", wrong);
+}
+
+static void test_saturation()
+{
+    /* full scale square, +12dB on it is 2^25 */
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        input[0][t] = (t / 50) & 1 ? FULL_SCALE - 1 : -FULL_SCALE;
+        input[1][t] = -input[0][t];
+    }
+
+    const uint8_t sources[GRAPH_MAX_FANIN] = {0, 0, 0, 0};
+    const float dB[GRAPH_MAX_FANIN] = {12.0f, 12.0f, 12.0f, 12.0f};
+    graph_node_t g[] = {
+        graph_input(0),
+        graph_input(1),
+        graph_gain(0, 12.0f),
+        graph_output(2, 0),
+        graph_mix(sources, dB, GRAPH_MAX_FANIN),
+        graph_gain(4, 12.0f),
+        graph_output(5, 1),
+    };
+    run("+12dB", g, sizeof(g) / sizeof(g[0]));
+
+    /* against the double result, held at the limit with the sign kept */
+    size_t wrapped = 0, unlimited = 0;
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        double gain = pow(10.0, 12.0 / 20.0);
+        double expected[2] = {input[0][t] * gain, input[0][t] * 4 * gain * gain};
+        for (int c = 0; c < 2; c++)
+        {
+            wrapped += (result[c][t] < 0) != (expected[c] < 0);
+            unlimited += result[c][t] != (expected[c] > 0 ? GRAPH_LIMIT : -GRAPH_LIMIT);
+        }
+    }
+    CHECK(wrapped == 0, "%zu samples wrapped", wrapped);
+    CHECK(unlimited == 0, "%zu samples not at GRAPH_LIMIT", unlimited);
+}
+
+int main()
+{
+    test_routing();
+    test_optional();
+    test_fade();
+    test_saturation();
+    return test_result("graph");
+}
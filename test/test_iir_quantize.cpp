@@ -0,0 +1,174 @@
+#include <stdint.h>
+#include <math.h>
+#include <complex>
+#include <vector>
+
+#include "test.h"
+#include "iir.h"
+
+/*
+    coefficient formats chosen by IIR::quantize over low cutoffs, high Q
+    and shelves, at the graph rate and at the subband rate:
+      - no filter falls below IIR_MIN_Q
+      - the quantized response stays on the design's, the economy
+        variant's within IIR_ECONOMY_MAX_DB
+      - a worst-case input (the sign of the time reversed impulse
+        response at full scale) does not wrap the 32 bit accumulator
+        of the economy variant, which is only sized by the gain bound
+*/
+
+static const char *typeNames[] = {"lowpass", "highpass", "bandpass", "notch", "peak", "lowshelf", "highshelf"};
+static const float cutoffs[] = {20, 30, 50, 80, 120, 200, 500, 1000, 5000, 15000};
+static const float qualities[] = {0.5, 0.707, 1.3, 2, 5, 10};
+static const float gains[] = {-12, 6, 12};
+
+/* |H| of 1 + b z^-1 ... over 1 - a z^-1 ..., in the design's sign convention */
+static double response(double a0, double a1, double a2, double b1, double b2, double f, double Fs)
+{
+    std::complex<double> z1 = std::polar(1.0, -2 * M_PI * f / Fs);
+    std::complex<double> z2 = z1 * z1;
+    return abs((a0 + a1 * z1 + a2 * z2) / (1.0 + b1 * z1 + b2 * z2));
+}
+
+/* largest deviation of the quantized response, relative above unity gain */
+static double responseError(const biquad_design_t &d, const biquad_coeffs_t &c, float Fs)
+{
+    double scale = ldexp(1.0, -c.shift);
+    double worst = 0;
+    for (int i = 0; i <= 64; i++)
+    {
+        double f = 10 * pow(Fs / 2 * 0.95 / 10, i / 64.0);
+        double ideal = response(d.a0, d.a1, d.a2, d.b1, d.b2, f, Fs);
+        double actual = response(c.b[0] * scale, c.b[1] * scale, c.b[2] * scale,
+                                 -c.a[0] * scale, -c.a[1] * scale, f, Fs);
+        worst = fmax(worst, fabs(actual - ideal) / fmax(1.0, ideal));
+    }
+    return worst;
+}
+
+/* the economy coefficients, rounded as IIR::setCoefficients does */
+static void economyCoefficients(const biquad_coeffs_t &c, double b[3], double a[2])
+{
+    int d = c.shift - c.economyShift;
+    int32_t half = d ? 1 << (d - 1) : 0;
+    double scale = ldexp(1.0, -c.economyShift);
+    for (int k = 0; k < 3; k++)
+    {
+        b[k] = ((c.b[k] + half) >> d) * scale;
+    }
+    for (int k = 0; k < 2; k++)
+    {
+        a[k] = ((c.a[k] + half) >> d) * scale;
+    }
+}
+
+/* in dB on a dense grid, below -40dB counts as -40dB (the bottom of a notch) */
+static double economyError(const biquad_design_t &d, const biquad_coeffs_t &c, float Fs)
+{
+    double b[3], a[2];
+    economyCoefficients(c, b, a);
+    double worst = 0;
+    for (int i = 0; i <= 4000; i++)
+    {
+        double f = 10 * pow(Fs / 2 * 0.99 / 10, i / 4000.0);
+        double ideal = response(d.a0, d.a1, d.a2, d.b1, d.b2, f, Fs);
+        double actual = response(b[0], b[1], b[2], -a[0], -a[1], f, Fs);
+        worst = fmax(worst, fabs(20 * log10((actual + 1e-2) / (ideal + 1e-2))));
+    }
+    return worst;
+}
+
+/* peak output of the economy variant under the input that maximises it */
+static bool economyWraps(const biquad_coeffs_t &c, double *peak, double *expected)
+{
+    /* impulse response of the economy coefficients, the variant's own */
+    const size_t length = 1 << 16;
+    double b[3], a[2];
+    economyCoefficients(c, b, a);
+    std::vector<double> h(length);
+    double x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+    for (size_t n = 0; n < length; n++)
+    {
+        double x0 = n == 0;
+        h[n] = b[0] * x0 + b[1] * x1 + b[2] * x2 + a[0] * y1 + a[1] * y2;
+        x2 = x1;
+        x1 = x0;
+        y2 = y1;
+        y1 = h[n];
+    }
+
+    IIR filter;
+    filter.setCoefficients(c);
+    filter.setEconomy(true);
+    const int32_t full = (1 << (IIR_SAMPLE_BITS - 1)) - 1;
+    double gain = 0;
+    *peak = 0;
+    for (size_t n = 0; n < length; n++)
+    {
+        int32_t s = h[length - 1 - n] < 0 ? -full : full;
+        gain += fabs(h[length - 1 - n]);
+        filter.filter(&s);
+        *peak = fmax(*peak, fabs((double)s));
+    }
+    *expected = gain * full;
+    /* the last output is the sum over the whole response, a wrap flips or shrinks it */
+    return fabs(*peak - *expected) > 0.01 * *expected + 4096;
+}
+
+static void sweep(float Fs)
+{
+    size_t designs = 0, economy = 0;
+    double worstError = 0, worstEconomy = 0;
+    for (int type = lowpass; type <= highshelf; type++)
+    {
+        for (float Fc : cutoffs)
+        {
+            if (Fc > Fs * 0.45f)
+            {
+                continue;
+            }
+            for (float Q : qualities)
+            {
+                for (float dB : gains)
+                {
+                    biquad_design_t d = biquad_design((filter_type_t)type, Fc, Q, dB, Fs);
+                    biquad_coeffs_t c = IIR::quantize(d);
+                    designs++;
+
+                    CHECK(c.shift >= IIR_MIN_Q, "%s %gHz Q%g %gdB at %gHz: Q%u",
+                          typeNames[type], Fc, Q, dB, Fs, c.shift);
+
+                    double error = responseError(d, c, Fs);
+                    worstError = fmax(worstError, error);
+                    CHECK(error < 1e-3, "%s %gHz Q%g %gdB at %gHz: response off by %g at Q%u",
+                          typeNames[type], Fc, Q, dB, Fs, error, c.shift);
+
+                    if (c.economyShift)
+                    {
+                        economy++;
+                        CHECK(c.economyShift >= IIR_ECONOMY_MIN_Q, "%s %gHz Q%g %gdB at %gHz: economy at Q%u",
+                              typeNames[type], Fc, Q, dB, Fs, c.economyShift);
+                        double economyDb = economyError(d, c, Fs);
+                        worstEconomy = fmax(worstEconomy, economyDb);
+                        CHECK(economyDb < IIR_ECONOMY_MAX_DB + 0.25, "%s %gHz Q%g %gdB at %gHz: economy response off by %.2fdB",
+                              typeNames[type], Fc, Q, dB, Fs, economyDb);
+                        double peak, expected;
+                        CHECK(!economyWraps(c, &peak, &expected),
+                              "%s %gHz Q%g %gdB at %gHz: economy peak %.0f, expected %.0f",
+                              typeNames[type], Fc, Q, dB, Fs, peak, expected);
+                    }
+                }
+            }
+        }
+    }
+    printf("%gHz: %zu designs, %zu with an economy variant, worst response error %.2g, economy %.2fdB\n",
+           Fs, designs, economy, worstError, worstEconomy);
+}
+
+int main()
+{
+    sweep(48000);
+    /* a low rate, the same cutoffs sit closer to z = 1 */
+    sweep(6000);
+    return test_result("iir_quantize");
+}
@@ -0,0 +1,194 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "preset.h"
+
+/*
+    PresetBank against a flash image in a file, mapped where XIP reads
+    land (see host/hardware/flash.h):
+      - erased and corrupt slots read as empty
+      - a save lands in its own sector, with interrupts masked, and
+        survives remapping the file
+      - begin() refuses a program image reaching into the bank
+      - preset_set replaces settings per node and stops when full
+*/
+
+static int image = -1;
+
+static void flash_map(const char *path, bool erase)
+{
+    image = open(path, O_RDWR | O_CREAT | (erase ? O_TRUNC : 0), 0644);
+    if (image < 0 || ftruncate(image, PICO_FLASH_SIZE_BYTES) != 0)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    void *m = mmap(nullptr, PICO_FLASH_SIZE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, image, 0);
+    if (m == MAP_FAILED)
+    {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+    host_xip = (uint8_t *)m;
+    if (erase)
+    {
+        memset(host_xip, 0xFF, PICO_FLASH_SIZE_BYTES);
+    }
+}
+
+static void flash_unmap()
+{
+    msync(host_xip, PICO_FLASH_SIZE_BYTES, MS_SYNC);
+    munmap(host_xip, PICO_FLASH_SIZE_BYTES);
+    close(image);
+    host_xip = nullptr;
+}
+
+static dsp_command_t command(command_type_t type, uint8_t node, int32_t value)
+{
+    dsp_command_t cmd;
+    memset(&cmd, 0, sizeof(cmd));
+    cmd.type = type;
+    cmd.node = node;
+    switch (type)
+    {
+    case command_filter:
+        cmd.coeffs.type = peak;
+        cmd.coeffs.b[0] = value;
+        cmd.coeffs.b[1] = -2 * value;
+        cmd.coeffs.b[2] = value / 2;
+        cmd.coeffs.a[0] = -value;
+        cmd.coeffs.a[1] = value / 3;
+        cmd.coeffs.shift = 28;
+        break;
+    case command_gain:
+        cmd.gain = value;
+        break;
+    default:
+        cmd.delay = value;
+        break;
+    }
+    return cmd;
+}
+
+static void test_set()
+{
+    preset_t p;
+    preset_init(p, "a name longer than the field");
+    CHECK(strlen(p.name) == PRESET_NAME - 1, "name not cut to %d chars", PRESET_NAME - 1);
+
+    CHECK(preset_set(p, command(command_gain, 3, 1 << 16)), "gain rejected");
+    CHECK(preset_set(p, command(command_filter, 3, 1 << 20)), "filter rejected");
+    CHECK(preset_set(p, command(command_gain, 3, 1 << 15)), "gain replacement rejected");
+    CHECK(!preset_set(p, command(command_bypass, 3, 0)), "bypass recorded");
+    CHECK(p.count == 2, "%u entries, expected 2", (unsigned)p.count);
+    CHECK(p.entry[0].gain == 1 << 15, "gain not replaced in place");
+
+    for (int node = 0; p.count < PRESET_MAX_ENTRIES; node++)
+    {
+        preset_set(p, command(command_delay, node, node));
+    }
+    CHECK(!preset_set(p, command(command_delay, PRESET_MAX_ENTRIES + 1, 0)), "entry past the end");
+    CHECK(preset_set(p, command(command_gain, 3, 1 << 14)), "replacement rejected when full");
+
+    for (uint32_t i = 0; i < p.count; i++)
+    {
+        dsp_command_t cmd = preset_command(p.entry[i]);
+        dsp_command_t expected = command((command_type_t)p.entry[i].type, p.entry[i].node, 0);
+        switch (p.entry[i].type)
+        {
+        case command_filter:
+            expected.coeffs = p.entry[i].coeffs;
+            break;
+        case command_gain:
+            expected.gain = p.entry[i].gain;
+            break;
+        default:
+            expected.delay = p.entry[i].delay;
+            break;
+        }
+        CHECK(!memcmp(&cmd, &expected, sizeof(cmd)), "entry %u does not round trip", (unsigned)i);
+    }
+}
+
+static void preset_fill(preset_t &p, const char *name, int32_t value)
+{
+    preset_init(p, name);
+    preset_set(p, command(command_filter, 1, value));
+    preset_set(p, command(command_gain, 2, value >> 4));
+    preset_set(p, command(command_delay, 5, value & 0xFFF));
+}
+
+static void test_bank(const char *path)
+{
+    flash_map(path, true);
+    PresetBank bank;
+    preset_t p, q;
+
+    /* the program runs into the last sector but one */
+    host_flash_end = (char *)host_xip + PRESET_FLASH_OFFSET + 1;
+    CHECK(!bank.begin(), "bank usable over the program image");
+    preset_fill(p, "x", 1 << 20);
+    CHECK(!bank.save(0, p), "saved over the program image");
+    CHECK(host_flash_faults == 0 && host_xip[PRESET_FLASH_OFFSET] == 0xFF, "flash written");
+
+    host_flash_end = (char *)host_xip + 256 * 1024;
+    CHECK(bank.begin(), "bank not usable");
+    for (uint8_t s = 0; s < PRESET_SLOTS; s++)
+    {
+        CHECK(!bank.name(s) && !bank.load(s, &q), "erased slot %u reads as a preset", s);
+    }
+
+    preset_fill(p, "bass", 1 << 20);
+    CHECK(bank.save(1, p), "save to slot 1 failed");
+    CHECK(!host_interrupts_disabled, "interrupts left masked");
+    CHECK(host_flash_faults == 0, "%u misaligned or unmasked flash operations", host_flash_faults);
+    CHECK(bank.name(1) && !strcmp(bank.name(1), "bass"), "slot 1 name %s", bank.name(1));
+    CHECK(bank.load(1, &q) && !memcmp(&p, &q, sizeof(p)), "slot 1 does not load back");
+    CHECK(!bank.name(0) && !bank.name(2), "a neighbouring slot became valid");
+    CHECK(!bank.save(PRESET_SLOTS, p) && !bank.name(PRESET_SLOTS), "slot past the bank");
+
+    /* a neighbour's erase leaves slot 1 alone, an overwrite needs one */
+    preset_t r;
+    preset_fill(r, "voice", 7 << 18);
+    CHECK(bank.save(2, r), "save to slot 2 failed");
+    CHECK(bank.load(1, &q) && !memcmp(&p, &q, sizeof(p)), "slot 2 save changed slot 1");
+    preset_fill(p, "bright", 3 << 21);
+    CHECK(bank.save(1, p), "overwrite of slot 1 failed");
+    CHECK(bank.load(1, &q) && !memcmp(&p, &q, sizeof(p)), "slot 1 overwrite does not load back");
+    flash_unmap();
+
+    /* power cycle */
+    flash_map(path, false);
+    host_flash_end = (char *)host_xip + 256 * 1024;
+    PresetBank reboot;
+    CHECK(reboot.begin(), "bank not usable after remapping");
+    CHECK(reboot.load(1, &q) && !memcmp(&p, &q, sizeof(p)), "slot 1 lost on remapping");
+    CHECK(reboot.load(2, &q) && !memcmp(&r, &q, sizeof(r)), "slot 2 lost on remapping");
+
+    /* any flipped bit, a torn write or an older layout is no preset */
+    uint8_t *slot2 = host_xip + PRESET_FLASH_OFFSET + 2 * FLASH_SECTOR_SIZE;
+    size_t probes[] = {offsetof(preset_t, magic), offsetof(preset_t, version), offsetof(preset_t, size),
+                       offsetof(preset_t, name), offsetof(preset_t, entry) + 5, offsetof(preset_t, checksum)};
+    for (size_t offset : probes)
+    {
+        slot2[offset] ^= 0x10;
+        CHECK(!reboot.name(2) && !reboot.load(2, &q), "bit flip at byte %zu not caught", offset);
+        slot2[offset] ^= 0x10;
+    }
+    memset(slot2 + sizeof(preset_t) / 2, 0xFF, sizeof(preset_t) - sizeof(preset_t) / 2);
+    CHECK(!reboot.name(2), "torn slot 2 reads as a preset");
+    CHECK(reboot.name(1) && !strcmp(reboot.name(1), "bright"), "slot 1 hurt by slot 2 corruption");
+    flash_unmap();
+}
+
+int main(int argc, char **argv)
+{
+    test_set();
+    test_bank(argc > 1 ? argv[1] : "preset_flash.bin");
+    return test_result("preset");
+}
@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <math.h>
+#include <vector>
+
+#include "test.h"
+#include "reference.h"
+#include "requantize.h"
+
+/*
+    noise floor and THD+N of the DAC word requantizer at the firmware's
+    setting (8 of 32 bits dropped, 48kHz): shaping must lower the noise
+    where the ear is most sensitive, and TPDF dither must leave an error
+    whose mean and power do not depend on the signal
+*/
+
+#define FS (48000.0)
+#define BITS (8)
+#define N (65536)
+
+/* a whole number of periods, so every bin is exact without a window */
+#define TONE_BIN (1365)
+
+/* threshold of hearing (Terhardt), dB SPL */
+static double threshold(double f)
+{
+    double k = fmax(f, 20) / 1000;
+    return 3.64 * pow(k, -0.8) - 6.5 * exp(-0.6 * (k - 3.3) * (k - 3.3)) + 1e-3 * pow(k, 4);
+}
+
+typedef struct
+{
+    double thdn;     // everything but the tone, 20Hz..20kHz, dB re tone
+    double weighted; // the same, weighted by the threshold of hearing
+    double sensitive; // 2..5kHz, where the ear is most sensitive
+} noise_t;
+
+static noise_t measure(uint8_t order, bool dither, double amplitude)
+{
+    Requantizer r;
+    r.configure(BITS, order, dither);
+
+    std::vector<int32_t> x(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        x[i] = (int32_t)llround(amplitude * 2147483647.0 * sin(2 * M_PI * TONE_BIN * i / N));
+    }
+    r.process(x.data(), N);
+
+    std::vector<complex_t> a(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        a[i] = x[i] / 2147483648.0;
+    }
+    reference_fft(a);
+
+    double tone = 0, noise = 0, weighted = 0, sensitive = 0;
+    for (size_t k = 1; k < N / 2; k++)
+    {
+        double p = norm(a[k]);
+        double f = k * FS / N;
+        if (k == TONE_BIN)
+        {
+            tone += p;
+        }
+        else if (f >= 20 && f <= 20000)
+        {
+            noise += p;
+            weighted += p * pow(10, -fmin(threshold(f), 90) / 10);
+            sensitive += f >= 2000 && f <= 5000 ? p : 0;
+        }
+    }
+    noise_t n = {reference_db(noise / tone), reference_db(weighted / tone), reference_db(sensitive / tone)};
+    return n;
+}
+
+/* shaped noise at every order against plain rounding */
+static void shaping()
+{
+    /* at least the fitted weighted gain, less 1dB of measurement spread */
+    static const double expected[REQUANTIZE_MAX_ORDER + 1] = {0, -4.3, -9.6, -12.0, -16.3, -18.3};
+
+    for (int dither = 0; dither < 2; dither++)
+    {
+        noise_t flat = measure(0, dither, 0.001);
+        printf("order 0 dither %d: THD+N %.1fdB weighted %.1fdB 2-5kHz %.1fdB (-60dBFS tone)\n",
+               dither, flat.thdn, flat.weighted, flat.sensitive);
+        for (uint8_t order = 1; order <= REQUANTIZE_MAX_ORDER; order++)
+        {
+            noise_t n = measure(order, dither, 0.001);
+            printf("order %u dither %d: THD+N %.1fdB weighted %.1fdB 2-5kHz %.1fdB\n",
+                   order, dither, n.thdn, n.weighted, n.sensitive);
+            CHECK(n.weighted - flat.weighted <= expected[order],
+                  "order %u dither %d: weighted noise %.1fdB against rounding", order, dither, n.weighted - flat.weighted);
+            CHECK(n.sensitive < flat.sensitive - 3,
+                  "order %u dither %d: 2-5kHz noise %.1fdB against rounding", order, dither, n.sensitive - flat.sensitive);
+        }
+    }
+}
+
+/*
+    constant inputs at every fraction of a step: with TPDF dither the
+    error has zero mean and a power of step^2 / 4 (rounding plus dither)
+    whatever the input, plain rounding has neither
+*/
+static void dither()
+{
+    const int32_t step = 1 << BITS;
+    double worstMean = 0, lowPower = 1e9, highPower = 0;
+
+    for (int32_t offset = 0; offset < step; offset += 8)
+    {
+        Requantizer r;
+        r.configure(BITS, 0, true);
+        int32_t input = 1000 * step + offset;
+        std::vector<int32_t> x(N, input);
+        r.process(x.data(), N);
+
+        double mean = 0, power = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            double e = (double)(x[i] - input) / step;
+            mean += e;
+            power += e * e;
+        }
+        mean /= N;
+        power = power / N - mean * mean;
+        worstMean = fmax(worstMean, fabs(mean));
+        lowPower = fmin(lowPower, power);
+        highPower = fmax(highPower, power);
+    }
+    printf("dither: worst mean error %.4f steps, error power %.4f..%.4f steps^2\n", worstMean, lowPower, highPower);
+    CHECK(worstMean < 0.01, "biased by %.4f steps", worstMean);
+    CHECK(lowPower > 0.23 && highPower < 0.27, "error power %.4f..%.4f, not step^2 / 4", lowPower, highPower);
+}
+
+/*
+    a tone of a few steps: rounding turns its error into harmonics,
+    dither into a flat floor without them
+*/
+static void linearity()
+{
+    const double amplitude = 3.3 * (1 << BITS) / 2147483648.0;
+    for (int dither = 0; dither < 2; dither++)
+    {
+        Requantizer r;
+        r.configure(BITS, 0, dither);
+        std::vector<int32_t> x(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            x[i] = (int32_t)llround(amplitude * 2147483647.0 * sin(2 * M_PI * TONE_BIN * i / N));
+        }
+        r.process(x.data(), N);
+
+        std::vector<complex_t> a(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            a[i] = x[i] / 2147483648.0;
+        }
+        reference_fft(a);
+
+        /* worst harmonic against the average noise bin */
+        double tone = norm(a[TONE_BIN]), harmonic = 0, floor = 0;
+        for (size_t h = 2; h <= 9; h++)
+        {
+            harmonic = fmax(harmonic, norm(a[(h * TONE_BIN) % N]));
+        }
+        for (size_t k = 1; k < N / 2; k++)
+        {
+            floor += k % TONE_BIN ? norm(a[k]) : 0;
+        }
+        floor /= N / 2;
+        printf("dither %d: worst harmonic %.1fdB re tone, %.1fdB over the noise bins\n",
+               dither, reference_db(harmonic / tone), reference_db(harmonic / floor));
+        if (dither)
+        {
+            CHECK(reference_db(harmonic / floor) < 12, "harmonic %.1fdB over the floor", reference_db(harmonic / floor));
+        }
+        else
+        {
+            CHECK(reference_db(harmonic / floor) > 20, "rounding shows no harmonics, the test is not sensitive");
+        }
+    }
+}
+
+int main()
+{
+    shaping();
+    dither();
+    linearity();
+    return test_result("requantize");
+}
@@ -0,0 +1,63 @@
+#include <stdint.h>
+
+#include "test.h"
+#include "silence.h"
+
+/*
+    idle decisions of SilenceDetector:
+      - disabled until configured, hold 0 disables again
+      - processing stops once, after exactly the hold time of quiet
+        blocks, a loud block restarts the count
+      - the first loud block after an idle stretch is processed at
+        once, waking costs no block of latency
+    and the conversions of the silence command
+*/
+
+#define FS (48000.0f)
+
+int main()
+{
+    SilenceDetector s;
+    CHECK(s.update(0) == silence_active && !s.idle(), "idle before configure");
+
+    int32_t threshold = silence_threshold(SILENCE_THRESHOLD_DB);
+    uint32_t hold = silence_hold(SILENCE_HOLD_MS, FS);
+    CHECK(threshold == 265, "-90dBFS is %ld at graph level", (long)threshold);
+    CHECK(silence_threshold(0.0f) == 1 << 23, "0dBFS is %ld", (long)silence_threshold(0.0f));
+    CHECK(hold == 3000, "2s is %lu blocks", (unsigned long)hold);
+    CHECK(silence_hold(0.1f, FS) == 1 && silence_hold(0.0f, FS) == 0, "short holds");
+    s.configure(threshold, hold);
+
+    /* the threshold itself is quiet, a loud block restarts the hold */
+    for (uint32_t i = 0; i < hold - 1; i++)
+    {
+        CHECK(s.update(i & 1 ? threshold : 0) == silence_active, "stopped after %lu blocks",
+              (unsigned long)i + 1);
+    }
+    CHECK(s.update(threshold + 1) == silence_active, "loud block not processed");
+    for (uint32_t i = 0; i < hold - 1; i++)
+    {
+        s.update(0);
+    }
+    CHECK(s.update(0) == silence_stop && s.idle(), "not stopped after the hold");
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        CHECK(s.update(threshold) == silence_idle, "idle block %lu not idle", (unsigned long)i);
+    }
+    CHECK(s.idleBlocks() == 100, "%lu idle blocks counted", (unsigned long)s.idleBlocks());
+
+    /* wake on the first loud block, then a full hold again */
+    CHECK(s.update(threshold + 1) == silence_active && !s.idle(), "first loud block after idle not processed");
+    CHECK(s.update(0) == silence_active, "stopped again without a hold");
+
+    /* turned off while idle */
+    for (uint32_t i = 0; i < hold; i++)
+    {
+        s.update(0);
+    }
+    CHECK(s.idle(), "not idle after a second hold");
+    s.configure(threshold, 0);
+    CHECK(s.update(0) == silence_active && !s.idle(), "still idle after silence off");
+
+    return test_result("silence");
+}
@@ -0,0 +1,123 @@
+#include <stdint.h>
+#include <string.h>
+#include <thread>
+
+#include "test.h"
+#include "spsc.h"
+
+/*
+    one producer and one consumer thread hammer a small ring; every
+    message must arrive once, in order and whole, which only holds if
+    the payload is published before the head (release/acquire)
+*/
+
+typedef struct
+{
+    uint32_t sequence;
+    uint32_t payload[31];
+} message_t;
+
+template <size_t Size>
+static void stress(uint32_t count)
+{
+    static SpscRing<message_t, Size> ring;
+    uint32_t fullSeen = 0, emptySeen = 0;
+    uint32_t received = 0, torn = 0, outOfOrder = 0, overCount = 0;
+
+    std::thread producer([&] {
+        for (uint32_t i = 0; i < count;)
+        {
+            message_t m;
+            m.sequence = i;
+            for (size_t k = 0; k < 31; k++)
+            {
+                m.payload[k] = i * 2654435761u + (uint32_t)k;
+            }
+            if (ring.push(m))
+            {
+                i++;
+            }
+            else
+            {
+                /* mostly spin, so the threads also get preempted mid-copy */
+                if (++fullSeen % 64 == 0)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    });
+
+    std::thread consumer([&] {
+        uint32_t expected = 0;
+        while (expected < count)
+        {
+            if (ring.count() > Size)
+            {
+                overCount++;
+            }
+            message_t m;
+            if (!ring.pop(&m))
+            {
+                if (++emptySeen % 64 == 0)
+                {
+                    std::this_thread::yield();
+                }
+                continue;
+            }
+            if (m.sequence != expected)
+            {
+                outOfOrder++;
+            }
+            for (size_t k = 0; k < 31; k++)
+            {
+                if (m.payload[k] != m.sequence * 2654435761u + (uint32_t)k)
+                {
+                    torn++;
+                    break;
+                }
+            }
+            expected = m.sequence + 1;
+            received++;
+        }
+    });
+
+    producer.join();
+    consumer.join();
+
+    message_t m;
+    CHECK(received == count, "size %zu: %u of %u received", Size, received, count);
+    CHECK(outOfOrder == 0, "size %zu: %u out of order", Size, outOfOrder);
+    CHECK(torn == 0, "size %zu: %u torn messages", Size, torn);
+    CHECK(overCount == 0, "size %zu: count above size %u times", Size, overCount);
+    CHECK(!ring.pop(&m), "size %zu: ring not empty", Size);
+    printf("size %zu: %u messages, producer saw full %u times, consumer saw empty %u times\n",
+           Size, count, fullSeen, emptySeen);
+}
+
+/* head and tail run freely and are only masked on access */
+static void wrap()
+{
+    SpscRing<uint32_t, 4> ring;
+    uint32_t v = 0;
+    for (uint32_t i = 0; i < 100; i++)
+    {
+        CHECK(ring.push(i) && ring.push(i + 1), "push %u", i);
+        CHECK(ring.pop(&v) && v == i, "pop %u", i);
+        CHECK(ring.pop(&v) && v == i + 1, "pop %u", i + 1);
+    }
+    for (uint32_t i = 0; i < 4; i++)
+    {
+        CHECK(ring.push(i), "fill %u", i);
+    }
+    CHECK(!ring.push(4), "push into a full ring");
+    CHECK(ring.count() == 4, "count %zu", ring.count());
+}
+
+int main()
+{
+    wrap();
+    stress<2>(200000);
+    stress<16>(1000000);
+    return test_result("spsc");
+}
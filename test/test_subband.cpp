@@ -0,0 +1,304 @@
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "test.h"
+#include "graph.h"
+#include "subband.h"
+
+/*
+    Subband split and merge against the contract in subband.h:
+      - an impulse comes out exactly SUBBAND_LATENCY samples later,
+        at every phase of the decimators; with the low band dropped
+        the change path is centered on the same sample with unity
+        gain at DC
+      - with the low band passed unchanged the output is the input
+        delayed bit for bit, in blocks of SUBBAND_FACTOR and of
+        SUBBAND_MAX_BLOCK, and through a split and merge in a Graph
+      - tones from Fs/16 to Fs/2 reach the low band at least
+        SUBBAND_STOPBAND_DB down
+      - a low shelf on the low band has the gain of the same shelf
+        at the full rate within SUBBAND_SHELF_DB from 20Hz to 20kHz,
+        and adds no tones of its own above SUBBAND_SPURIOUS_DB;
+        in a Graph it matches Subband and IIR called by hand bit for bit
+*/
+
+#define FS (48000.0)
+#define FULL_SCALE (1 << 23)
+/* low band level of tones above Fs/16, dB below the tone */
+#define SUBBAND_STOPBAND_DB (80.0)
+/* gain of the low band shelf against the full rate one, dB, a 300Hz
+    shelf is 0.06dB off at 500Hz */
+#define SUBBAND_SHELF_DB (0.1)
+/* everything but the tone in the output of the low band shelf, dB below
+    the tone; the worst is the small change at 2kHz, whose image at 4kHz
+    falls into the transition of the last interpolator (-61dB) */
+#define SUBBAND_SPURIOUS_DB (-58.0)
+/* samples the filters settle for before a measurement, and measured */
+#define SETTLE (9600)
+#define MEASURE (4800)
+#define LENGTH (SETTLE + MEASURE)
+
+static uint32_t noise_state = 1;
+
+static int32_t noise(int32_t level)
+{
+    noise_state = noise_state * 1664525 + 1013904223;
+    return (int32_t)(((int64_t)(int32_t)noise_state * level) >> 31);
+}
+
+static int32_t input[LENGTH];
+static int32_t output[LENGTH];
+static int32_t low[LENGTH / SUBBAND_FACTOR];
+
+/* the low band processing between split and merge, nullptr leaves it unchanged */
+typedef void (*low_band_t)(int32_t *low, size_t n, void *context);
+
+static void drop(int32_t *low, size_t n, void *)
+{
+    memset(low, 0, n * sizeof(int32_t));
+}
+
+static void filter(int32_t *low, size_t n, void *context)
+{
+    static_cast<IIR *>(context)->filterBlock(low, low, n);
+}
+
+/* input to output through a fresh Subband in blocks of n, keeps the low band */
+static void run(size_t block, low_band_t process = nullptr, void *context = nullptr)
+{
+    static Subband subband;
+    subband.reset();
+    for (size_t b = 0; b < LENGTH / block; b++)
+    {
+        int32_t *l = &low[b * block / SUBBAND_FACTOR];
+        int32_t processed[SUBBAND_MAX_BLOCK / SUBBAND_FACTOR];
+        subband.split(&input[b * block], l, block);
+        memcpy(processed, l, block / SUBBAND_FACTOR * sizeof(int32_t));
+        if (process)
+        {
+            process(processed, block / SUBBAND_FACTOR, context);
+        }
+        subband.merge(processed, &output[b * block], block);
+    }
+}
+
+/* least squares fit of a tone at f over the measured part of x */
+static void fit(const int32_t *x, size_t count, double f, double Fs, double *sine, double *cosine)
+{
+    double s = 0, c = 0;
+    for (size_t t = 0; t < count; t++)
+    {
+        s += x[t] * sin(2 * M_PI * f * t / Fs);
+        c += x[t] * cos(2 * M_PI * f * t / Fs);
+    }
+    *sine = 2 * s / count;
+    *cosine = 2 * c / count;
+}
+
+static void tone(double f, int32_t amplitude)
+{
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        input[t] = (int32_t)lrint(amplitude * sin(2 * M_PI * f * t / FS));
+    }
+}
+
+static void test_latency()
+{
+    for (size_t phase = 0; phase < SUBBAND_FACTOR; phase++)
+    {
+        const size_t at = 64 + phase;
+        memset(input, 0, sizeof(input));
+        input[at] = FULL_SCALE / 2;
+
+        run(SUBBAND_MAX_BLOCK);
+        size_t stray = 0;
+        for (size_t t = 0; t < LENGTH; t++)
+        {
+            stray += output[t] != (t == at + SUBBAND_LATENCY ? FULL_SCALE / 2 : 0);
+        }
+        CHECK(stray == 0, "impulse at phase %zu: %zu samples off", phase, stray);
+
+        /* out = in(n - latency) - I(D(in)), the change path alone */
+        run(SUBBAND_MAX_BLOCK, drop);
+        double sum = 0, moment = 0;
+        for (size_t t = 0; t < LENGTH; t++)
+        {
+            double change = (double)(t == at + SUBBAND_LATENCY ? FULL_SCALE / 2 : 0) - output[t];
+            sum += change;
+            moment += change * t;
+        }
+        double center = moment / sum - at;
+        CHECK(fabs(center - SUBBAND_LATENCY) < 0.01, "change path at phase %zu centered at %.3f", phase, center);
+        CHECK(fabs(sum / (FULL_SCALE / 2) - 1) < 1e-3, "change path at phase %zu has DC gain %.5f", phase, sum / (FULL_SCALE / 2));
+    }
+}
+
+static void test_passthrough()
+{
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        input[t] = noise(FULL_SCALE);
+    }
+
+    const size_t blocks[] = {SUBBAND_FACTOR, SUBBAND_MAX_BLOCK};
+    for (size_t block : blocks)
+    {
+        run(block);
+        size_t wrong = 0;
+        for (size_t t = 0; t < LENGTH; t++)
+        {
+            wrong += output[t] != (t >= SUBBAND_LATENCY ? input[t - SUBBAND_LATENCY] : 0);
+        }
+        CHECK(wrong == 0, "blocks of %zu: %zu samples off the delayed input", block, wrong);
+    }
+
+    static Graph graph;
+    const graph_node_t nodes[] = {
+        graph_input(0),
+        graph_split(0),
+        graph_merge(1, 1),
+        graph_output(2, 0),
+        graph_output(2, 1),
+    };
+    CHECK(graph.compile(nodes, sizeof(nodes) / sizeof(nodes[0])), "graph: %s", graph.error());
+    size_t wrong = 0;
+    for (size_t b = 0; b < LENGTH / GRAPH_BLOCK_SIZE; b++)
+    {
+        memcpy(graph.input(0), &input[b * GRAPH_BLOCK_SIZE], GRAPH_BLOCK_SIZE * sizeof(int32_t));
+        graph.process();
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            size_t t = b * GRAPH_BLOCK_SIZE + i;
+            wrong += graph.output(0)[i] != (t >= SUBBAND_LATENCY ? input[t - SUBBAND_LATENCY] : 0);
+        }
+    }
+    CHECK(wrong == 0, "graph: %zu samples off the delayed input", wrong);
+}
+
+static void test_stopband()
+{
+    const size_t settle = SETTLE / SUBBAND_FACTOR;
+    const size_t count = MEASURE / SUBBAND_FACTOR;
+
+    double worst = -200, at = 0;
+    for (double f = FS / 16; f < FS / 2; f += 50)
+    {
+        tone(f, FULL_SCALE);
+        run(SUBBAND_MAX_BLOCK);
+
+        double power = 0;
+        for (size_t t = settle; t < settle + count; t++)
+        {
+            power += (double)low[t] * low[t];
+        }
+        double dB = 10 * log10(power / count / (0.5 * FULL_SCALE * FULL_SCALE) + 1e-30);
+        if (dB > worst)
+        {
+            worst = dB;
+            at = f;
+        }
+    }
+    CHECK(worst < -SUBBAND_STOPBAND_DB, "%.0fHz reaches the low band at %.1fdB", at, worst);
+}
+
+static void test_shelf()
+{
+    const double Fl = FS / SUBBAND_FACTOR;
+    const float shelves[][2] = {{100, 12}, {100, -12}, {300, 6}};
+    /* whole cycles in MEASURE samples */
+    const double frequencies[] = {20, 30, 50, 70, 100, 150, 200, 300, 500, 700, 1000,
+                                  1500, 2000, 3000, 5000, 7000, 10000, 15000, 20000};
+
+    for (auto &shelf : shelves)
+    {
+        biquad_design_t full = biquad_design(lowshelf, shelf[0], BIQUAD_Q_ORDER_2, shelf[1], FS);
+        biquad_design_t band = biquad_design(lowshelf, shelf[0], BIQUAD_Q_ORDER_2, shelf[1], Fl);
+
+        double worstGain = 0, gainAt = 0, worstSpurious = -200, spuriousAt = 0;
+        for (double f : frequencies)
+        {
+            const int32_t amplitude = FULL_SCALE / 8;
+            tone(f, amplitude);
+
+            IIR reference;
+            reference.setCoefficients(IIR::quantize(full));
+            reference.filterBlock(input, output, LENGTH);
+            double s, c;
+            fit(&output[SETTLE], MEASURE, f, FS, &s, &c);
+            double expected = 20 * log10(hypot(s, c) / amplitude);
+
+            IIR biquad;
+            biquad.setCoefficients(IIR::quantize(band));
+            run(SUBBAND_MAX_BLOCK, filter, &biquad);
+            fit(&output[SETTLE], MEASURE, f, FS, &s, &c);
+            double gain = 20 * log10(hypot(s, c) / amplitude);
+            if (fabs(gain - expected) > fabs(worstGain))
+            {
+                worstGain = gain - expected;
+                gainAt = f;
+            }
+
+            /* what is left once the tone is taken out */
+            double power = 0;
+            for (size_t t = 0; t < MEASURE; t++)
+            {
+                double w = 2 * M_PI * f * t / FS;
+                double rest = output[SETTLE + t] - s * sin(w) - c * cos(w);
+                power += rest * rest;
+            }
+            double spurious = 10 * log10(power / MEASURE / (0.5 * (s * s + c * c)) + 1e-30);
+            if (spurious > worstSpurious)
+            {
+                worstSpurious = spurious;
+                spuriousAt = f;
+            }
+        }
+        CHECK(fabs(worstGain) < SUBBAND_SHELF_DB, "%.0fHz %+.0fdB shelf: %.3fdB off at %.0fHz",
+              shelf[0], shelf[1], worstGain, gainAt);
+        CHECK(worstSpurious < SUBBAND_SPURIOUS_DB, "%.0fHz %+.0fdB shelf: spurious %.1fdB at %.0fHz",
+              shelf[0], shelf[1], worstSpurious, spuriousAt);
+    }
+
+    /* the same shelf as a low band node of a graph */
+    for (size_t t = 0; t < LENGTH; t++)
+    {
+        input[t] = noise(FULL_SCALE / 4);
+    }
+    biquad_design_t band = biquad_design(lowshelf, 100, BIQUAD_Q_ORDER_2, 12, Fl);
+    IIR biquad;
+    biquad.setCoefficients(IIR::quantize(band));
+    run(GRAPH_BLOCK_SIZE, filter, &biquad);
+
+    static Graph graph;
+    const graph_node_t nodes[] = {
+        graph_input(0),
+        graph_split(0),
+        graph_biquad(1, band),
+        graph_merge(2, 1),
+        graph_output(3, 0),
+        graph_output(3, 1),
+    };
+    CHECK(graph.compile(nodes, sizeof(nodes) / sizeof(nodes[0])), "graph: %s", graph.error());
+    size_t wrong = 0;
+    for (size_t b = 0; b < LENGTH / GRAPH_BLOCK_SIZE; b++)
+    {
+        memcpy(graph.input(0), &input[b * GRAPH_BLOCK_SIZE], GRAPH_BLOCK_SIZE * sizeof(int32_t));
+        graph.process();
+        for (size_t i = 0; i < GRAPH_BLOCK_SIZE; i++)
+        {
+            wrong += graph.output(0)[i] != output[b * GRAPH_BLOCK_SIZE + i];
+        }
+    }
+    CHECK(wrong == 0, "graph shelf: %zu samples off Subband and IIR", wrong);
+}
+
+int main()
+{
+    test_latency();
+    test_passthrough();
+    test_stopband();
+    test_shelf();
+    return test_result("subband");
+}